@@ -0,0 +1,292 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "buffer_arena.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+#include <utki/debug.hpp>
+
+#include "resource_census.hpp"
+#include "state_cache.hpp"
+#include "util.hpp"
+
+using namespace ruis::render::opengl;
+
+buffer_arena::~buffer_arena()
+{
+	for (const auto& p : this->pages) {
+		ASSERT(p->blocks.empty())
+		this->gl_state.on_buffer_deleted(p->buffer);
+		glDeleteBuffers(1, &p->buffer);
+		assert_opengl_no_error();
+		this->census.on_destroyed(resource_kind::buffer, page_size);
+	}
+}
+
+void buffer_arena::bind(GLuint buffer)
+{
+	if (this->target == GL_ELEMENT_ARRAY_BUFFER) {
+		this->gl_state.bind_default_element_array_buffer(buffer);
+	} else {
+		this->gl_state.bind_buffer(this->target, buffer);
+	}
+}
+
+buffer_arena::page& buffer_arena::add_page()
+{
+	auto p = std::make_unique<page>();
+
+	glGenBuffers(1, &p->buffer);
+	assert_opengl_no_error();
+
+	this->bind(p->buffer);
+
+	glBufferData(
+		this->target, //
+		GLsizeiptr(page_size),
+		nullptr,
+		GL_STATIC_DRAW
+	);
+	assert_opengl_no_error();
+
+	p->free_ranges.emplace(0, page_size);
+
+	this->census.on_created(resource_kind::buffer, page_size);
+
+	this->pages.push_back(std::move(p));
+	return *this->pages.back();
+}
+
+buffer_arena::block* buffer_arena::allocate(size_t size)
+{
+	if (!this->enabled || size > max_block_size) {
+		return nullptr;
+	}
+
+	size = std::max((size + alignment - 1) / alignment * alignment, alignment);
+
+	auto take = [&](page& p, std::map<size_t, size_t>::iterator range) -> block* {
+		auto offset = range->first;
+		auto remaining = range->second - size;
+
+		p.free_ranges.erase(range);
+		if (remaining != 0) {
+			p.free_ranges.emplace(offset + size, remaining);
+		}
+
+		p.used += size;
+
+		auto b = std::make_unique<block>(block{
+			.page = &p, //
+			.buffer = p.buffer,
+			.offset = offset,
+			.size = size
+		});
+		auto ret = b.get();
+		p.blocks.emplace(offset, std::move(b));
+		return ret;
+	};
+
+	// first fit
+	for (auto& p : this->pages) {
+		auto i = std::find_if(
+			p->free_ranges.begin(), //
+			p->free_ranges.end(),
+			[&](const auto& r) {
+				return r.second >= size;
+			}
+		);
+		if (i != p->free_ranges.end()) {
+			return take(*p, i);
+		}
+	}
+
+	auto& p = this->add_page();
+	return take(p, p.free_ranges.begin());
+}
+
+void buffer_arena::free(block* b)
+{
+	ASSERT(b)
+
+	auto pi = std::find_if(
+		this->pages.begin(), //
+		this->pages.end(),
+		[&](const auto& p) {
+			return p.get() == b->page;
+		}
+	);
+	ASSERT(pi != this->pages.end())
+	auto& p = **pi;
+
+	auto offset = b->offset;
+	auto size = b->size;
+
+	ASSERT(p.blocks.find(offset) != p.blocks.end())
+	p.blocks.erase(offset);
+	p.used -= size;
+
+	auto i = p.free_ranges.emplace(offset, size).first;
+
+	// merge with the next free range
+	if (auto next = std::next(i); next != p.free_ranges.end() && i->first + i->second == next->first) {
+		i->second += next->second;
+		p.free_ranges.erase(next);
+	}
+
+	// merge with the previous free range
+	if (i != p.free_ranges.begin()) {
+		auto prev = std::prev(i);
+		if (prev->first + prev->second == i->first) {
+			prev->second += i->second;
+			p.free_ranges.erase(i);
+		}
+	}
+}
+
+void buffer_arena::move_out(block* b)
+{
+	this->free(b);
+	++this->generation;
+}
+
+void buffer_arena::defragment()
+{
+	// release empty pages
+	this->pages.erase(
+		std::remove_if(
+			this->pages.begin(), //
+			this->pages.end(),
+			[this](const auto& p) {
+				if (!p->blocks.empty()) {
+					return false;
+				}
+				this->gl_state.on_buffer_deleted(p->buffer);
+				glDeleteBuffers(1, &p->buffer);
+				assert_opengl_no_error();
+				this->census.on_destroyed(resource_kind::buffer, page_size);
+				return true;
+			}
+		),
+		this->pages.end()
+	);
+
+	if (!this->copy_buffer_supported) {
+		return;
+	}
+
+	// Source and destination ranges of glCopyBufferSubData() must not overlap within same buffer,
+	// so the blocks are gathered in a scratch buffer and then copied back in one go.
+	GLuint scratch = 0;
+
+	for (auto& p : this->pages) {
+		if (p->free_ranges.empty()) {
+			// page is full
+			continue;
+		}
+
+		if (p->free_ranges.size() == 1 && p->free_ranges.begin()->first == p->used) {
+			// page is already compact
+			continue;
+		}
+
+		if (scratch == 0) {
+			glGenBuffers(1, &scratch);
+			assert_opengl_no_error();
+
+			// copy targets are not tracked by the state cache
+			glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+			glBufferData(
+				GL_COPY_WRITE_BUFFER, //
+				GLsizeiptr(page_size),
+				nullptr,
+				GL_STREAM_COPY
+			);
+			assert_opengl_no_error();
+		}
+
+		glBindBuffer(GL_COPY_READ_BUFFER, p->buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, scratch);
+		assert_opengl_no_error();
+
+		decltype(p->blocks) blocks;
+		size_t end = 0;
+		for (auto& [offset, b] : p->blocks) {
+			ASSERT(b->offset == offset)
+			glCopyBufferSubData(
+				GL_COPY_READ_BUFFER, //
+				GL_COPY_WRITE_BUFFER,
+				GLintptr(offset),
+				GLintptr(end),
+				GLsizeiptr(b->size)
+			);
+			assert_opengl_no_error();
+
+			auto new_offset = end;
+			end += b->size;
+			b->offset = new_offset;
+			blocks.emplace(new_offset, std::move(b));
+		}
+		ASSERT(end == p->used)
+
+		glBindBuffer(GL_COPY_READ_BUFFER, scratch);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, p->buffer);
+		glCopyBufferSubData(
+			GL_COPY_READ_BUFFER, //
+			GL_COPY_WRITE_BUFFER,
+			0,
+			0,
+			GLsizeiptr(end)
+		);
+		assert_opengl_no_error();
+
+		p->blocks = std::move(blocks);
+
+		p->free_ranges.clear();
+		p->free_ranges.emplace(end, page_size - end);
+	}
+
+	if (scratch != 0) {
+		glDeleteBuffers(1, &scratch);
+		assert_opengl_no_error();
+		++this->generation;
+	}
+}
+
+buffer_arena::statistics buffer_arena::get_statistics() const noexcept
+{
+	statistics ret;
+
+	ret.num_pages = this->pages.size();
+
+	for (const auto& p : this->pages) {
+		ret.num_blocks += p->blocks.size();
+		ret.capacity += page_size;
+		ret.used += p->used;
+		for (const auto& r : p->free_ranges) {
+			ret.largest_free_range = std::max(ret.largest_free_range, r.second);
+		}
+	}
+
+	return ret;
+}
@@ -0,0 +1,259 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <GL/glew.h>
+
+namespace ruis::render::opengl {
+
+class resource_census;
+class state_cache;
+
+/**
+ * @brief Sub-allocator of small buffers from large OpenGL buffer objects.
+ * Small vertex and index buffers are placed into shared pages, so that thousands
+ * of small meshes do not require thousands of OpenGL buffer objects.
+ * Each page keeps a list of free ranges, adjacent free ranges are merged on free.
+ * Allocations never move between pages, so the OpenGL buffer object of an allocation
+ * never changes, only its offset may change on defragmentation.
+ */
+class buffer_arena
+{
+public:
+	/**
+	 * @brief Allocation within the arena.
+	 */
+	struct block {
+		// page the block belongs to
+		const void* const page;
+
+		/**
+		 * @brief OpenGL buffer object the block is allocated within.
+		 */
+		const GLuint buffer;
+
+		/**
+		 * @brief Offset of the block within the buffer object in bytes.
+		 * Can change on defragmentation.
+		 */
+		size_t offset;
+
+		/**
+		 * @brief Size of the block in bytes.
+		 */
+		const size_t size;
+	};
+
+	struct statistics {
+		size_t num_pages = 0;
+		size_t num_blocks = 0;
+
+		/**
+		 * @brief Total size of all pages in bytes.
+		 */
+		size_t capacity = 0;
+
+		/**
+		 * @brief Total size of all blocks in bytes.
+		 */
+		size_t used = 0;
+
+		/**
+		 * @brief Largest free range among all pages in bytes.
+		 */
+		size_t largest_free_range = 0;
+
+		/**
+		 * @brief Fraction of allocated bytes.
+		 * @return Value from 0 to 1.
+		 */
+		float occupancy() const noexcept
+		{
+			if (this->capacity == 0) {
+				return 0;
+			}
+			return float(this->used) / float(this->capacity);
+		}
+
+		/**
+		 * @brief External fragmentation of free space.
+		 * Zero when all free space is in a single range, close to 1 when free space is scattered
+		 * among many small ranges.
+		 * @return Value from 0 to 1.
+		 */
+		float fragmentation() const noexcept
+		{
+			auto free = this->capacity - this->used;
+			if (free == 0) {
+				return 0;
+			}
+			return 1 - float(this->largest_free_range) / float(free);
+		}
+	};
+
+	/**
+	 * @brief Size of a page in bytes.
+	 */
+	constexpr static const size_t page_size = size_t(1024) * 1024;
+
+	/**
+	 * @brief Maximum size of a block in bytes.
+	 * Larger buffers get dedicated OpenGL buffer objects.
+	 */
+	constexpr static const size_t max_block_size = size_t(64) * 1024;
+
+	/**
+	 * @brief Alignment of blocks in bytes.
+	 */
+	constexpr static const size_t alignment = 16;
+
+private:
+	state_cache& gl_state;
+
+	resource_census& census;
+
+	const GLenum target;
+
+	const bool copy_buffer_supported;
+
+	bool enabled = true;
+
+	struct page {
+		GLuint buffer = 0;
+
+		// offset -> size
+		std::map<size_t, size_t> free_ranges;
+
+		// offset -> block
+		std::map<size_t, std::unique_ptr<block>> blocks;
+
+		size_t used = 0;
+	};
+
+	std::vector<std::unique_ptr<page>> pages;
+
+	// incremented every time some blocks are moved
+	unsigned generation = 0;
+
+public:
+	/**
+	 * @param gl_state - state cache of the owning context.
+	 * @param census - resource census of the owning context, pages are counted in it.
+	 * @param target - either GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER.
+	 *                 Vertex and index data are kept in separate pages, because some
+	 *                 OpenGL implementations (e.g. WebGL) do not allow using same buffer object for both.
+	 * @param copy_buffer_supported - whether glCopyBufferSubData() is supported, needed for defragmentation.
+	 */
+	buffer_arena(
+		state_cache& gl_state, //
+		resource_census& census,
+		GLenum target,
+		bool copy_buffer_supported
+	) :
+		gl_state(gl_state),
+		census(census),
+		target(target),
+		copy_buffer_supported(copy_buffer_supported)
+	{}
+
+	buffer_arena(const buffer_arena&) = delete;
+	buffer_arena& operator=(const buffer_arena&) = delete;
+
+	buffer_arena(buffer_arena&&) = delete;
+	buffer_arena& operator=(buffer_arena&&) = delete;
+
+	~buffer_arena();
+
+	bool is_enabled() const noexcept
+	{
+		return this->enabled;
+	}
+
+	/**
+	 * @brief Enable or disable sub-allocation.
+	 * Disabling does not affect existing allocations.
+	 * Enabled by default.
+	 * @param enable - whether to enable sub-allocation.
+	 */
+	void set_enabled(bool enable) noexcept
+	{
+		this->enabled = enable;
+	}
+
+	/**
+	 * @brief Allocate block.
+	 * The storage of the page the block is allocated from is not initialized.
+	 * @param size - size of the block in bytes.
+	 * @return Allocated block.
+	 * @return nullptr in case sub-allocation is disabled or requested size is larger than max_block_size.
+	 */
+	block* allocate(size_t size);
+
+	/**
+	 * @brief Free block.
+	 * @param b - block to free.
+	 */
+	void free(block* b);
+
+	/**
+	 * @brief Free block which data has been moved out of the arena.
+	 * Same as free(), but also increments the generation, since the data of the block
+	 * now lives in another buffer object.
+	 * @param b - block to free.
+	 */
+	void move_out(block* b);
+
+	/**
+	 * @brief Compact blocks within each page.
+	 * Moves blocks towards the beginning of their pages, so that free space of each page
+	 * forms a single range. Pages without blocks are released.
+	 * Block offsets are changed, so the generation is incremented in case any block was moved.
+	 * Only pages are released in case copying between buffers is not supported.
+	 */
+	void defragment();
+
+	/**
+	 * @brief Get generation number.
+	 * The generation number changes every time block offsets change
+	 * or some block is moved out of the arena.
+	 * Users which cache block offsets can compare generation numbers to find out
+	 * if the cached offsets are still valid.
+	 * @return Generation number.
+	 */
+	unsigned get_generation() const noexcept
+	{
+		return this->generation;
+	}
+
+	statistics get_statistics() const noexcept;
+
+private:
+	page& add_page();
+
+	void bind(GLuint buffer);
+};
+
+} // namespace ruis::render::opengl
@@ -0,0 +1,497 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+#include "compressed_image.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+#include <utki/debug.hpp>
+
+using namespace ruis::render::opengl;
+
+namespace {
+constexpr uint32_t block_dim = 4;
+
+using rgba = std::array<uint8_t, 4>;
+
+// pixels of a decoded block, the index is y * block_dim + x
+using block_pixels = std::array<rgba, size_t(block_dim * block_dim)>;
+
+uint8_t clamp_to_byte(int v)
+{
+	constexpr auto max_byte = 0xff;
+	return uint8_t(std::clamp(v, 0, max_byte));
+}
+
+uint64_t read_big_endian_64(utki::span<const uint8_t> p)
+{
+	uint64_t ret = 0;
+	for (size_t i = 0; i != sizeof(uint64_t); ++i) {
+		ret = (ret << 8) | uint64_t(p[i]);
+	}
+	return ret;
+}
+
+uint64_t read_little_endian(
+	utki::span<const uint8_t> p, //
+	size_t num_bytes
+)
+{
+	uint64_t ret = 0;
+	for (size_t i = 0; i != num_bytes; ++i) {
+		ret |= uint64_t(p[i]) << (i * 8);
+	}
+	return ret;
+}
+
+// decodes BC1 color block, also used as color part of BC2 and BC3 blocks
+void decode_bc1_color(
+	utki::span<const uint8_t> p, //
+	block_pixels& out,
+	bool is_bc1
+)
+{
+	auto c0 = unsigned(read_little_endian(p, 2));
+	auto c1 = unsigned(read_little_endian(p.subspan(2), 2));
+
+	// expand 5:6:5 color to 8 bits per component
+	auto to_rgb = [](unsigned c) -> std::array<int, 3> {
+		auto r = int((c >> 11) & 0x1f);
+		auto g = int((c >> 5) & 0x3f);
+		auto b = int(c & 0x1f);
+		return {(r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2)};
+	};
+
+	auto e0 = to_rgb(c0);
+	auto e1 = to_rgb(c1);
+
+	std::array<rgba, 4> palette{};
+	for (size_t i = 0; i != e0.size(); ++i) {
+		palette[0][i] = uint8_t(e0[i]);
+		palette[1][i] = uint8_t(e1[i]);
+
+		// BC2 and BC3 always use the 4 color mode
+		if (c0 > c1 || !is_bc1) {
+			palette[2][i] = uint8_t((2 * e0[i] + e1[i]) / 3);
+			palette[3][i] = uint8_t((e0[i] + 2 * e1[i]) / 3);
+		} else {
+			palette[2][i] = uint8_t((e0[i] + e1[i]) / 2);
+			palette[3][i] = 0;
+		}
+	}
+	palette[0][3] = 0xff;
+	palette[1][3] = 0xff;
+	palette[2][3] = 0xff;
+	palette[3][3] = c0 > c1 || !is_bc1 ? 0xff : 0; // transparent black in 3 color mode
+
+	auto indices = read_little_endian(p.subspan(4), 4);
+	for (size_t i = 0; i != out.size(); ++i) {
+		out[i] = palette[(indices >> (2 * i)) & 0x3];
+	}
+}
+
+void decode_bc2_alpha(
+	utki::span<const uint8_t> p, //
+	block_pixels& out
+)
+{
+	auto alphas = read_little_endian(p, sizeof(uint64_t));
+	for (size_t i = 0; i != out.size(); ++i) {
+		constexpr auto expand_4bit = 17;
+		out[i][3] = uint8_t(((alphas >> (4 * i)) & 0xf) * expand_4bit);
+	}
+}
+
+void decode_bc3_alpha(
+	utki::span<const uint8_t> p, //
+	block_pixels& out
+)
+{
+	auto a0 = int(p[0]);
+	auto a1 = int(p[1]);
+
+	std::array<uint8_t, 8> palette{};
+	palette[0] = uint8_t(a0);
+	palette[1] = uint8_t(a1);
+	if (a0 > a1) {
+		for (int k = 1; k != 7; ++k) {
+			palette[size_t(k) + 1] = uint8_t(((7 - k) * a0 + k * a1) / 7);
+		}
+	} else {
+		for (int k = 1; k != 5; ++k) {
+			palette[size_t(k) + 1] = uint8_t(((5 - k) * a0 + k * a1) / 5);
+		}
+		palette[6] = 0;
+		palette[7] = 0xff;
+	}
+
+	constexpr auto num_index_bytes = 6;
+	auto indices = read_little_endian(p.subspan(2), num_index_bytes);
+	for (size_t i = 0; i != out.size(); ++i) {
+		out[i][3] = palette[(indices >> (3 * i)) & 0x7];
+	}
+}
+
+// ETC1 intensity modifiers, {small, large} per table
+constexpr std::array<std::array<int, 2>, 8> etc1_modifiers = {
+	{{2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}}
+};
+
+// ETC2 T and H modes distances
+constexpr std::array<int, 8> etc2_distances = {3, 6, 11, 16, 23, 32, 41, 64};
+
+// EAC alpha modifiers
+constexpr std::array<std::array<int, 8>, 16> eac_modifiers = {
+	{{-3, -6, -9, -15, 2, 5, 8, 14},
+	 {-3, -7, -10, -13, 2, 6, 9, 12},
+	 {-2, -5, -8, -13, 1, 4, 7, 12},
+	 {-2, -4, -6, -13, 1, 3, 5, 12},
+	 {-3, -6, -8, -12, 2, 5, 7, 11},
+	 {-3, -7, -9, -11, 2, 6, 8, 10},
+	 {-4, -7, -8, -11, 3, 6, 7, 10},
+	 {-3, -5, -8, -11, 2, 4, 7, 10},
+	 {-2, -6, -8, -10, 1, 5, 7, 9},
+	 {-2, -5, -8, -10, 1, 4, 7, 9},
+	 {-2, -4, -8, -10, 1, 3, 7, 9},
+	 {-2, -5, -7, -10, 1, 4, 6, 9},
+	 {-3, -4, -7, -10, 2, 3, 6, 9},
+	 {-1, -2, -3, -10, 0, 1, 2, 9},
+	 {-4, -6, -8, -9, 3, 5, 7, 8},
+	 {-3, -5, -7, -9, 2, 4, 6, 8}}
+};
+
+int extend_4bit(int v)
+{
+	return (v << 4) | v;
+}
+
+int extend_5bit(int v)
+{
+	return (v << 3) | (v >> 2);
+}
+
+int extend_6bit(int v)
+{
+	return (v << 2) | (v >> 4);
+}
+
+int extend_7bit(int v)
+{
+	return (v << 1) | (v >> 6);
+}
+
+void decode_etc2_color(
+	utki::span<const uint8_t> p, //
+	block_pixels& out
+)
+{
+	auto block = read_big_endian_64(p);
+
+	// get bits from high to low inclusive
+	auto bits = [block](unsigned high, unsigned low) {
+		return int((block >> low) & ((uint64_t(1) << (high - low + 1)) - 1));
+	};
+
+	// pixels are indexed column by column, the index bits are split into the low and high halves
+	auto indices = uint32_t(block);
+	auto pixel_index = [indices](uint32_t x, uint32_t y) {
+		auto i = x * block_dim + y;
+		return (((indices >> (i + 16)) & 1) << 1) | ((indices >> i) & 1);
+	};
+
+	auto set_pixel = [&out](uint32_t x, uint32_t y, const std::array<int, 3>& c) {
+		out[y * block_dim + x] = {clamp_to_byte(c[0]), clamp_to_byte(c[1]), clamp_to_byte(c[2]), 0xff};
+	};
+
+	// decode using four paint colors, T and H modes
+	auto decode_paint_colors = [&](const std::array<std::array<int, 3>, 4>& paint) {
+		for (uint32_t y = 0; y != block_dim; ++y) {
+			for (uint32_t x = 0; x != block_dim; ++x) {
+				set_pixel(x, y, paint[pixel_index(x, y)]);
+			}
+		}
+	};
+
+	// decode two sub-blocks with base colors and intensity modifier tables, ETC1 compatible modes
+	auto decode_sub_blocks = [&](const std::array<int, 3>& c1, const std::array<int, 3>& c2) {
+		bool flip = bits(32, 32) != 0;
+		std::array<int, 2> tables = {bits(39, 37), bits(36, 34)};
+		for (uint32_t y = 0; y != block_dim; ++y) {
+			for (uint32_t x = 0; x != block_dim; ++x) {
+				bool second = flip ? y >= 2 : x >= 2;
+				const auto& m = etc1_modifiers[size_t(tables[second ? 1 : 0])];
+				auto index = pixel_index(x, y);
+				int modifier = m[index & 1];
+				if (index & 2) {
+					modifier = -modifier;
+				}
+				const auto& c = second ? c2 : c1;
+				set_pixel(x, y, {c[0] + modifier, c[1] + modifier, c[2] + modifier});
+			}
+		}
+	};
+
+	bool diff = bits(33, 33) != 0;
+	if (!diff) {
+		// individual mode
+		decode_sub_blocks(
+			{extend_4bit(bits(63, 60)), extend_4bit(bits(55, 52)), extend_4bit(bits(47, 44))},
+			{extend_4bit(bits(59, 56)), extend_4bit(bits(51, 48)), extend_4bit(bits(43, 40))}
+		);
+		return;
+	}
+
+	auto sign_extend_3bit = [](int v) {
+		return v >= 4 ? v - 8 : v;
+	};
+
+	int r = bits(63, 59);
+	int g = bits(55, 51);
+	int b = bits(47, 43);
+	int r2 = r + sign_extend_3bit(bits(58, 56));
+	int g2 = g + sign_extend_3bit(bits(50, 48));
+	int b2 = b + sign_extend_3bit(bits(42, 40));
+
+	constexpr auto max_5bit = 31;
+
+	if (r2 < 0 || r2 > max_5bit) {
+		// T mode
+		std::array<int, 3> c1 = {
+			extend_4bit((bits(60, 59) << 2) | bits(57, 56)),
+			extend_4bit(bits(55, 52)),
+			extend_4bit(bits(51, 48))
+		};
+		std::array<int, 3> c2 = {extend_4bit(bits(47, 44)), extend_4bit(bits(43, 40)), extend_4bit(bits(39, 36))};
+		int d = etc2_distances[size_t((bits(35, 34) << 1) | bits(32, 32))];
+		decode_paint_colors({
+			{c1, {c2[0] + d, c2[1] + d, c2[2] + d}, c2, {c2[0] - d, c2[1] - d, c2[2] - d}}
+		});
+	} else if (g2 < 0 || g2 > max_5bit) {
+		// H mode
+		std::array<int, 3> v1 = {bits(62, 59), (bits(58, 56) << 1) | bits(52, 52), (bits(51, 51) << 3) | bits(49, 47)};
+		std::array<int, 3> v2 = {bits(46, 43), bits(42, 39), bits(38, 35)};
+
+		// the lowest bit of the distance index is given by the ordering of the base colors
+		int ordering = ((v1[0] << 8) | (v1[1] << 4) | v1[2]) >= ((v2[0] << 8) | (v2[1] << 4) | v2[2]) ? 1 : 0;
+		int d = etc2_distances[size_t((bits(34, 34) << 2) | (bits(32, 32) << 1) | ordering)];
+
+		std::array<int, 3> c1 = {extend_4bit(v1[0]), extend_4bit(v1[1]), extend_4bit(v1[2])};
+		std::array<int, 3> c2 = {extend_4bit(v2[0]), extend_4bit(v2[1]), extend_4bit(v2[2])};
+		decode_paint_colors({
+			{{c1[0] + d, c1[1] + d, c1[2] + d},
+			 {c1[0] - d, c1[1] - d, c1[2] - d},
+			 {c2[0] + d, c2[1] + d, c2[2] + d},
+			 {c2[0] - d, c2[1] - d, c2[2] - d}}
+		});
+	} else if (b2 < 0 || b2 > max_5bit) {
+		// planar mode
+		std::array<int, 3> o = {
+			extend_6bit(bits(62, 57)),
+			extend_7bit((bits(56, 56) << 6) | bits(54, 49)),
+			extend_6bit((bits(48, 48) << 5) | (bits(44, 43) << 3) | bits(41, 39))
+		};
+		std::array<int, 3> h = {
+			extend_6bit((bits(38, 34) << 1) | bits(32, 32)),
+			extend_7bit(bits(31, 25)),
+			extend_6bit(bits(24, 19))
+		};
+		std::array<int, 3> v = {extend_6bit(bits(18, 13)), extend_7bit(bits(12, 6)), extend_6bit(bits(5, 0))};
+
+		for (uint32_t y = 0; y != block_dim; ++y) {
+			for (uint32_t x = 0; x != block_dim; ++x) {
+				std::array<int, 3> c{};
+				for (size_t i = 0; i != c.size(); ++i) {
+					c[i] = (int(x) * (h[i] - o[i]) + int(y) * (v[i] - o[i]) + 4 * o[i] + 2) >> 2;
+				}
+				set_pixel(x, y, c);
+			}
+		}
+	} else {
+		// differential mode
+		decode_sub_blocks(
+			{extend_5bit(r), extend_5bit(g), extend_5bit(b)},
+			{extend_5bit(r2), extend_5bit(g2), extend_5bit(b2)}
+		);
+	}
+}
+
+void decode_eac_alpha(
+	utki::span<const uint8_t> p, //
+	block_pixels& out
+)
+{
+	auto base = int(p[0]);
+	auto multiplier = int(p[1] >> 4);
+	const auto& m = eac_modifiers[size_t(p[1] & 0xf)];
+
+	// 3-bit indices follow column by column starting from the most significant bits
+	auto block = read_big_endian_64(p);
+	for (uint32_t i = 0; i != block_dim * block_dim; ++i) {
+		auto index = size_t((block >> (45 - 3 * i)) & 0x7);
+		auto x = i / block_dim;
+		auto y = i % block_dim;
+		out[y * block_dim + x][3] = clamp_to_byte(base + m[index] * multiplier);
+	}
+}
+
+void decode_block(
+	compressed_format f, //
+	utki::span<const uint8_t> p,
+	block_pixels& out
+)
+{
+	constexpr auto half_block_size = 8;
+
+	switch (f) {
+		case compressed_format::bc1_rgb:
+		case compressed_format::bc1_rgba:
+			decode_bc1_color(p, out, true);
+			break;
+		case compressed_format::bc2_rgba:
+			decode_bc1_color(p.subspan(half_block_size), out, false);
+			decode_bc2_alpha(p, out);
+			break;
+		case compressed_format::bc3_rgba:
+			decode_bc1_color(p.subspan(half_block_size), out, false);
+			decode_bc3_alpha(p, out);
+			break;
+		case compressed_format::etc2_rgb8:
+			decode_etc2_color(p, out);
+			break;
+		case compressed_format::etc2_rgba8:
+			decode_etc2_color(p.subspan(half_block_size), out);
+			decode_eac_alpha(p, out);
+			break;
+		default:
+			ASSERT(false)
+			break;
+	}
+}
+} // namespace
+
+GLenum ruis::render::opengl::to_gl_internal_format(compressed_format f)
+{
+	switch (f) {
+		case compressed_format::bc1_rgb:
+			return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case compressed_format::bc1_rgba:
+			return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+		case compressed_format::bc2_rgba:
+			return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+		case compressed_format::bc3_rgba:
+			return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case compressed_format::etc2_rgb8:
+			return GL_COMPRESSED_RGB8_ETC2;
+		case compressed_format::etc2_rgba8:
+			return GL_COMPRESSED_RGBA8_ETC2_EAC;
+		case compressed_format::astc_4x4_rgba:
+			return GL_COMPRESSED_RGBA_ASTC_4x4_KHR;
+		default:
+			utki::assert(false, SL);
+			return 0;
+	}
+}
+
+size_t ruis::render::opengl::to_block_size(compressed_format f)
+{
+	switch (f) {
+		case compressed_format::bc1_rgb:
+		case compressed_format::bc1_rgba:
+		case compressed_format::etc2_rgb8:
+			return 8; // NOLINT(cppcoreguidelines-avoid-magic-numbers)
+		default:
+			return 16; // NOLINT(cppcoreguidelines-avoid-magic-numbers)
+	}
+}
+
+rasterimage::format ruis::render::opengl::to_decompressed_format(compressed_format f)
+{
+	switch (f) {
+		case compressed_format::bc1_rgb:
+		case compressed_format::etc2_rgb8:
+			return rasterimage::format::rgb;
+		default:
+			return rasterimage::format::rgba;
+	}
+}
+
+size_t ruis::render::opengl::calc_compressed_size(
+	compressed_format f, //
+	r4::vector2<uint32_t> dims
+)
+{
+	auto num_blocks_x = size_t((dims.x() + block_dim - 1) / block_dim);
+	auto num_blocks_y = size_t((dims.y() + block_dim - 1) / block_dim);
+	return num_blocks_x * num_blocks_y * to_block_size(f);
+}
+
+bool ruis::render::opengl::can_decompress(compressed_format f)
+{
+	// ASTC decoding is too heavy to be a fallback
+	return f != compressed_format::astc_4x4_rgba;
+}
+
+std::vector<uint8_t> ruis::render::opengl::decompress(const compressed_image& image)
+{
+	if (!can_decompress(image.format)) {
+		throw std::invalid_argument(
+			"decompress(): "
+			"the compressed format cannot be decompressed on CPU"
+		);
+	}
+
+	if (image.levels.empty() || image.levels.front().size() < calc_compressed_size(image.format, image.dims)) {
+		throw std::invalid_argument(
+			"decompress(): "
+			"compressed image data is too small"
+		);
+	}
+
+	const auto& dims = image.dims;
+	auto num_channels = size_t(rasterimage::to_num_channels(to_decompressed_format(image.format)));
+	auto block_size = to_block_size(image.format);
+	auto data = image.levels.front();
+
+	std::vector<uint8_t> ret(size_t(dims.x()) * size_t(dims.y()) * num_channels);
+
+	block_pixels block{};
+	size_t offset = 0;
+	for (uint32_t by = 0; by < dims.y(); by += block_dim) {
+		for (uint32_t bx = 0; bx < dims.x(); bx += block_dim) {
+			decode_block(image.format, data.subspan(offset, block_size), block);
+			offset += block_size;
+
+			// copy the block pixels which are within the image, the blocks on the right
+			// and bottom edges can be partially outside of the image
+			auto w = std::min(block_dim, dims.x() - bx);
+			auto h = std::min(block_dim, dims.y() - by);
+			for (uint32_t y = 0; y != h; ++y) {
+				auto dst = std::next(ret.begin(), std::ptrdiff_t(((size_t(by + y) * dims.x()) + bx) * num_channels));
+				for (uint32_t x = 0; x != w; ++x) {
+					dst = std::copy_n(block[y * block_dim + x].begin(), num_channels, dst);
+				}
+			}
+		}
+	}
+
+	return ret;
+}
@@ -0,0 +1,150 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <rasterimage/image_variant.hpp>
+#include <utki/span.hpp>
+
+namespace ruis::render::opengl {
+
+/**
+ * @brief Block-compressed texture formats.
+ * All the formats use 4x4 pixel blocks.
+ */
+enum class compressed_format {
+	/**
+	 * @brief BC1 (DXT1) without alpha, 8 bytes per block.
+	 */
+	bc1_rgb,
+
+	/**
+	 * @brief BC1 (DXT1) with 1-bit alpha, 8 bytes per block.
+	 */
+	bc1_rgba,
+
+	/**
+	 * @brief BC2 (DXT3), 16 bytes per block.
+	 */
+	bc2_rgba,
+
+	/**
+	 * @brief BC3 (DXT5), 16 bytes per block.
+	 */
+	bc3_rgba,
+
+	/**
+	 * @brief ETC2 RGB, 8 bytes per block. ETC1 data is valid ETC2 RGB data.
+	 */
+	etc2_rgb8,
+
+	/**
+	 * @brief ETC2 RGB with EAC alpha, 16 bytes per block.
+	 */
+	etc2_rgba8,
+
+	/**
+	 * @brief ASTC LDR with 4x4 blocks, 16 bytes per block.
+	 */
+	astc_4x4_rgba,
+
+	enum_size
+};
+
+/**
+ * @brief Borrowed block-compressed image data in client memory.
+ */
+struct compressed_image {
+	compressed_format format = compressed_format::etc2_rgba8;
+
+	/**
+	 * @brief Dimensions of the base mipmap level in pixels.
+	 */
+	rasterimage::dimensioned::dimensions_type dims = {0, 0};
+
+	/**
+	 * @brief Compressed blocks of mipmap levels.
+	 * Starting from the base level, each next level is half the size of the previous one,
+	 * but not less than 1 pixel. At least the base level must be present.
+	 */
+	std::vector<utki::span<const uint8_t>> levels;
+
+	/**
+	 * @brief Row order of the image data.
+	 * true if the first row of blocks is the top row of the image,
+	 * false if the first row of blocks is the bottom row of the image.
+	 */
+	bool top_down = true;
+};
+
+/**
+ * @brief Get OpenGL internal format of the compressed format.
+ * @param f - compressed format.
+ * @return OpenGL internal format.
+ */
+GLenum to_gl_internal_format(compressed_format f);
+
+/**
+ * @brief Get size of the compressed block.
+ * @param f - compressed format.
+ * @return Size of the 4x4 pixel block in bytes.
+ */
+size_t to_block_size(compressed_format f);
+
+/**
+ * @brief Get format of the decompressed image.
+ * @param f - compressed format.
+ * @return Either rgb or rgba.
+ */
+rasterimage::format to_decompressed_format(compressed_format f);
+
+/**
+ * @brief Calculate size of compressed image data.
+ * @param f - compressed format.
+ * @param dims - image dimensions in pixels.
+ * @return Size of the compressed data in bytes.
+ */
+size_t calc_compressed_size(
+	compressed_format f, //
+	r4::vector2<uint32_t> dims
+);
+
+/**
+ * @brief Check if the compressed format can be decompressed on CPU.
+ * @param f - compressed format.
+ * @return true if decompress() supports the format.
+ */
+bool can_decompress(compressed_format f);
+
+/**
+ * @brief Decompress base mipmap level of the image on CPU.
+ * Used as a fallback for the formats not supported by the OpenGL implementation.
+ * The blocks are decoded right into the output pixels, without any intermediate buffers.
+ * @param image - image to decompress.
+ * @return Pixels in the to_decompressed_format() format, in the same row order as the compressed image.
+ * @throw std::invalid_argument - in case the format cannot be decompressed on CPU,
+ *                                see can_decompress(), or the image data is too small.
+ */
+std::vector<uint8_t> decompress(const compressed_image& image);
+
+} // namespace ruis::render::opengl
@@ -21,6 +21,9 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "context.hpp"
 
+#include <algorithm>
+#include <array>
+
 #include <utki/config.hpp>
 #include <utki/shared.hpp>
 #include <utki/string.hpp>
@@ -32,11 +35,18 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "shaders/shader_pos_clr.hpp"
 #include "shaders/shader_pos_tex.hpp"
 
+#include "draw_recorder.hpp"
 #include "frame_buffer.hpp"
+#include "gpu_profiler.hpp"
 #include "index_buffer.hpp"
+#include "program_binary_cache.hpp"
 #include "texture_2d.hpp"
+#include "texture_atlas.hpp"
 #include "texture_cube.hpp"
 #include "texture_depth.hpp"
+#include "texture_residency.hpp"
+#include "texture_uploader.hpp"
+#include "uniform_blocks.hpp"
 #include "vertex_array.hpp"
 #include "vertex_buffer.hpp"
 
@@ -44,6 +54,8 @@ using namespace std::string_view_literals;
 
 using namespace ruis::render::opengl;
 
+thread_local context::loader_thread_state context::loader_thread;
+
 // TODO: remove commented code
 // namespace {
 // unsigned get_max_texture_size()
@@ -118,6 +130,50 @@ utki::flags<ruis::render::opengl::extension> parse_supported_extensions(std::str
 			ext_flags.set(ruis::render::opengl::extension::arb_debug_output);
 		} else if (ext == "GL_KHR_debug"sv) {
 			ext_flags.set(ruis::render::opengl::extension::khr_debug);
+		} else if (ext == "GL_ARB_vertex_array_object"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_vertex_array_object);
+		} else if (ext == "GL_ARB_instanced_arrays"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_instanced_arrays);
+		} else if (ext == "GL_ARB_draw_instanced"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_draw_instanced);
+		} else if (ext == "GL_ARB_sync"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_sync);
+		} else if (ext == "GL_ARB_buffer_storage"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_buffer_storage);
+		} else if (ext == "GL_ARB_copy_buffer"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_copy_buffer);
+		} else if (ext == "GL_ARB_pixel_buffer_object"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_pixel_buffer_object);
+		} else if (ext == "GL_EXT_texture_compression_s3tc"sv) {
+			ext_flags.set(ruis::render::opengl::extension::ext_texture_compression_s3tc);
+		} else if (ext == "GL_ARB_ES3_compatibility"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_es3_compatibility);
+		} else if (ext == "GL_KHR_texture_compression_astc_ldr"sv) {
+			ext_flags.set(ruis::render::opengl::extension::khr_texture_compression_astc_ldr);
+		} else if (ext == "GL_ARB_texture_float"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_texture_float);
+		} else if (ext == "GL_ARB_half_float_pixel"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_half_float_pixel);
+		} else if (ext == "GL_OES_texture_float"sv) {
+			// only unsized internal formats, so it does not imply ARB_texture_float
+			ext_flags.set(ruis::render::opengl::extension::oes_texture_float);
+		} else if (ext == "GL_OES_texture_half_float"sv) {
+			// only unsized internal formats and its own GL_HALF_FLOAT_OES type
+			ext_flags.set(ruis::render::opengl::extension::oes_texture_half_float);
+		} else if (ext == "GL_EXT_texture_norm16"sv) {
+			ext_flags.set(ruis::render::opengl::extension::ext_texture_norm16);
+		} else if (ext == "GL_ARB_color_buffer_float"sv || ext == "GL_EXT_color_buffer_float"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_color_buffer_float);
+		} else if (ext == "GL_ARB_timer_query"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_timer_query);
+		} else if (ext == "GL_ARB_get_program_binary"sv || ext == "GL_OES_get_program_binary"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_get_program_binary);
+		} else if (ext == "GL_KHR_parallel_shader_compile"sv || ext == "GL_ARB_parallel_shader_compile"sv) {
+			ext_flags.set(ruis::render::opengl::extension::khr_parallel_shader_compile);
+		} else if (ext == "GL_ARB_uniform_buffer_object"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_uniform_buffer_object);
+		} else if (ext == "GL_ARB_draw_elements_base_vertex"sv) {
+			ext_flags.set(ruis::render::opengl::extension::arb_draw_elements_base_vertex);
 		}
 	}
 
@@ -135,6 +191,69 @@ utki::flags<ruis::render::opengl::extension> parse_supported_extensions(std::str
 		if (ext_flags.get(ruis::render::opengl::extension::khr_debug)) {
 			o << "  GL_KHR_debug" << std::endl;
 		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_vertex_array_object)) {
+			o << "  GL_ARB_vertex_array_object" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_instanced_arrays)) {
+			o << "  GL_ARB_instanced_arrays" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_draw_instanced)) {
+			o << "  GL_ARB_draw_instanced" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_sync)) {
+			o << "  GL_ARB_sync" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_buffer_storage)) {
+			o << "  GL_ARB_buffer_storage" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_copy_buffer)) {
+			o << "  GL_ARB_copy_buffer" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_pixel_buffer_object)) {
+			o << "  GL_ARB_pixel_buffer_object" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::ext_texture_compression_s3tc)) {
+			o << "  GL_EXT_texture_compression_s3tc" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_es3_compatibility)) {
+			o << "  GL_ARB_ES3_compatibility" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::khr_texture_compression_astc_ldr)) {
+			o << "  GL_KHR_texture_compression_astc_ldr" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_texture_float)) {
+			o << "  GL_ARB_texture_float" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_half_float_pixel)) {
+			o << "  GL_ARB_half_float_pixel" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::oes_texture_float)) {
+			o << "  GL_OES_texture_float" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::oes_texture_half_float)) {
+			o << "  GL_OES_texture_half_float" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::ext_texture_norm16)) {
+			o << "  GL_EXT_texture_norm16" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_color_buffer_float)) {
+			o << "  GL_ARB_color_buffer_float" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_timer_query)) {
+			o << "  GL_ARB_timer_query" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_get_program_binary)) {
+			o << "  GL_ARB_get_program_binary" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::khr_parallel_shader_compile)) {
+			o << "  GL_KHR_parallel_shader_compile" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_uniform_buffer_object)) {
+			o << "  GL_ARB_uniform_buffer_object" << std::endl;
+		}
+		if (ext_flags.get(ruis::render::opengl::extension::arb_draw_elements_base_vertex)) {
+			o << "  GL_ARB_draw_elements_base_vertex" << std::endl;
+		}
 	});
 
 	return ext_flags;
@@ -170,6 +289,19 @@ context::context(utki::shared_ref<ruis::render::native_window> native_window) :
 
 		return parse_opengl_version(version_string);
 	}()),
+	renderer([&]() {
+		std::string ret;
+		this->apply([&]() {
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "needed to make string from GLubyte*")
+			ret = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+		});
+
+		utki::log_debug([&](auto& o) {
+			o << "OpenGL renderer: " << ret << std::endl;
+		});
+
+		return ret;
+	}()),
 	supported_extensions([&]() {
 		std::string_view extensions_string;
 		this->apply([&]() {
@@ -179,7 +311,186 @@ context::context(utki::shared_ref<ruis::render::native_window> native_window) :
 			);
 		});
 
-		return parse_supported_extensions(extensions_string);
+		auto ext_flags = parse_supported_extensions(extensions_string);
+
+		// pixel buffer objects are core functionality since OpenGL 2.1
+		if (this->gl_version >= utki::version_duplet{2, 1}) {
+			ext_flags.set(ruis::render::opengl::extension::arb_pixel_buffer_object);
+		}
+
+		// vertex array objects are core functionality since OpenGL 3.0
+		if (this->gl_version >= utki::version_duplet{3, 0}) {
+			ext_flags.set(ruis::render::opengl::extension::arb_vertex_array_object);
+		}
+
+		// float and 16-bit textures and rendering to those are core functionality since OpenGL 3.0
+		if (this->gl_version >= utki::version_duplet{3, 0}) {
+			ext_flags.set(ruis::render::opengl::extension::arb_texture_float);
+			ext_flags.set(ruis::render::opengl::extension::arb_half_float_pixel);
+			ext_flags.set(ruis::render::opengl::extension::ext_texture_norm16);
+			ext_flags.set(ruis::render::opengl::extension::arb_color_buffer_float);
+		}
+
+		// instanced drawing and timer queries are core functionality since OpenGL 3.3
+		if (this->gl_version >= utki::version_duplet{3, 3}) {
+			ext_flags.set(ruis::render::opengl::extension::arb_instanced_arrays);
+			ext_flags.set(ruis::render::opengl::extension::arb_draw_instanced);
+			ext_flags.set(ruis::render::opengl::extension::arb_timer_query);
+		}
+
+		// copying between buffer objects is core functionality since OpenGL 3.1
+		if (this->gl_version >= utki::version_duplet{3, 1}) {
+			ext_flags.set(ruis::render::opengl::extension::arb_copy_buffer);
+		}
+
+		// sync objects and base vertex draws are core functionality since OpenGL 3.2
+		if (this->gl_version >= utki::version_duplet{3, 2}) {
+			ext_flags.set(ruis::render::opengl::extension::arb_sync);
+			ext_flags.set(ruis::render::opengl::extension::arb_draw_elements_base_vertex);
+		}
+
+		// program binaries are core functionality since OpenGL 4.1
+		if (this->gl_version >= utki::version_duplet{4, 1}) {
+			ext_flags.set(ruis::render::opengl::extension::arb_get_program_binary);
+		}
+
+		// ETC2 texture compression is core functionality since OpenGL 4.3
+		if (this->gl_version >= utki::version_duplet{4, 3}) {
+			ext_flags.set(ruis::render::opengl::extension::arb_es3_compatibility);
+		}
+
+		// immutable buffer storage is core functionality since OpenGL 4.4
+		if (this->gl_version >= utki::version_duplet{4, 4}) {
+			ext_flags.set(ruis::render::opengl::extension::arb_buffer_storage);
+		}
+
+		return ext_flags;
+	}()),
+	supported_compressed_formats([&]() {
+		utki::flags<compressed_format> formats = false;
+
+		if (this->supported_extensions.get(ruis::render::opengl::extension::ext_texture_compression_s3tc)) {
+			formats.set(compressed_format::bc1_rgb);
+			formats.set(compressed_format::bc1_rgba);
+			formats.set(compressed_format::bc2_rgba);
+			formats.set(compressed_format::bc3_rgba);
+		}
+		if (this->supported_extensions.get(ruis::render::opengl::extension::arb_es3_compatibility)) {
+			formats.set(compressed_format::etc2_rgb8);
+			formats.set(compressed_format::etc2_rgba8);
+		}
+		if (this->supported_extensions.get(ruis::render::opengl::extension::khr_texture_compression_astc_ldr)) {
+			formats.set(compressed_format::astc_4x4_rgba);
+		}
+
+		// some implementations support formats without advertising the extensions,
+		// e.g. OpenGL ES 3 always supports ETC2, so also check the formats list
+		this->apply([&]() {
+			// NOLINTNEXTLINE(cppcoreguidelines-init-variables)
+			GLint num_formats;
+			glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &num_formats);
+			if (num_formats <= 0) {
+				return;
+			}
+
+			std::vector<GLint> gl_formats(size_t(num_formats));
+			glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, gl_formats.data());
+
+			for (auto gl_format : gl_formats) {
+				for (size_t i = 0; i != size_t(compressed_format::enum_size); ++i) {
+					auto f = compressed_format(i);
+					if (GLenum(gl_format) == to_gl_internal_format(f)) {
+						formats.set(f);
+					}
+				}
+			}
+		});
+
+		utki::log_debug([&](auto& o) {
+			o << "Supported compressed texture formats:";
+			for (size_t i = 0; i != size_t(compressed_format::enum_size); ++i) {
+				if (formats.get(compressed_format(i))) {
+					o << ' ' << std::hex << to_gl_internal_format(compressed_format(i)) << std::dec;
+				}
+			}
+			o << std::endl;
+		});
+
+		return formats;
+	}()),
+	gl_state(
+		this->supported_extensions.get(ruis::render::opengl::extension::arb_vertex_array_object),
+		this->is_instancing_supported()
+	),
+	vertex_arena(
+		this->gl_state, //
+		this->census,
+		GL_ARRAY_BUFFER,
+		this->supported_extensions.get(ruis::render::opengl::extension::arb_copy_buffer)
+	),
+	index_arena(
+		this->gl_state, //
+		this->census,
+		GL_ELEMENT_ARRAY_BUFFER,
+		this->supported_extensions.get(ruis::render::opengl::extension::arb_copy_buffer)
+	),
+	residency(std::make_unique<texture_residency>(
+		this->gl_state, //
+		this->census
+	)),
+	atlas(std::make_unique<texture_atlas>(
+		this->gl_state, //
+		this->census,
+		this->supported_extensions
+	)),
+	uploader(std::make_unique<texture_uploader>(
+		this->gl_state, //
+		this->census,
+		this->supported_extensions.get(ruis::render::opengl::extension::arb_pixel_buffer_object) &&
+			this->supported_extensions.get(ruis::render::opengl::extension::arb_sync)
+	)),
+	profiler(std::make_unique<gpu_profiler>( //
+		this->supported_extensions.get(ruis::render::opengl::extension::arb_timer_query)
+	)),
+	program_cache([&]() {
+		bool supported = false;
+		std::string gl_id;
+		this->apply([&]() {
+			// the extension can be supported with no binary formats, then program binaries cannot be retrieved
+			if (this->supported_extensions.get(ruis::render::opengl::extension::arb_get_program_binary)) {
+				GLint num_formats = 0;
+				glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &num_formats);
+				assert_opengl_no_error();
+				supported = num_formats > 0;
+			}
+
+			// version string usually includes the driver build
+			for (auto name : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION}) {
+				// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "needed to make string from GLubyte*")
+				if (auto str = reinterpret_cast<const char*>(glGetString(name))) {
+					gl_id.append(str);
+				}
+				gl_id.push_back('\n');
+			}
+		});
+
+		return std::make_unique<program_binary_cache>(
+			supported, //
+			std::move(gl_id)
+		);
+	}()),
+	shared_uniforms([&]() {
+		std::unique_ptr<uniform_blocks> ret;
+		this->apply([&]() {
+			// Uniform buffer objects are core functionality since OpenGL 3.1, but the shaders are GLSL 1.10,
+			// where uniform blocks are only available via the extension directive, so the extension is required.
+			ret = std::make_unique<uniform_blocks>(
+				this->gl_state, //
+				this->census,
+				this->supported_extensions.get(ruis::render::opengl::extension::arb_uniform_buffer_object)
+			);
+		});
+		return ret;
 	}())
 {
 	this->apply([&]() {
@@ -208,12 +519,105 @@ context::context(utki::shared_ref<ruis::render::native_window> native_window) :
 		// utki::logcat_debug("ruis::render::opengl::context::context(): enable face culling", '\n');
 		glEnable(GL_CULL_FACE);
 		// utki::logcat_debug("ruis::render::opengl::context::context(): face culling enabled", '\n');
+
+		if (this->supported_extensions.get(ruis::render::opengl::extension::khr_parallel_shader_compile)) {
+			// let the implementation choose the number of shader compiler threads,
+			// the ARB variant of the extension has the same semantics
+			constexpr auto max_compiler_threads = GLuint(0xffffffff);
+			if (glMaxShaderCompilerThreadsKHR) {
+				glMaxShaderCompilerThreadsKHR(max_compiler_threads);
+			} else if (glMaxShaderCompilerThreadsARB) {
+				glMaxShaderCompilerThreadsARB(max_compiler_threads);
+			}
+			assert_opengl_no_error();
+		}
+
+		this->gl_state.resync();
+	});
+}
+
+context::~context() = default;
+
+void context::end_frame()
+{
+	this->uploader->end_frame();
+	this->residency->end_frame();
+	this->profiler->end_frame();
+	this->shared_uniforms->end_frame();
+
+	++this->frames_since_atlas_repack;
+	if (this->frames_since_atlas_repack == atlas_repack_interval) {
+		this->frames_since_atlas_repack = 0;
+		this->atlas->repack();
+	}
+
+	for (auto arena : {&this->vertex_arena, &this->index_arena}) {
+		if (arena->get_statistics().fragmentation() > arena_defragmentation_threshold) {
+			arena->defragment();
+		}
+	}
+
+	this->last_frame_stats = this->gl_state.get_statistics();
+	this->gl_state.reset_statistics();
+}
+
+utki::shared_ref<const context> context::to_opengl_context(
+	const utki::shared_ref<const ruis::render::context>& rendering_context
+)
+{
+	utki::assert(dynamic_cast<const context*>(&rendering_context.get()), SL);
+	return utki::make_shared_from(
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast, "assert(dynamic_cast) done")
+		static_cast<const context&>(rendering_context.get())
+	);
+}
+
+bool context::is_software_renderer() const noexcept
+{
+	constexpr std::array<std::string_view, 5> software_renderers = {
+		"llvmpipe"sv, //
+		"softpipe"sv,
+		"SwiftShader"sv,
+		"Software Rasterizer"sv,
+		"GDI Generic"sv
+	};
+
+	return std::any_of(
+		software_renderers.begin(), //
+		software_renderers.end(),
+		[this](std::string_view name) {
+			return this->renderer.find(name) != std::string::npos;
+		}
+	);
+}
+
+void context::invalidate_state_cache()
+{
+	this->apply([this]() {
+		this->gl_state.resync();
 	});
 }
 
+void context::begin_recording()
+{
+	utki::assert(!this->recorder, SL);
+	this->recorder = std::make_unique<draw_recorder>(this->gl_state.get_render_state());
+}
+
+void context::end_recording()
+{
+	utki::assert(this->recorder, SL);
+
+	// reset recorder before flushing, so that draws made by flush() are executed right away
+	auto r = std::move(this->recorder);
+	this->batching_stats = r->flush(this->gl_state);
+}
+
 utki::shared_ref<ruis::render::context::shaders> context::make_shaders() const
 {
 	// TODO: are those lint supressions still valid?
+	// The shader programs are built on first use, or in the background in case parallel shader compilation
+	// is supported. In the latter case all the programs are submitted for building before waiting for any of those.
 	auto ret = utki::make_shared<ruis::render::context::shaders>();
 	// NOLINTNEXTLINE(bugprone-unused-return-value, "false positive")
 	ret.get().pos_tex = std::make_unique<shader_pos_tex>(this->get_shared_ref());
@@ -237,9 +641,10 @@ utki::shared_ref<ruis::render::texture_2d> context::make_texture_2d(
 ) const
 {
 	return this->create_texture_2d_internal(
-		format, //
-		dims,
-		{},
+		{
+			.format = format, //
+			.dims = dims
+		},
 		std::move(params)
 	);
 }
@@ -249,53 +654,125 @@ utki::shared_ref<ruis::render::texture_2d> context::make_texture_2d(
 	texture_2d_parameters params
 ) const
 {
-	auto imvar_copy = imvar;
+	// the pixels are uploaded right from the image, without copying and flipping
+	return this->create_texture_2d_internal(
+		make_image_view(imvar), //
+		std::move(params)
+	);
+}
+
+utki::shared_ref<ruis::render::texture_2d> context::make_texture_2d(
+	rasterimage::image_variant&& imvar, //
+	texture_2d_parameters params
+) const
+{
+	const auto& iv = imvar;
 	return this->make_texture_2d(
-		std::move(imvar_copy), //
+		iv, //
+		std::move(params)
+	);
+}
+
+utki::shared_ref<ruis::render::texture_2d> context::make_texture_2d(
+	const image_view& image, //
+	texture_2d_parameters params
+) const
+{
+	return this->create_texture_2d_internal(
+		image, //
 		std::move(params)
 	);
 }
 
 utki::shared_ref<ruis::render::texture_2d> context::make_texture_2d(
+	const compressed_image& image, //
+	texture_2d_parameters params
+) const
+{
+	if (this->supported_compressed_formats.get(image.format)) {
+		auto tex = utki::make_shared<texture_2d>(
+			this->get_shared_ref(), //
+			image,
+			std::move(params)
+		);
+
+		utki::log_debug([&](auto& o) {
+			const auto& usage = tex.get().get_memory_usage();
+			o << "compressed texture " << image.dims.x() << 'x' << image.dims.y() << ": " << usage.size_bytes << " bytes, uncompressed "
+			  << usage.uncompressed_size_bytes << " bytes, saved " << (usage.savings() * 100) << "%" << std::endl;
+		});
+
+		return tex;
+	}
+
+	utki::log_debug([&](auto& o) {
+		o << "compressed texture format " << std::hex << to_gl_internal_format(image.format) << std::dec
+		  << " is not supported, decompress on CPU" << std::endl;
+	});
+
+	auto pixels = decompress(image);
+
+	return this->create_texture_2d_internal(
+		{
+			.format = to_decompressed_format(image.format), //
+			.dims = image.dims,
+			.data = utki::make_span(std::as_const(pixels)),
+			.top_down = image.top_down
+		},
+		std::move(params)
+	);
+}
+
+utki::shared_ref<texture_upload> context::make_texture_2d_async(
 	rasterimage::image_variant&& imvar, //
 	texture_2d_parameters params
 ) const
 {
-	auto iv = std::move(imvar);
-	return std::visit(
-		[this, &imvar = iv, &params](auto&& im) -> utki::shared_ref<ruis::render::texture_2d> {
-			if constexpr (sizeof(im.pixels().front().front()) != 1) {
-				throw std::logic_error(
-					"context::make_texture_2d(): "
-					"non-8bit images are not supported"
-				);
-			} else {
-				im.span().flip_vertical();
-				auto data = im.pixels();
-				return this->create_texture_2d_internal(
-					imvar.get_format(),
-					im.dims(),
-					utki::make_span(data.front().data(), data.size_bytes()),
-					std::move(params)
-				);
-			}
+	utki::assert(!this->is_loader_thread(), SL);
+
+	auto view = make_image_view(imvar);
+
+	// create texture without contents, it is never placed in the texture atlas
+	auto tex = utki::make_shared<texture_2d>(
+		this->get_shared_ref(), //
+		image_view{
+			.format = view.format, //
+			.type = view.type,
+			.dims = view.dims
 		},
-		iv.variant
+		params
+	);
+
+	// the rows are uploaded in memory order, see texture_2d constructor
+	tex.get().tex_rect = {
+		{0, 1},
+		{1, -1}
+	};
+
+	return this->uploader->upload(
+		std::move(tex), //
+		std::move(imvar),
+		params.mipmap != ruis::render::texture_2d::mipmap::none
 	);
 }
 
 utki::shared_ref<ruis::render::texture_2d> context::create_texture_2d_internal(
-	rasterimage::format type, //
-	rasterimage::dimensioned::dimensions_type dims,
-	utki::span<const uint8_t> data,
+	const image_view& image, //
 	texture_2d_parameters params
 ) const
 {
+	if (!this->is_loader_thread() && this->atlas->accepts(image, params)) {
+		return utki::make_shared<texture_2d>(
+			this->get_shared_ref(), //
+			image,
+			params,
+			*this->atlas
+		);
+	}
+
 	return utki::make_shared<texture_2d>(
 		this->get_shared_ref(), //
-		type,
-		dims,
-		data,
+		image,
 		params
 	);
 }
@@ -331,30 +808,12 @@ utki::shared_ref<ruis::render::texture_cube> context::make_texture_cube(
 		std::move(positive_z),
 		std::move(negative_z)
 	};
-	std::array<ruis::render::opengl::texture_cube::cube_face_image, num_cube_sides> faces;
-
-	auto face = faces.begin();
-	for (auto& side : sides) {
-		ASSERT(face != faces.end())
-		std::visit(
-			[&](auto& im) {
-				if constexpr (sizeof(im.pixels().front().front()) != 1) {
-					throw std::logic_error(
-						"context::make_texture_cube(): "
-						"non-8bit images are not supported"
-					);
-				} else {
-					im.span().flip_vertical();
-					auto data = im.pixels();
-
-					face->type = side.get_format();
-					face->dims = im.dims();
-					face->data = utki::make_span(data.front().data(), data.size_bytes());
-				}
-			},
-			side.variant
-		);
-		++face;
+	std::array<image_view, num_cube_sides> faces;
+
+	// the pixels are uploaded right from the images, the rows are reversed during upload
+	for (size_t i = 0; i != num_cube_sides; ++i) {
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+		faces[i] = make_image_view(sides[i]);
 	}
 
 	return utki::make_shared<texture_cube>(
@@ -417,6 +876,24 @@ utki::shared_ref<ruis::render::vertex_array> context::make_vertex_array(
 	);
 }
 
+utki::shared_ref<ruis::render::vertex_array> context::make_vertex_array(
+	std::vector<utki::shared_ref<const ruis::render::vertex_buffer>> buffers, //
+	std::vector<utki::shared_ref<const ruis::render::vertex_buffer>> instance_buffers,
+	utki::shared_ref<const ruis::render::index_buffer> indices,
+	ruis::render::vertex_array::mode mode,
+	size_t num_instances
+) const
+{
+	return utki::make_shared<vertex_array>(
+		this->get_shared_ref(), //
+		std::move(buffers),
+		std::move(instance_buffers),
+		std::move(indices),
+		mode,
+		num_instances
+	);
+}
+
 utki::shared_ref<ruis::render::index_buffer> context::make_index_buffer( //
 	utki::span<const uint16_t> indices
 ) const
@@ -453,39 +930,53 @@ utki::shared_ref<ruis::render::frame_buffer> context::make_framebuffer(
 
 void context::set_framebuffer_internal(ruis::render::frame_buffer* fb)
 {
-	if (!fb) {
-		glBindFramebuffer(GL_FRAMEBUFFER, this->default_framebuffer);
-		assert_opengl_no_error();
+	GLuint fbo = [&]() {
+		if (!fb) {
+			return this->default_framebuffer;
+		}
+
+		ASSERT(dynamic_cast<frame_buffer*>(fb))
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+		auto& ogl_fb = static_cast<frame_buffer&>(*fb);
+		return ogl_fb.fbo;
+	}();
+
+	if (this->recorder) {
+		this->recorder->get_state().framebuffer = fbo;
 		return;
 	}
 
-	ASSERT(dynamic_cast<frame_buffer*>(fb))
-	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
-	auto& ogl_fb = static_cast<frame_buffer&>(*fb);
+	this->gl_state.bind_framebuffer(fbo);
+}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, ogl_fb.fbo);
+void context::clear(GLbitfield mask)
+{
+	if (this->recorder) {
+		this->recorder->record_clear(mask);
+		return;
+	}
+
+	glClear(mask);
 	assert_opengl_no_error();
+	++this->gl_state.get_statistics().num_clears;
 }
 
 void context::clear_framebuffer_color()
 {
 	// Default clear color is RGBA = (0, 0, 0, 0);
-	glClear(GL_COLOR_BUFFER_BIT);
-	assert_opengl_no_error();
+	this->clear(GL_COLOR_BUFFER_BIT);
 }
 
 void context::clear_framebuffer_depth()
 {
 	// Default clear depth value is 1, see glClearDepth()
-	glClear(GL_DEPTH_BUFFER_BIT);
-	assert_opengl_no_error();
+	this->clear(GL_DEPTH_BUFFER_BIT);
 }
 
 void context::clear_framebuffer_stencil()
 {
 	// Default clear stencil value is 0, see glClearStencil()
-	glClear(GL_STENCIL_BUFFER_BIT);
-	assert_opengl_no_error();
+	this->clear(GL_STENCIL_BUFFER_BIT);
 }
 
 r4::vector2<uint32_t> context::to_window_coords(const ruis::vec2& point) const
@@ -502,86 +993,62 @@ r4::vector2<uint32_t> context::to_window_coords(const ruis::vec2& point) const
 
 bool context::is_scissor_enabled() const noexcept
 {
-	return glIsEnabled(GL_SCISSOR_TEST) ? true : false; // "? true : false" is to avoid warning under MSVC
+	if (this->recorder) {
+		return this->recorder->get_state().scissor_enabled;
+	}
+	return this->gl_state.is_scissor_enabled();
 }
 
 void context::enable_scissor(bool enable)
 {
-	if (enable) {
-		glEnable(GL_SCISSOR_TEST);
-	} else {
-		glDisable(GL_SCISSOR_TEST);
+	if (this->recorder) {
+		this->recorder->get_state().scissor_enabled = enable;
+		return;
 	}
+	this->gl_state.enable_scissor(enable);
 }
 
 r4::rectangle<uint32_t> context::get_scissor() const
 {
-	std::array<GLint, 4> osb{};
-	glGetIntegerv(GL_SCISSOR_BOX, osb.data());
-
-#ifdef DEBUG
-	for (auto n : osb) {
-		ASSERT(n >= 0)
+	if (this->recorder) {
+		return this->recorder->get_state().scissor;
 	}
-#endif
-
-	return {
-		uint32_t(osb[0]), //
-		uint32_t(osb[1]),
-		uint32_t(osb[2]),
-		uint32_t(osb[3])
-	};
+	return this->gl_state.get_scissor();
 }
 
 void context::set_scissor(const r4::rectangle<uint32_t>& r)
 {
-	glScissor(
-		GLint(r.p.x()), //
-		GLint(r.p.y()),
-		GLint(r.d.x()),
-		GLint(r.d.y())
-	);
-	assert_opengl_no_error();
+	if (this->recorder) {
+		this->recorder->get_state().scissor = r;
+		return;
+	}
+	this->gl_state.set_scissor(r);
 }
 
 r4::rectangle<uint32_t> context::get_viewport() const
 {
-	std::array<GLint, 4> vp{};
-
-	glGetIntegerv(GL_VIEWPORT, vp.data());
-
-#ifdef DEBUG
-	for (auto n : vp) {
-		ASSERT(n >= 0)
+	if (this->recorder) {
+		return this->recorder->get_state().viewport;
 	}
-#endif
-
-	return {
-		uint32_t(vp[0]), //
-		uint32_t(vp[1]),
-		uint32_t(vp[2]),
-		uint32_t(vp[3])
-	};
+	return this->gl_state.get_viewport();
 }
 
 void context::set_viewport(const r4::rectangle<uint32_t>& r)
 {
-	glViewport(
-		GLint(r.p.x()), //
-		GLint(r.p.y()),
-		GLint(r.d.x()),
-		GLint(r.d.y())
-	);
-	assert_opengl_no_error();
+	if (this->recorder) {
+		this->recorder->get_state().viewport = r;
+		return;
+	}
+	this->gl_state.set_viewport(r);
 }
 
 void context::enable_blend(bool enable)
 {
-	if (enable) {
-		glEnable(GL_BLEND);
-	} else {
-		glDisable(GL_BLEND);
+	if (this->recorder) {
+		this->recorder->get_state().blend_enabled = enable;
+		return;
 	}
+	this->gl_state.enable_blend(enable);
 }
 
 namespace {
@@ -613,7 +1080,7 @@ void context::set_blend_func(
 	blend_factor dst_alpha
 )
 {
-	glBlendFuncSeparate(
+	state_cache::blend_factors_type factors = {
 		// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
 		blend_func[unsigned(src_color)],
 		// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
@@ -622,19 +1089,29 @@ void context::set_blend_func(
 		blend_func[unsigned(src_alpha)],
 		// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
 		blend_func[unsigned(dst_alpha)]
-	);
+	};
+
+	if (this->recorder) {
+		this->recorder->get_state().blend_factors = factors;
+		return;
+	}
+
+	this->gl_state.set_blend_func(factors);
 }
 
 bool context::is_depth_enabled() const noexcept
 {
-	return glIsEnabled(GL_DEPTH_TEST) ? true : false; // "? true : false" is to avoid warning under MSVC
+	if (this->recorder) {
+		return this->recorder->get_state().depth_enabled;
+	}
+	return this->gl_state.is_depth_enabled();
 }
 
 void context::enable_depth(bool enable)
 {
-	if (enable) {
-		glEnable(GL_DEPTH_TEST);
-	} else {
-		glDisable(GL_DEPTH_TEST);
+	if (this->recorder) {
+		this->recorder->get_state().depth_enabled = enable;
+		return;
 	}
+	this->gl_state.enable_depth(enable);
 }
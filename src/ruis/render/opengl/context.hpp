@@ -21,12 +21,21 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <memory>
+#include <string>
+
 #include <GL/glew.h>
 #include <ruis/render/context.hpp>
 #include <utki/flags.hpp>
 #include <utki/shared.hpp>
 #include <utki/version.hpp>
 
+#include "buffer_arena.hpp"
+#include "compressed_image.hpp"
+#include "image_view.hpp"
+#include "resource_census.hpp"
+#include "state_cache.hpp"
+
 namespace ruis::render::opengl {
 
 enum class extension {
@@ -34,21 +43,408 @@ enum class extension {
 	arb_texture_swizzle = ext_texture_swizzle,
 	arb_debug_output,
 	khr_debug,
+	arb_vertex_array_object,
+	arb_instanced_arrays,
+	arb_draw_instanced,
+	arb_sync,
+	arb_buffer_storage,
+	arb_copy_buffer,
+	arb_pixel_buffer_object,
+	ext_texture_compression_s3tc,
+	arb_es3_compatibility,
+	khr_texture_compression_astc_ldr,
+	arb_texture_float,
+	arb_half_float_pixel,
+	oes_texture_float,
+	oes_texture_half_float,
+	ext_texture_norm16,
+	arb_color_buffer_float,
+	arb_timer_query,
+	arb_get_program_binary,
+	khr_parallel_shader_compile,
+	arb_uniform_buffer_object,
+	arb_draw_elements_base_vertex,
 
 	enum_size
 };
 
+class draw_recorder;
+class gpu_profiler;
+class program_binary_cache;
+class texture_atlas;
+class texture_residency;
+class uniform_blocks;
+class texture_upload;
+class texture_uploader;
+
 class context : public ruis::render::context
 {
+	friend class resource_loader;
+
 	GLuint default_framebuffer;
 
 public:
 	const utki::version_duplet gl_version;
 
+	/**
+	 * @brief Name of the OpenGL renderer.
+	 * As reported by glGetString(GL_RENDERER).
+	 */
+	const std::string renderer;
+
+	/**
+	 * @brief Supported OpenGL extensions.
+	 * Extensions which are part of the core functionality of the
+	 * OpenGL version in use are also marked as supported.
+	 */
 	const utki::flags<extension> supported_extensions;
 
+	/**
+	 * @brief Compressed texture formats supported by OpenGL implementation.
+	 * Textures of other compressed formats are decompressed on CPU.
+	 */
+	const utki::flags<compressed_format> supported_compressed_formats;
+
+	/**
+	 * @brief Check if instanced drawing is supported.
+	 * Instanced drawing requires both GL_ARB_instanced_arrays and GL_ARB_draw_instanced.
+	 * @return true if instanced drawing is supported.
+	 */
+	bool is_instancing_supported() const noexcept
+	{
+		return this->supported_extensions.get(extension::arb_instanced_arrays) &&
+			this->supported_extensions.get(extension::arb_draw_instanced);
+	}
+
+	/**
+	 * @brief Check if OpenGL is implemented in software.
+	 * Some operations, e.g. mipmap generation, are faster to do on CPU with software renderers.
+	 * @return true if the renderer is a known software rasterizer.
+	 */
+	bool is_software_renderer() const noexcept;
+
+	struct uniform_upload_statistics {
+		/**
+		 * @brief Number of glUniform*() calls issued.
+		 */
+		size_t num_issued = 0;
+
+		/**
+		 * @brief Number of glUniform*() calls skipped because the uniform already had the same value.
+		 */
+		size_t num_skipped = 0;
+	};
+
+	struct batching_statistics {
+		/**
+		 * @brief Number of draws recorded.
+		 */
+		size_t num_draws_recorded = 0;
+
+		/**
+		 * @brief Number of draws issued to OpenGL after batching.
+		 */
+		size_t num_draws_issued = 0;
+
+		/**
+		 * @brief Number of state changes between consecutive draws in recorded order.
+		 * Changes of render state, shader program and texture are counted.
+		 */
+		size_t num_state_changes_recorded = 0;
+
+		/**
+		 * @brief Number of state changes between consecutive draws in issued order.
+		 */
+		size_t num_state_changes_issued = 0;
+	};
+
+private:
+	// The OpenGL state is changed by resources (textures, buffers, shaders) which only
+	// hold a const reference to the context, so the state cache has to be mutable.
+	mutable state_cache gl_state;
+
+	// Resources update the census on destruction, so it has to be destroyed after
+	// the members owning resources, including the buffer arenas.
+	mutable resource_census census;
+
+	// Small static vertex and index buffers are sub-allocated from shared buffer objects.
+	// Vertex and index data are kept in separate buffer objects, because WebGL does not allow
+	// using same buffer object for both.
+	mutable buffer_arena vertex_arena;
+	mutable buffer_arena index_arena;
+
+	// arenas are defragmented by end_frame() once fragmentation of their free space exceeds this value
+	constexpr static const float arena_defragmentation_threshold = 0.5f;
+
+	// Textures owned by the atlas and the uploader unregister from the residency manager
+	// on destruction, so it has to be destroyed after those.
+	std::unique_ptr<texture_residency> residency;
+
+	// small textures are placed into shared atlas pages
+	std::unique_ptr<texture_atlas> atlas;
+
+	// the atlas is repacked by end_frame() once in this number of frames
+	constexpr static const unsigned atlas_repack_interval = 300;
+
+	unsigned frames_since_atlas_repack = 0;
+
+	std::unique_ptr<texture_uploader> uploader;
+
+	std::unique_ptr<gpu_profiler> profiler;
+
+	std::unique_ptr<program_binary_cache> program_cache;
+
+	std::unique_ptr<uniform_blocks> shared_uniforms;
+
+	mutable uniform_upload_statistics uniform_upload_stats;
+
+	// not null while recording
+	std::unique_ptr<draw_recorder> recorder;
+
+	batching_statistics batching_stats;
+
+	state_cache::statistics last_frame_stats;
+
+	// State of the shared OpenGL context bound on a resource loader thread.
+	// Resources created on the loader thread change the OpenGL state of the loader context,
+	// so they have to use its own state cache.
+	struct loader_thread_state {
+		// nullptr on threads other than resource loader threads
+		state_cache* gl_state = nullptr;
+
+		uniform_upload_statistics uniform_upload_stats;
+	};
+
+	static thread_local loader_thread_state loader_thread;
+
+public:
 	context(utki::shared_ref<ruis::render::native_window> native_window);
 
+	context(const context&) = delete;
+	context& operator=(const context&) = delete;
+
+	context(context&&) = delete;
+	context& operator=(context&&) = delete;
+
+	~context() override;
+
+	/**
+	 * @brief Get OpenGL context from a generic rendering context.
+	 * @param rendering_context - rendering context. Must be an OpenGL context.
+	 * @return The OpenGL context.
+	 */
+	static utki::shared_ref<const context> to_opengl_context( //
+		const utki::shared_ref<const ruis::render::context>& rendering_context
+	);
+
+	/**
+	 * @brief Get cached OpenGL state.
+	 * All OpenGL state changes must be done through the returned object.
+	 * @return The OpenGL state cache of this context.
+	 */
+	state_cache& get_state_cache() const noexcept
+	{
+		if (loader_thread.gl_state) {
+			return *loader_thread.gl_state;
+		}
+		return this->gl_state;
+	}
+
+	/**
+	 * @brief Check if called on a resource loader thread.
+	 * Resources created on a resource loader thread do not use context-wide resources
+	 * like buffer arenas and texture atlas, because those are only used on the rendering thread.
+	 * @return true if called on a resource loader thread.
+	 */
+	bool is_loader_thread() const noexcept
+	{
+		return loader_thread.gl_state != nullptr;
+	}
+
+	/**
+	 * @brief Re-synchronize the cached OpenGL state.
+	 * The context keeps a CPU-side copy of the OpenGL state to avoid redundant
+	 * OpenGL calls and state queries. In case the OpenGL state is changed by some
+	 * code outside of the renderer, this function has to be called afterwards.
+	 */
+	void invalidate_state_cache();
+
+	/**
+	 * @brief Get arena for sub-allocating vertex buffers.
+	 * The arena is defragmented by end_frame() when its free space gets too fragmented.
+	 * @return The vertex buffer arena of this context.
+	 */
+	buffer_arena& get_vertex_buffer_arena() const noexcept
+	{
+		return this->vertex_arena;
+	}
+
+	/**
+	 * @brief Get arena for sub-allocating index buffers.
+	 * The arena is defragmented by end_frame() when its free space gets too fragmented.
+	 * @return The index buffer arena of this context.
+	 */
+	buffer_arena& get_index_buffer_arena() const noexcept
+	{
+		return this->index_arena;
+	}
+
+	/**
+	 * @brief Get texture atlas.
+	 * Small textures made by make_texture_2d() are placed into the atlas,
+	 * unless the atlas is disabled.
+	 * The atlas is repacked periodically by end_frame().
+	 * @return The texture atlas of this context.
+	 */
+	texture_atlas& get_texture_atlas() const noexcept
+	{
+		return *this->atlas;
+	}
+
+	/**
+	 * @brief Get census of OpenGL resources of this context.
+	 * @return The resource census.
+	 */
+	resource_census& get_resource_census() const noexcept
+	{
+		return this->census;
+	}
+
+	/**
+	 * @brief Get texture residency manager.
+	 * Standalone 2D textures created on the rendering thread are managed by it.
+	 * By default the texture memory budget is unlimited.
+	 * Textures which do not fit into the budget are evicted by end_frame().
+	 * @return The texture residency manager of this context.
+	 */
+	texture_residency& get_texture_residency() const noexcept
+	{
+		return *this->residency;
+	}
+
+	/**
+	 * @brief Get asynchronous texture uploader.
+	 * The uploads are advanced by end_frame().
+	 * @return The texture uploader of this context.
+	 */
+	texture_uploader& get_texture_uploader() const noexcept
+	{
+		return *this->uploader;
+	}
+
+	/**
+	 * @brief End frame.
+	 * Advances the texture uploads, the texture residency manager and the GPU profiler,
+	 * defragments the buffer arenas if needed, periodically repacks the texture atlas
+	 * and starts counting the frame statistics anew.
+	 * Must be called once per frame, after all the rendering of the frame is done.
+	 */
+	void end_frame();
+
+	/**
+	 * @brief Get statistics of the current frame.
+	 * The statistics are counted since the last end_frame() call.
+	 * Draws, state changes and uploads done on resource loader threads are not counted.
+	 * @return Statistics of OpenGL calls.
+	 */
+	const state_cache::statistics& get_frame_statistics() const noexcept
+	{
+		return this->gl_state.get_statistics();
+	}
+
+	/**
+	 * @brief Get statistics of the previous frame.
+	 * @return Statistics of OpenGL calls between the last two end_frame() calls.
+	 */
+	const state_cache::statistics& get_last_frame_statistics() const noexcept
+	{
+		return this->last_frame_stats;
+	}
+
+	/**
+	 * @brief Get GPU profiler.
+	 * The timings are read back by end_frame().
+	 * @return The GPU profiler of this context.
+	 */
+	gpu_profiler& get_gpu_profiler() const noexcept
+	{
+		return *this->profiler;
+	}
+
+	/**
+	 * @brief Get shader program binary cache.
+	 * The cache is disabled until its directory is set with program_binary_cache::set_directory().
+	 * @return The program binary cache of this context.
+	 */
+	program_binary_cache& get_program_binary_cache() const noexcept
+	{
+		return *this->program_cache;
+	}
+
+	/**
+	 * @brief Get uniform data shared by all shader programs.
+	 * The per-frame data is updated by end_frame().
+	 * @return The shared uniform blocks of this context.
+	 */
+	uniform_blocks& get_uniform_blocks() const noexcept
+	{
+		return *this->shared_uniforms;
+	}
+
+	/**
+	 * @brief Get uniform upload statistics.
+	 * The statistics are accumulated by shaders of this context.
+	 * The returned object can be reset by assigning an empty value to it.
+	 * @return Uniform upload statistics.
+	 */
+	uniform_upload_statistics& get_uniform_upload_statistics() const noexcept
+	{
+		if (loader_thread.gl_state) {
+			return loader_thread.uniform_upload_stats;
+		}
+		return this->uniform_upload_stats;
+	}
+
+	/**
+	 * @brief Start recording draw commands.
+	 * While recording, draws, clears and state changes are not executed right away,
+	 * but are recorded to be executed by end_recording().
+	 * The vertex arrays, textures and shaders used for recorded draws must stay alive
+	 * till end_recording() is called.
+	 */
+	void begin_recording();
+
+	/**
+	 * @brief Execute recorded draw commands.
+	 * The draws are executed in the recorded order. Consecutive draws which differ only in
+	 * vertex data placed in the same buffer objects are merged into single draw calls.
+	 */
+	void end_recording();
+
+	bool is_recording() const noexcept
+	{
+		return this->recorder != nullptr;
+	}
+
+	/**
+	 * @brief Get draw recorder.
+	 * @return Draw recorder in case the context is in recording mode.
+	 * @return nullptr otherwise.
+	 */
+	draw_recorder* get_recorder() const noexcept
+	{
+		return this->recorder.get();
+	}
+
+	/**
+	 * @brief Get batching statistics of the last recorded command sequence.
+	 * @return Batching statistics.
+	 */
+	const batching_statistics& get_batching_statistics() const noexcept
+	{
+		return this->batching_stats;
+	}
+
 	// ===============================
 	// ====== factory functions ======
 
@@ -70,6 +466,47 @@ public:
 		texture_2d_parameters params
 	) const override;
 
+	/**
+	 * @brief Create texture from borrowed pixels.
+	 * The pixels are uploaded right from the given memory, without intermediate copies.
+	 * The memory only has to stay valid during the call.
+	 * @param image - image area to create the texture from.
+	 * @param params - texture parameters.
+	 * @return The created texture.
+	 */
+	utki::shared_ref<ruis::render::texture_2d> make_texture_2d(
+		const image_view& image, //
+		texture_2d_parameters params
+	) const;
+
+	/**
+	 * @brief Create texture from block-compressed image.
+	 * In case the compressed format is not supported by OpenGL implementation,
+	 * the base level of the image is decompressed on CPU and the texture is created from the decompressed pixels.
+	 * Memory savings can be checked with texture_2d::get_memory_usage().
+	 * @param image - compressed image.
+	 * @param params - texture parameters.
+	 * @return The created texture.
+	 * @throw std::invalid_argument - in case the format is not supported and cannot be decompressed on CPU.
+	 */
+	utki::shared_ref<ruis::render::texture_2d> make_texture_2d(
+		const compressed_image& image, //
+		texture_2d_parameters params
+	) const;
+
+	/**
+	 * @brief Create texture and upload its contents asynchronously.
+	 * The texture is created right away, but it can be used for rendering only
+	 * after the returned upload is ready.
+	 * @param imvar - texture image.
+	 * @param params - texture parameters.
+	 * @return Handle of the texture upload.
+	 */
+	utki::shared_ref<texture_upload> make_texture_2d_async(
+		rasterimage::image_variant&& imvar, //
+		texture_2d_parameters params
+	) const;
+
 	utki::shared_ref<ruis::render::texture_depth> make_texture_depth( //
 		rasterimage::dimensioned::dimensions_type dims
 	) const override;
@@ -107,6 +544,26 @@ public:
 		ruis::render::vertex_array::mode mode
 	) const override;
 
+	/**
+	 * @brief Create instanced vertex array.
+	 * Vertex array is drawn num_instances times with a single draw call.
+	 * Vertex attribute indices of per-instance buffers follow the ones of per-vertex buffers.
+	 * In case instanced drawing is not supported, the instances are drawn one by one.
+	 * @param buffers - per-vertex buffers.
+	 * @param instance_buffers - per-instance buffers.
+	 * @param indices - index buffer.
+	 * @param mode - rendering mode.
+	 * @param num_instances - number of instances to draw.
+	 * @return New vertex array.
+	 */
+	utki::shared_ref<ruis::render::vertex_array> make_vertex_array(
+		std::vector<utki::shared_ref<const ruis::render::vertex_buffer>> buffers, //
+		std::vector<utki::shared_ref<const ruis::render::vertex_buffer>> instance_buffers,
+		utki::shared_ref<const ruis::render::index_buffer> indices,
+		ruis::render::vertex_array::mode mode,
+		size_t num_instances
+	) const;
+
 	utki::shared_ref<ruis::render::frame_buffer> make_framebuffer( //
 		std::shared_ptr<ruis::render::texture_2d> color,
 		std::shared_ptr<ruis::render::texture_depth> depth,
@@ -115,12 +572,12 @@ public:
 
 private:
 	utki::shared_ref<ruis::render::texture_2d> create_texture_2d_internal(
-		rasterimage::format type,
-		rasterimage::dimensioned::dimensions_type dims,
-		utki::span<const uint8_t> data,
+		const image_view& image, //
 		texture_2d_parameters params
 	) const;
 
+	void clear(GLbitfield mask);
+
 public:
 	// =====================================
 	// ====== state control functions ======
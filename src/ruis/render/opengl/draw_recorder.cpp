@@ -0,0 +1,230 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "draw_recorder.hpp"
+
+#include <algorithm>
+#include <tuple>
+#include <utility>
+
+#include "index_buffer.hpp"
+#include "opengl_texture.hpp"
+#include "util.hpp"
+#include "vertex_array.hpp"
+
+using namespace ruis::render::opengl;
+
+size_t draw_recorder::get_state_index()
+{
+	if (this->states.empty() || this->states.back() != this->current_state) {
+		this->states.push_back(this->current_state);
+	}
+	return this->states.size() - 1;
+}
+
+void draw_recorder::record_draw(
+	const shader_base& shader, //
+	const r4::matrix4<float>& matrix,
+	const vertex_array& va,
+	const draw_parameters& params
+)
+{
+	this->commands.push_back({
+		.state_index = this->get_state_index(),
+		.shader = &shader,
+		.matrix = matrix,
+		.va = &va,
+		.params = params,
+		.clear_mask = 0
+	});
+}
+
+void draw_recorder::record_clear(GLbitfield mask)
+{
+	this->commands.push_back({
+		.state_index = this->get_state_index(),
+		.shader = nullptr,
+		.matrix = {},
+		.va = nullptr,
+		.params = {},
+		.clear_mask = mask
+	});
+}
+
+namespace {
+// draws which differ in any of the key components require OpenGL state change in between
+auto state_key(const draw_recorder::command& c)
+{
+	return std::make_tuple(
+		c.state_index, //
+		c.shader->get_program_object(),
+		// textures placed in the same atlas page share the texture object
+		c.params.texture ? c.params.texture->tex : 0
+	);
+}
+
+// draws with same parameters differ only in vertex data
+bool has_same_parameters(const draw_recorder::command& a, const draw_recorder::command& b)
+{
+	return a.state_index == b.state_index && //
+		a.shader == b.shader && //
+		a.params.texture == b.params.texture && //
+		a.params.color == b.params.color && //
+		a.matrix == b.matrix;
+}
+
+// offset of the first index within the element array buffer
+const GLvoid* get_indices(const vertex_array& va)
+{
+	ASSERT(dynamic_cast<const index_buffer*>(&va.indices.get()))
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+	const auto& ivbo = static_cast<const index_buffer&>(va.indices.get());
+
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, performance-no-int-to-ptr)
+	return reinterpret_cast<const GLvoid*>(ivbo.get_offset());
+}
+
+GLsizei get_count(const vertex_array& va)
+{
+	ASSERT(dynamic_cast<const index_buffer*>(&va.indices.get()))
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+	return static_cast<const index_buffer&>(va.indices.get()).elements_count;
+}
+
+size_t count_state_changes(utki::span<const draw_recorder::command> commands)
+{
+	size_t ret = 0;
+	const draw_recorder::command* prev = nullptr;
+	for (const auto& c : commands) {
+		if (!c.shader) {
+			continue;
+		}
+		if (!prev || state_key(*prev) != state_key(c)) {
+			++ret;
+		}
+		prev = &c;
+	}
+	return ret;
+}
+} // namespace
+
+size_t draw_recorder::collect_mergeable_draws(size_t index)
+{
+	this->merge_counts.clear();
+	this->merge_indices.clear();
+	this->merge_base_vertices.clear();
+
+	const auto& first = this->commands[index];
+	ASSERT(first.shader)
+
+	if (first.va->is_instanced()) {
+		return 1;
+	}
+
+	this->merge_counts.push_back(get_count(*first.va));
+	this->merge_indices.push_back(get_indices(*first.va));
+	this->merge_base_vertices.push_back(0);
+
+	for (auto i = index + 1; i != this->commands.size(); ++i) {
+		const auto& c = this->commands[i];
+		if (!c.shader || !has_same_parameters(first, c)) {
+			break;
+		}
+
+		auto base_vertex = c.va->get_base_vertex(*first.va);
+		if (!base_vertex) {
+			break;
+		}
+
+		this->merge_counts.push_back(get_count(*c.va));
+		this->merge_indices.push_back(get_indices(*c.va));
+		this->merge_base_vertices.push_back(*base_vertex);
+	}
+
+	return this->merge_counts.size();
+}
+
+context::batching_statistics draw_recorder::flush(state_cache& state)
+{
+	context::batching_statistics stats;
+
+	stats.num_draws_recorded = size_t(std::count_if(
+		this->commands.begin(), //
+		this->commands.end(),
+		[](const auto& c) {
+			return c.shader != nullptr;
+		}
+	));
+	stats.num_state_changes_recorded = count_state_changes(utki::make_span(this->commands));
+
+	const draw_recorder::command* prev = nullptr;
+
+	for (size_t i = 0; i != this->commands.size();) {
+		const auto& c = this->commands[i];
+
+		state.set_render_state(this->states[c.state_index]);
+
+		if (!c.shader) {
+			glClear(c.clear_mask);
+			assert_opengl_no_error();
+			++state.get_statistics().num_clears;
+			++i;
+			continue;
+		}
+
+		auto num_merged = this->collect_mergeable_draws(i);
+		if (num_merged == 1) {
+			c.shader->draw(c.matrix, *c.va, c.params);
+		} else {
+			bool zero_base_vertices = std::all_of(
+				this->merge_base_vertices.begin(), //
+				this->merge_base_vertices.end(),
+				[](auto bv) {
+					return bv == 0;
+				}
+			);
+
+			c.shader->draw_multi(
+				c.matrix, //
+				*c.va,
+				utki::make_span(std::as_const(this->merge_counts)),
+				utki::make_span(std::as_const(this->merge_indices)),
+				zero_base_vertices ? utki::span<const GLint>() : utki::make_span(std::as_const(this->merge_base_vertices)),
+				c.params
+			);
+		}
+		++stats.num_draws_issued;
+
+		if (!prev || state_key(*prev) != state_key(c)) {
+			++stats.num_state_changes_issued;
+		}
+		prev = &c;
+
+		i += num_merged;
+	}
+
+	state.set_render_state(this->current_state);
+
+	this->commands.clear();
+	this->states.clear();
+
+	return stats;
+}
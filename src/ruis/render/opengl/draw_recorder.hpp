@@ -0,0 +1,126 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <vector>
+
+#include <r4/matrix.hpp>
+
+#include "shader_base.hpp"
+#include "state_cache.hpp"
+
+namespace ruis::render::opengl {
+
+class vertex_array;
+
+/**
+ * @brief Recorder of draw and clear commands.
+ * Recorded commands are executed on flush in the recorded order.
+ * Runs of consecutive draws which use the same render state, shader, shader parameters
+ * and the same buffer objects are merged into a single draw call.
+ * The draws are never reordered, since in general the rendering result depends on the order,
+ * e.g. with blending, or with depth test where of fragments with equal depth the first one drawn wins.
+ */
+class draw_recorder
+{
+public:
+	struct command {
+		// index into states
+		size_t state_index;
+
+		// nullptr for clear command
+		const shader_base* shader;
+
+		// for draw command
+		r4::matrix4<float> matrix;
+		const vertex_array* va;
+		draw_parameters params;
+
+		// for clear command
+		GLbitfield clear_mask;
+	};
+
+private:
+	// render state set by the context state functions while recording
+	render_state current_state;
+
+	std::vector<render_state> states;
+
+	std::vector<command> commands;
+
+	// arguments of merged draw calls, kept to avoid allocations on every flush
+	std::vector<GLsizei> merge_counts;
+	std::vector<const GLvoid*> merge_indices;
+	std::vector<GLint> merge_base_vertices;
+
+public:
+	/**
+	 * @param initial_state - render state at the moment of starting the recording.
+	 */
+	draw_recorder(const render_state& initial_state) :
+		current_state(initial_state)
+	{}
+
+	/**
+	 * @brief Get render state to be used for commands recorded next.
+	 * The context state functions modify the returned object while recording.
+	 */
+	render_state& get_state() noexcept
+	{
+		return this->current_state;
+	}
+
+	const render_state& get_state() const noexcept
+	{
+		return this->current_state;
+	}
+
+	/**
+	 * @brief Record draw command.
+	 * All the objects referred by the draw command must stay alive until flush.
+	 */
+	void record_draw(
+		const shader_base& shader, //
+		const r4::matrix4<float>& matrix,
+		const vertex_array& va,
+		const draw_parameters& params
+	);
+
+	void record_clear(GLbitfield mask);
+
+	/**
+	 * @brief Execute recorded commands.
+	 * After execution the OpenGL state corresponds to the current recording state.
+	 * @param state - state cache of the context to execute the commands in.
+	 * @return Statistics of the executed command sequence.
+	 */
+	context::batching_statistics flush(state_cache& state);
+
+private:
+	size_t get_state_index();
+
+	// Collect draws which can be merged with the draw at the given index.
+	// Returns number of the merged draws, the draw call arguments are placed to merge_* arrays.
+	size_t collect_mergeable_draws(size_t index);
+};
+
+} // namespace ruis::render::opengl
@@ -24,8 +24,10 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <GL/glew.h>
 #include <utki/string.hpp>
 
+#include "context.hpp"
 #include "texture_2d.hpp"
 #include "texture_depth.hpp"
+#include "texture_residency.hpp"
 #include "util.hpp"
 
 using namespace ruis::render::opengl;
@@ -49,20 +51,30 @@ frame_buffer::frame_buffer(
 		glGenFramebuffers(1, &this->fbo);
 		assert_opengl_no_error();
 
-		// No need to initialize the variable because it is initialized via
-		// output argument of glGetIntegerv().
-		// NOLINTNEXTLINE(cppcoreguidelines-init-variables)
-		GLint old_fb;
-		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &old_fb);
+		auto& state = this->get_state_cache();
 
-		glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
-		assert_opengl_no_error();
+		auto old_fb = state.get_framebuffer();
+
+		state.bind_framebuffer(this->fbo);
 
 		if (this->color) {
 			utki::assert(dynamic_cast<texture_2d*>(this->color.get()), SL);
 			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
 			auto& tex = static_cast<texture_2d&>(*this->color);
 
+			const auto& ctx = this->get_opengl_context();
+
+			if (tex.get_gl_type() == GL_FLOAT || tex.get_gl_type() == GL_HALF_FLOAT) {
+				if (!ctx.supported_extensions.get(extension::arb_color_buffer_float)) {
+					throw std::invalid_argument(
+						"frame_buffer(): rendering to floating point textures is not supported by OpenGL implementation"
+					);
+				}
+			}
+
+			// the texture is rendered to, so it must not be evicted while attached
+			ctx.get_texture_residency().pin(tex);
+
 			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex.tex, 0);
 			assert_opengl_no_error();
 		} else {
@@ -93,8 +105,10 @@ frame_buffer::frame_buffer(
 			}
 		}
 
-		glBindFramebuffer(GL_FRAMEBUFFER, old_fb);
-		assert_opengl_no_error();
+		state.bind_framebuffer(old_fb);
+
+		// attachments are accounted as textures
+		this->get_opengl_context().get_resource_census().on_created(resource_kind::frame_buffer);
 	});
 }
 
@@ -103,7 +117,27 @@ frame_buffer::~frame_buffer()
 	// In OpenGL framebuffer objects are not shared between contexts,
 	// so make sure the owning context is bound when deleting the framebuffer object.
 	this->rendering_context.get().apply([this]() {
+		if (this->color) {
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast, "type is checked in constructor")
+			this->get_opengl_context().get_texture_residency().unpin(static_cast<texture_2d&>(*this->color));
+		}
+
+		this->get_opengl_context().get_resource_census().on_destroyed(resource_kind::frame_buffer);
+
+		this->get_state_cache().on_framebuffer_deleted(this->fbo);
 		glDeleteFramebuffers(1, &this->fbo);
 		assert_opengl_no_error();
 	});
 }
+
+const ruis::render::opengl::context& frame_buffer::get_opengl_context() const
+{
+	utki::assert(dynamic_cast<const opengl::context*>(&this->rendering_context.get()), SL);
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast, "assert(dynamic_cast) done")
+	return static_cast<const opengl::context&>(this->rendering_context.get());
+}
+
+state_cache& frame_buffer::get_state_cache() const
+{
+	return this->get_opengl_context().get_state_cache();
+}
@@ -24,8 +24,12 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <GL/glew.h>
 #include <ruis/render/frame_buffer.hpp>
 
+#include "state_cache.hpp"
+
 namespace ruis::render::opengl {
 
+class context;
+
 class frame_buffer : public ruis::render::frame_buffer
 {
 public:
@@ -47,6 +51,8 @@ public:
 	~frame_buffer() override;
 
 private:
+	const context& get_opengl_context() const;
+	state_cache& get_state_cache() const;
 };
 
 } // namespace ruis::render::opengl
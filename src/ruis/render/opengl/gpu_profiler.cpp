@@ -0,0 +1,207 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "gpu_profiler.hpp"
+
+#include <algorithm>
+
+#include <utki/debug.hpp>
+
+#include "util.hpp"
+
+using namespace ruis::render::opengl;
+
+gpu_profiler::gpu_profiler(bool timer_query_supported) :
+	timer_query_supported(timer_query_supported)
+{}
+
+gpu_profiler::~gpu_profiler()
+{
+	for (auto& f : this->pending_frames) {
+		this->release_queries(f);
+	}
+
+	if (!this->query_pool.empty()) {
+		glDeleteQueries(GLsizei(this->query_pool.size()), this->query_pool.data());
+		assert_opengl_no_error();
+	}
+}
+
+GLuint gpu_profiler::acquire_query()
+{
+	if (!this->query_pool.empty()) {
+		auto ret = this->query_pool.back();
+		this->query_pool.pop_back();
+		return ret;
+	}
+
+	// NOLINTNEXTLINE(cppcoreguidelines-init-variables)
+	GLuint ret;
+	glGenQueries(1, &ret);
+	assert_opengl_no_error();
+	return ret;
+}
+
+void gpu_profiler::release_queries(pending_frame& f)
+{
+	for (const auto& s : f.scopes) {
+		if (s.begin_query != 0) {
+			this->query_pool.push_back(s.begin_query);
+		}
+		if (s.end_query != 0) {
+			this->query_pool.push_back(s.end_query);
+		}
+	}
+}
+
+void gpu_profiler::begin_scope(std::string name)
+{
+	GLuint query = 0;
+	if (this->timer_query_supported) {
+		query = this->acquire_query();
+		glQueryCounter(query, GL_TIMESTAMP);
+		assert_opengl_no_error();
+	}
+
+	this->open_scopes.push_back(this->cur_scopes.size());
+	this->cur_scopes.push_back({
+		.name = std::move(name),
+		.depth = unsigned(this->open_scopes.size() - 1),
+		.begin_query = query,
+		.end_query = 0,
+		.cpu_begin = std::chrono::steady_clock::now(),
+		.cpu_end = {}
+	});
+}
+
+void gpu_profiler::end_scope()
+{
+	utki::assert(!this->open_scopes.empty(), SL);
+
+	auto& s = this->cur_scopes[this->open_scopes.back()];
+	this->open_scopes.pop_back();
+
+	s.cpu_end = std::chrono::steady_clock::now();
+
+	if (this->timer_query_supported) {
+		s.end_query = this->acquire_query();
+		glQueryCounter(s.end_query, GL_TIMESTAMP);
+		assert_opengl_no_error();
+	}
+}
+
+bool gpu_profiler::is_available(const pending_frame& f) const
+{
+	if (!this->timer_query_supported) {
+		return true;
+	}
+
+	if (f.scopes.empty()) {
+		return true;
+	}
+
+	// timestamps are recorded in order, so in case the latest one is available, all the rest are too
+	auto last_ended = std::max_element(
+		f.scopes.begin(), //
+		f.scopes.end(),
+		[](const auto& a, const auto& b) {
+			return a.cpu_end < b.cpu_end;
+		}
+	);
+
+	// NOLINTNEXTLINE(cppcoreguidelines-init-variables)
+	GLuint available;
+	glGetQueryObjectuiv(last_ended->end_query, GL_QUERY_RESULT_AVAILABLE, &available);
+	assert_opengl_no_error();
+
+	return available != GL_FALSE;
+}
+
+void gpu_profiler::resolve(pending_frame& f)
+{
+	this->last_frame.frame = f.frame;
+	this->last_frame.scopes.clear();
+
+	for (const auto& s : f.scopes) {
+		std::chrono::nanoseconds gpu_time{0};
+		if (this->timer_query_supported) {
+			// NOLINTNEXTLINE(cppcoreguidelines-init-variables)
+			GLuint64 begin;
+			glGetQueryObjectui64v(s.begin_query, GL_QUERY_RESULT, &begin);
+			assert_opengl_no_error();
+
+			// NOLINTNEXTLINE(cppcoreguidelines-init-variables)
+			GLuint64 end;
+			glGetQueryObjectui64v(s.end_query, GL_QUERY_RESULT, &end);
+			assert_opengl_no_error();
+
+			// timestamps are in nanoseconds
+			gpu_time = std::chrono::nanoseconds(end >= begin ? end - begin : 0);
+		}
+
+		auto cpu_time = std::chrono::duration_cast<std::chrono::nanoseconds>(s.cpu_end - s.cpu_begin);
+
+		this->last_frame.scopes.push_back({
+			.name = s.name,
+			.depth = s.depth,
+			.gpu_time = gpu_time,
+			.cpu_time = cpu_time
+		});
+
+		auto i = this->stats.find(s.name);
+		if (i == this->stats.end()) {
+			i = this->stats.insert(std::make_pair(s.name, scope_statistics())).first;
+		}
+		auto& st = i->second;
+		++st.num_samples;
+		st.total_gpu_time += gpu_time;
+		st.total_cpu_time += cpu_time;
+		st.max_gpu_time = std::max(st.max_gpu_time, gpu_time);
+	}
+
+	this->release_queries(f);
+}
+
+void gpu_profiler::end_frame()
+{
+	utki::assert(this->open_scopes.empty(), SL);
+
+	this->pending_frames.push_back({
+		.frame = this->cur_frame, //
+		.scopes = std::move(this->cur_scopes)
+	});
+	this->cur_scopes.clear();
+	++this->cur_frame;
+
+	while (!this->pending_frames.empty()) {
+		auto& f = this->pending_frames.front();
+		if (this->is_available(f)) {
+			this->resolve(f);
+		} else if (this->pending_frames.size() > max_frames_in_flight) {
+			// reading the results now would stall, drop the frame instead
+			this->release_queries(f);
+			++this->num_dropped_frames;
+		} else {
+			break;
+		}
+		this->pending_frames.pop_front();
+	}
+}
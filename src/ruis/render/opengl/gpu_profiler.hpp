@@ -0,0 +1,268 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <GL/glew.h>
+
+namespace ruis::render::opengl {
+
+/**
+ * @brief Profiler of GPU time spent in named scopes.
+ * Timestamps at the beginning and the end of each scope are recorded with timestamp queries,
+ * which allows nesting the scopes. The query results are read back a few frames later,
+ * once those are available, so profiling never waits for the GPU.
+ * Query objects are pooled and reused.
+ * In case timer queries are not supported, only CPU time of the scopes is measured.
+ * The draws are issued to OpenGL only when the draw recording ends, so while recording,
+ * the scopes should enclose begin_recording() and end_recording() calls to measure the draws.
+ * The profiler must only be used on the rendering thread.
+ */
+class gpu_profiler
+{
+public:
+	struct scope_timing {
+		std::string name;
+
+		/**
+		 * @brief Nesting depth of the scope, 0 for the outermost scopes.
+		 */
+		unsigned depth;
+
+		/**
+		 * @brief GPU time of the scope.
+		 * Zero in case timer queries are not supported.
+		 */
+		std::chrono::nanoseconds gpu_time;
+
+		/**
+		 * @brief CPU time spent between the beginning and the end of the scope.
+		 */
+		std::chrono::nanoseconds cpu_time;
+	};
+
+	struct frame_timings {
+		/**
+		 * @brief Number of the frame, counted by end_frame() calls.
+		 */
+		uint64_t frame = 0;
+
+		/**
+		 * @brief Timings of the scopes in the order the scopes were begun.
+		 */
+		std::vector<scope_timing> scopes;
+	};
+
+	struct scope_statistics {
+		size_t num_samples = 0;
+		std::chrono::nanoseconds total_gpu_time{0};
+		std::chrono::nanoseconds total_cpu_time{0};
+		std::chrono::nanoseconds max_gpu_time{0};
+
+		std::chrono::nanoseconds average_gpu_time() const noexcept
+		{
+			if (this->num_samples == 0) {
+				return std::chrono::nanoseconds(0);
+			}
+			return this->total_gpu_time / this->num_samples;
+		}
+
+		std::chrono::nanoseconds average_cpu_time() const noexcept
+		{
+			if (this->num_samples == 0) {
+				return std::chrono::nanoseconds(0);
+			}
+			return this->total_cpu_time / this->num_samples;
+		}
+	};
+
+	/**
+	 * @brief RAII helper for profiling a scope.
+	 */
+	class scope
+	{
+		gpu_profiler& profiler;
+
+	public:
+		scope(
+			gpu_profiler& profiler, //
+			std::string name
+		) :
+			profiler(profiler)
+		{
+			this->profiler.begin_scope(std::move(name));
+		}
+
+		scope(const scope&) = delete;
+		scope& operator=(const scope&) = delete;
+
+		scope(scope&&) = delete;
+		scope& operator=(scope&&) = delete;
+
+		~scope()
+		{
+			this->profiler.end_scope();
+		}
+	};
+
+	/**
+	 * @brief Maximum number of frames the query results are waited for.
+	 * Timings of frames which query results are not available by then are dropped.
+	 */
+	constexpr static const size_t max_frames_in_flight = 4;
+
+private:
+	const bool timer_query_supported;
+
+	struct pending_scope {
+		std::string name;
+		unsigned depth;
+
+		// 0 in case timer queries are not supported
+		GLuint begin_query;
+		GLuint end_query;
+
+		std::chrono::steady_clock::time_point cpu_begin;
+		std::chrono::steady_clock::time_point cpu_end;
+	};
+
+	struct pending_frame {
+		uint64_t frame;
+		std::vector<pending_scope> scopes;
+	};
+
+	uint64_t cur_frame = 0;
+
+	// scopes of the current frame
+	std::vector<pending_scope> cur_scopes;
+
+	// indices of the open scopes within cur_scopes
+	std::vector<size_t> open_scopes;
+
+	// frames waiting for the query results, the oldest go first
+	std::deque<pending_frame> pending_frames;
+
+	std::vector<GLuint> query_pool;
+
+	frame_timings last_frame;
+
+	std::map<std::string, scope_statistics, std::less<>> stats;
+
+	size_t num_dropped_frames = 0;
+
+public:
+	/**
+	 * @param timer_query_supported - whether timestamp queries are supported.
+	 */
+	gpu_profiler(bool timer_query_supported);
+
+	gpu_profiler(const gpu_profiler&) = delete;
+	gpu_profiler& operator=(const gpu_profiler&) = delete;
+
+	gpu_profiler(gpu_profiler&&) = delete;
+	gpu_profiler& operator=(gpu_profiler&&) = delete;
+
+	~gpu_profiler();
+
+	/**
+	 * @brief Check if GPU time is measured.
+	 * @return true if timer queries are supported.
+	 * @return false if only CPU time is measured.
+	 */
+	bool is_gpu_timing_supported() const noexcept
+	{
+		return this->timer_query_supported;
+	}
+
+	/**
+	 * @brief Begin profiling scope.
+	 * Scopes can be nested. Each begin_scope() has to be matched by end_scope() within the same frame.
+	 * @param name - name of the scope, statistics of the scopes with the same name are accumulated together.
+	 */
+	void begin_scope(std::string name);
+
+	/**
+	 * @brief End the innermost open profiling scope.
+	 */
+	void end_scope();
+
+	/**
+	 * @brief Advance frame.
+	 * Reads back available query results of previous frames.
+	 * Must be called once per frame, when no scopes are open.
+	 * context::end_frame() does that for the profiler of the context.
+	 */
+	void end_frame();
+
+	/**
+	 * @brief Get timings of the latest frame which query results are read back.
+	 * The frame is usually a few frames behind the current one.
+	 * @return Timings of the frame.
+	 */
+	const frame_timings& get_last_frame_timings() const noexcept
+	{
+		return this->last_frame;
+	}
+
+	/**
+	 * @brief Get accumulated statistics of the scopes.
+	 * @return Statistics by scope name.
+	 */
+	const std::map<std::string, scope_statistics, std::less<>>& get_statistics() const noexcept
+	{
+		return this->stats;
+	}
+
+	void reset_statistics() noexcept
+	{
+		this->stats.clear();
+	}
+
+	/**
+	 * @brief Get number of frames which timings were dropped.
+	 * Timings are dropped in case the query results are not available
+	 * after max_frames_in_flight frames.
+	 * @return Number of dropped frames.
+	 */
+	size_t get_num_dropped_frames() const noexcept
+	{
+		return this->num_dropped_frames;
+	}
+
+private:
+	GLuint acquire_query();
+	void release_queries(pending_frame& f);
+
+	// returns true if the query results of the frame are available
+	bool is_available(const pending_frame& f) const;
+
+	void resolve(pending_frame& f);
+};
+
+} // namespace ruis::render::opengl
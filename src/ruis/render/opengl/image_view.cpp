@@ -0,0 +1,296 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+#include "image_view.hpp"
+
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include <utki/debug.hpp>
+
+#include "pixel_kernels.hpp"
+#include "util.hpp"
+
+using namespace ruis::render::opengl;
+
+namespace {
+GLint get_unpack_alignment(
+	utki::span<const uint8_t> data, //
+	size_t row_size
+)
+{
+	constexpr size_t max_alignment = 8;
+
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "needed to check pointer alignment")
+	auto address = reinterpret_cast<uintptr_t>(data.data());
+
+	size_t alignment = max_alignment;
+	for (; alignment != 1; alignment /= 2) {
+		if (row_size % alignment == 0 && address % alignment == 0) {
+			break;
+		}
+	}
+	return GLint(alignment);
+}
+} // namespace
+
+size_t ruis::render::opengl::to_component_size(GLenum type)
+{
+	switch (type) {
+		case GL_UNSIGNED_BYTE:
+			return sizeof(uint8_t);
+		case GL_UNSIGNED_SHORT:
+		case GL_HALF_FLOAT:
+			return sizeof(uint16_t);
+		case GL_FLOAT:
+			return sizeof(float);
+		default:
+			utki::assert(false, SL);
+			return 0;
+	}
+}
+
+size_t image_view::get_pixel_size() const noexcept
+{
+	return size_t(rasterimage::to_num_channels(this->format)) * to_component_size(this->type);
+}
+
+void image_view::upload(
+	GLenum target, //
+	GLenum gl_format,
+	r4::vector2<uint32_t> pos,
+	bool reverse_rows
+) const
+{
+	auto pixel_size = this->get_pixel_size();
+	auto stride = size_t(this->get_stride());
+
+	ASSERT(this->origin.x() + this->dims.x() <= stride)
+	ASSERT((size_t(this->origin.y()) + size_t(this->dims.y())) * stride * pixel_size <= this->data.size())
+
+	// Use the largest row alignment the pixels have, 1-byte aligned rows is a slow path on many drivers.
+	glPixelStorei(GL_UNPACK_ALIGNMENT, get_unpack_alignment(this->data, stride * pixel_size));
+	assert_opengl_no_error();
+
+	// select the image area within the whole image
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, GLint(stride));
+	assert_opengl_no_error();
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, GLint(this->origin.x()));
+	assert_opengl_no_error();
+
+	if (!reverse_rows) {
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, GLint(this->origin.y()));
+		assert_opengl_no_error();
+
+		glTexSubImage2D(
+			target,
+			0, // 0th level, no mipmaps
+			GLint(pos.x()),
+			GLint(pos.y()),
+			GLsizei(this->dims.x()),
+			GLsizei(this->dims.y()),
+			gl_format, // format of the texel data
+			this->type, // data type of the texel data
+			this->data.data()
+		);
+		assert_opengl_no_error();
+	} else {
+		// OpenGL cannot read rows in reverse order, so upload the rows one by one
+		for (uint32_t r = 0; r != this->dims.y(); ++r) {
+			glPixelStorei(GL_UNPACK_SKIP_ROWS, GLint(this->origin.y() + this->dims.y() - 1 - r));
+			assert_opengl_no_error();
+
+			glTexSubImage2D(
+				target,
+				0, // 0th level, no mipmaps
+				GLint(pos.x()),
+				GLint(pos.y() + r),
+				GLsizei(this->dims.x()),
+				1,
+				gl_format, // format of the texel data
+				this->type, // data type of the texel data
+				this->data.data()
+			);
+			assert_opengl_no_error();
+		}
+	}
+
+	// restore default unpacking parameters
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	assert_opengl_no_error();
+	glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+	assert_opengl_no_error();
+	glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+	assert_opengl_no_error();
+}
+
+image_view ruis::render::opengl::make_image_view(const rasterimage::image_variant& imvar)
+{
+	return std::visit(
+		[&](const auto& im) -> image_view {
+			auto data = im.pixels();
+			using component_type = std::remove_cv_t<std::remove_reference_t<decltype(data.front().front())>>;
+
+			GLenum type = [&]() {
+				if constexpr (std::is_same_v<component_type, uint8_t>) {
+					return GLenum(GL_UNSIGNED_BYTE);
+				} else if constexpr (std::is_same_v<component_type, uint16_t>) {
+					return GLenum(GL_UNSIGNED_SHORT);
+				} else if constexpr (std::is_same_v<component_type, float>) {
+					return GLenum(GL_FLOAT);
+				} else {
+					throw std::logic_error(
+						"make_image_view(): "
+						"image component type is not supported"
+					);
+				}
+			}();
+
+			return {
+				.format = imvar.get_format(),
+				.type = type,
+				.dims = im.dims(),
+				.data = utki::make_span(
+					// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "pixels are uploaded as raw bytes")
+					reinterpret_cast<const uint8_t*>(data.front().data()),
+					data.size_bytes()
+				)
+			};
+		},
+		imvar.variant
+	);
+}
+
+void ruis::render::opengl::convert_floats(
+	utki::span<const uint8_t> src, //
+	GLenum type,
+	utki::span<uint8_t> dst
+)
+{
+	auto src_floats = utki::make_span(
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "pixels of float images are floats")
+		reinterpret_cast<const float*>(src.data()),
+		src.size() / sizeof(float)
+	);
+
+	switch (type) {
+		case GL_HALF_FLOAT:
+		case GL_UNSIGNED_SHORT:
+			{
+				auto dst_shorts = utki::make_span(
+					// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "destination holds 16-bit components")
+					reinterpret_cast<uint16_t*>(dst.data()),
+					src_floats.size()
+				);
+				ASSERT(dst.size() >= dst_shorts.size_bytes())
+				if (type == GL_HALF_FLOAT) {
+					convert_float_to_half(src_floats, dst_shorts);
+				} else {
+					convert_float_to_unorm16(src_floats, dst_shorts);
+				}
+			}
+			break;
+		case GL_UNSIGNED_BYTE:
+			ASSERT(dst.size() >= src_floats.size())
+			convert_float_to_unorm8(src_floats, dst.subspan(0, src_floats.size()));
+			break;
+		default:
+			utki::assert(false, SL);
+			break;
+	}
+}
+
+image_view ruis::render::opengl::prepare_for_upload(
+	const image_view& image, //
+	bool reverse_rows,
+	GLenum float_type,
+	std::vector<uint8_t>& buffer
+)
+{
+	bool convert = image.type == GL_FLOAT && float_type != GL_FLOAT;
+
+	if (image.data.empty()) {
+		auto ret = image;
+		if (convert) {
+			ret.type = float_type;
+		}
+		return ret;
+	}
+
+	constexpr size_t rgba_size = 4;
+	constexpr size_t gl_alignment = 4;
+
+	auto num_channels = size_t(rasterimage::to_num_channels(image.format));
+	auto pixel_size = image.get_pixel_size();
+	auto src_stride = size_t(image.get_stride()) * pixel_size;
+
+	// rows of 3-byte pixels are often not aligned, which is a slow path on many drivers
+	bool expand = image.type == GL_UNSIGNED_BYTE && image.format == rasterimage::format::rgb &&
+		src_stride % gl_alignment != 0;
+
+	if (!expand && !convert && !reverse_rows) {
+		return image;
+	}
+
+	auto src_row_size = size_t(image.dims.x()) * pixel_size;
+	auto dst_row_size = [&]() {
+		if (expand) {
+			return size_t(image.dims.x()) * rgba_size;
+		} else if (convert) {
+			return size_t(image.dims.x()) * num_channels * to_component_size(float_type);
+		}
+		return src_row_size;
+	}();
+	auto num_rows = size_t(image.dims.y());
+
+	buffer.resize(dst_row_size * num_rows);
+
+	auto src = image.data.subspan((size_t(image.origin.y()) * image.get_stride() + image.origin.x()) * pixel_size);
+
+	if (expand || convert) {
+		for (size_t r = 0; r != num_rows; ++r) {
+			auto src_row = src.subspan((reverse_rows ? num_rows - 1 - r : r) * src_stride, src_row_size);
+			auto dst_row = utki::make_span(buffer).subspan(r * dst_row_size, dst_row_size);
+			if (expand) {
+				expand_rgb_to_rgba(src_row, dst_row);
+			} else {
+				convert_floats(src_row, float_type, dst_row);
+			}
+		}
+	} else {
+		flip_rows(
+			src, //
+			src_stride,
+			utki::make_span(buffer),
+			src_row_size,
+			num_rows
+		);
+	}
+
+	return {
+		.format = expand ? rasterimage::format::rgba : image.format,
+		.type = convert ? float_type : image.type,
+		.dims = image.dims,
+		.data = utki::make_span(std::as_const(buffer)),
+		.top_down = reverse_rows ? !image.top_down : image.top_down
+	};
+}
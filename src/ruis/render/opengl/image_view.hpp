@@ -0,0 +1,167 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <r4/vector.hpp>
+#include <rasterimage/image_variant.hpp>
+#include <utki/span.hpp>
+
+namespace ruis::render::opengl {
+
+/**
+ * @brief Borrowed image pixels in client memory.
+ * Describes a rectangular area of a possibly larger image, so that the area
+ * can be uploaded to a texture without copying or flipping the pixels on CPU.
+ * Rows are not padded.
+ */
+struct image_view {
+	rasterimage::format format = rasterimage::format::rgba;
+
+	/**
+	 * @brief OpenGL data type of the pixel components.
+	 * One of GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_HALF_FLOAT or GL_FLOAT.
+	 */
+	GLenum type = GL_UNSIGNED_BYTE;
+
+	/**
+	 * @brief Dimensions of the image area in pixels.
+	 */
+	rasterimage::dimensioned::dimensions_type dims = {0, 0};
+
+	/**
+	 * @brief Pixels of the whole image.
+	 * Empty for textures without initial contents.
+	 */
+	utki::span<const uint8_t> data;
+
+	/**
+	 * @brief Row stride of the whole image in pixels.
+	 * 0 means the stride equals to the width of the image area.
+	 */
+	uint32_t stride = 0;
+
+	/**
+	 * @brief Position of the image area within the whole image in pixels.
+	 * Rows are counted from the first row in memory.
+	 */
+	r4::vector2<uint32_t> origin = {0, 0};
+
+	/**
+	 * @brief Row order of the pixel data.
+	 * true if the first row in memory is the top row of the image,
+	 * false if the first row in memory is the bottom row of the image.
+	 */
+	bool top_down = true;
+
+	/**
+	 * @brief Get size of a pixel.
+	 * @return Size of a pixel in bytes.
+	 */
+	size_t get_pixel_size() const noexcept;
+
+	/**
+	 * @brief Get size of the image area pixels.
+	 * @return Size in bytes of the pixels within the image area.
+	 */
+	size_t get_size_bytes() const noexcept
+	{
+		return size_t(this->dims.x()) * size_t(this->dims.y()) * this->get_pixel_size();
+	}
+
+	uint32_t get_stride() const noexcept
+	{
+		if (this->stride == 0) {
+			return this->dims.x();
+		}
+		return this->stride;
+	}
+
+	/**
+	 * @brief Upload the image area to the bound texture.
+	 * The rows are read directly from the whole image using GL_UNPACK_ROW_LENGTH,
+	 * GL_UNPACK_SKIP_PIXELS and GL_UNPACK_SKIP_ROWS. In case the rows have to be reversed,
+	 * they are uploaded one by one in reverse order.
+	 * @param target - texture target or cube map face.
+	 * @param gl_format - OpenGL format of the texel data.
+	 * @param pos - position of the image area within the texture.
+	 * @param reverse_rows - whether to place the last row in memory to the first texture row.
+	 */
+	void upload(
+		GLenum target, //
+		GLenum gl_format,
+		r4::vector2<uint32_t> pos,
+		bool reverse_rows
+	) const;
+};
+
+/**
+ * @brief Make view of image pixels.
+ * The image must outlive the view.
+ * @param imvar - image to make the view of. 8-bit, 16-bit and float images are supported.
+ * @return Top-down view of the whole image.
+ * @throw std::logic_error - in case the image component type is not supported.
+ */
+image_view make_image_view(const rasterimage::image_variant& imvar);
+
+/**
+ * @brief Get size of a pixel component.
+ * @param type - OpenGL data type of the pixel components.
+ * @return Size of a pixel component in bytes.
+ */
+size_t to_component_size(GLenum type);
+
+/**
+ * @brief Convert float components.
+ * @param src - source float components.
+ * @param type - OpenGL data type to convert to, GL_HALF_FLOAT, GL_UNSIGNED_SHORT or GL_UNSIGNED_BYTE.
+ *        Values are clamped to [0, 1] when converting to the normalized integer types.
+ * @param dst - destination components, must be large enough to hold the converted source components.
+ */
+void convert_floats(
+	utki::span<const uint8_t> src, //
+	GLenum type,
+	utki::span<uint8_t> dst
+);
+
+/**
+ * @brief Prepare image for fast uploading.
+ * 8-bit RGB images with rows not aligned to 4 bytes are expanded to RGBA.
+ * In case the rows do not need reversing and the image does not need expanding or converting,
+ * the image is returned as is, without copying.
+ * @param image - image to prepare.
+ * @param reverse_rows - whether to copy the rows in reverse order.
+ * @param float_type - OpenGL data type to upload float components as, see opengl_texture::to_float_type().
+ *        Float components are converted in case it is not GL_FLOAT.
+ * @param buffer - buffer for the prepared pixels in case those need to be copied.
+ * @return View of the prepared image. Its row order is reversed in case the rows were reversed.
+ *         For float images its data type is the float_type, also for images without data.
+ */
+image_view prepare_for_upload(
+	const image_view& image, //
+	bool reverse_rows,
+	GLenum float_type,
+	std::vector<uint8_t>& buffer
+);
+
+} // namespace ruis::render::opengl
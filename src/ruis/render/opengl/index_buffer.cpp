@@ -32,49 +32,102 @@ index_buffer::index_buffer(
 	const void* data,
 	size_t size_bytes,
 	size_t size,
-	GLenum element_type
+	GLenum element_type,
+	buffer_usage usage
 ) :
-	ruis::render::index_buffer(std::move(rendering_context)),
+	ruis::render::index_buffer(rendering_context),
+	opengl_buffer(
+		rendering_context, //
+		GL_ELEMENT_ARRAY_BUFFER,
+		size_bytes,
+		usage
+	),
 	element_type(element_type),
 	elements_count(GLsizei(size))
 {
-	glBindBuffer(
+	this->bind();
+
+	this->allocate(
 		GL_ELEMENT_ARRAY_BUFFER, //
-		this->buffer
+		data,
+		size_bytes,
+		usage
 	);
-	assert_opengl_no_error();
+}
+
+void index_buffer::bind()
+{
+	this->opengl_context.get().get_state_cache().bind_default_element_array_buffer(this->get_buffer());
+}
 
-	glBufferData(
+void index_buffer::update_data(
+	size_t offset, //
+	const void* data,
+	size_t size
+)
+{
+	this->bind();
+
+	this->opengl_buffer::update(
 		GL_ELEMENT_ARRAY_BUFFER, //
-		GLsizeiptr(size_bytes),
+		offset,
 		data,
-		GL_STATIC_DRAW
+		size
+	);
+}
+
+void index_buffer::update(
+	size_t first, //
+	utki::span<const uint16_t> indices
+)
+{
+	ASSERT(this->element_type == GL_UNSIGNED_SHORT)
+	this->update_data(
+		first * sizeof(uint16_t), //
+		indices.data(),
+		indices.size_bytes()
+	);
+}
+
+void index_buffer::update(
+	size_t first, //
+	utki::span<const uint32_t> indices
+)
+{
+	ASSERT(this->element_type == GL_UNSIGNED_INT)
+	this->update_data(
+		first * sizeof(uint32_t), //
+		indices.data(),
+		indices.size_bytes()
 	);
-	assert_opengl_no_error();
 }
 
 index_buffer::index_buffer(
 	utki::shared_ref<const ruis::render::context> rendering_context, //
-	utki::span<const uint16_t> indices
+	utki::span<const uint16_t> indices,
+	buffer_usage usage
 ) :
 	index_buffer(
 		std::move(rendering_context), //
 		indices.data(),
 		indices.size_bytes(),
 		indices.size(),
-		GL_UNSIGNED_SHORT
+		GL_UNSIGNED_SHORT,
+		usage
 	)
 {}
 
 index_buffer::index_buffer(
 	utki::shared_ref<const ruis::render::context> rendering_context, //
-	utki::span<const uint32_t> indices
+	utki::span<const uint32_t> indices,
+	buffer_usage usage
 ) :
 	index_buffer(
 		std::move(rendering_context), //
 		indices.data(),
 		indices.size_bytes(),
 		indices.size(),
-		GL_UNSIGNED_INT
+		GL_UNSIGNED_INT,
+		usage
 	)
 {}
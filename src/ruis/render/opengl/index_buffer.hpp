@@ -42,17 +42,20 @@ private:
 		const void* data,
 		size_t size_bytes,
 		size_t size,
-		GLenum element_type
+		GLenum element_type,
+		buffer_usage usage
 	);
 
 public:
 	index_buffer(
 		utki::shared_ref<const ruis::render::context> rendering_context, //
-		utki::span<const uint16_t> indices
+		utki::span<const uint16_t> indices,
+		buffer_usage usage = buffer_usage::static_draw
 	);
 	index_buffer(
 		utki::shared_ref<const ruis::render::context> rendering_context, //
-		utki::span<const uint32_t> indices
+		utki::span<const uint32_t> indices,
+		buffer_usage usage = buffer_usage::static_draw
 	);
 
 	index_buffer(const index_buffer&) = delete;
@@ -63,7 +66,30 @@ public:
 
 	~index_buffer() override = default;
 
+	/**
+	 * @brief Update indices.
+	 * The index type must match the one of the buffer.
+	 * @param first - index of the first element to update.
+	 * @param indices - new index values.
+	 */
+	void update(
+		size_t first, //
+		utki::span<const uint16_t> indices
+	);
+
+	void update(
+		size_t first, //
+		utki::span<const uint32_t> indices
+	);
+
 private:
+	void update_data(
+		size_t offset, //
+		const void* data,
+		size_t size
+	);
+
+	void bind();
 };
 
 } // namespace ruis::render::opengl
@@ -21,24 +21,244 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "opengl_buffer.hpp"
 
+#include <stdexcept>
+
 #include "util.hpp"
 
 using namespace ruis::render::opengl;
 
-opengl_buffer::opengl_buffer() :
-	buffer([]() -> GLuint {
-		// NOLINTNEXTLINE(cppcoreguidelines-init-variables)
-		GLuint ret;
-		glGenBuffers(1, &ret);
-		assert_opengl_no_error();
-		return ret;
-	}())
-{}
+namespace {
+GLenum to_gl_usage(buffer_usage u)
+{
+	switch (u) {
+		case buffer_usage::dynamic_draw:
+			return GL_DYNAMIC_DRAW;
+		case buffer_usage::stream_draw:
+			return GL_STREAM_DRAW;
+		case buffer_usage::static_draw:
+			break;
+	}
+	return GL_STATIC_DRAW;
+}
+} // namespace
 
-opengl_buffer::~opengl_buffer()
+namespace {
+GLuint gen_buffer()
 {
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	// NOLINTNEXTLINE(cppcoreguidelines-init-variables)
+	GLuint ret;
+	glGenBuffers(1, &ret);
 	assert_opengl_no_error();
+	return ret;
+}
+} // namespace
+
+opengl_buffer::opengl_buffer(const utki::shared_ref<const ruis::render::context>& rendering_context) :
+	opengl_context(context::to_opengl_context(rendering_context)),
+	arena(nullptr),
+	block(nullptr),
+	buffer(gen_buffer())
+{
+	this->opengl_context.get().get_resource_census().on_created(resource_kind::buffer);
+}
+
+opengl_buffer::opengl_buffer(
+	const utki::shared_ref<const ruis::render::context>& rendering_context,
+	GLenum target,
+	size_t size,
+	buffer_usage usage
+) :
+	opengl_context(context::to_opengl_context(rendering_context)),
+	arena([&]() -> buffer_arena* {
+		if (usage != buffer_usage::static_draw) {
+			// frequently updated buffers are better off with dedicated buffer objects
+			return nullptr;
+		}
+		const auto& ctx = this->opengl_context.get();
+		if (ctx.is_loader_thread()) {
+			return nullptr;
+		}
+		switch (target) {
+			case GL_ARRAY_BUFFER:
+				return &ctx.get_vertex_buffer_arena();
+			case GL_ELEMENT_ARRAY_BUFFER:
+				return &ctx.get_index_buffer_arena();
+			default:
+				return nullptr;
+		}
+	}()),
+	block(this->arena ? this->arena->allocate(size) : nullptr),
+	buffer(this->block ? this->block->buffer : gen_buffer())
+{
+	// arena pages are counted in the resource census by the arena
+	if (!this->block) {
+		this->opengl_context.get().get_resource_census().on_created(resource_kind::buffer);
+	}
+}
+
+opengl_buffer::~opengl_buffer()
+{
+	if (this->block) {
+		ASSERT(this->arena)
+		this->arena->free(this->block);
+		return;
+	}
+
+	this->opengl_context.get().get_resource_census().on_destroyed(
+		resource_kind::buffer, //
+		this->size_bytes
+	);
+
+	this->opengl_context.get().get_state_cache().on_buffer_deleted(this->buffer);
 	glDeleteBuffers(1, &this->buffer);
 	assert_opengl_no_error();
 }
+
+void opengl_buffer::allocate(
+	GLenum target, //
+	const void* data,
+	size_t size,
+	buffer_usage u
+)
+{
+	if (this->block) {
+		ASSERT(size <= this->block->size)
+		if (data) {
+			glBufferSubData(
+				target, //
+				GLintptr(this->block->offset),
+				GLsizeiptr(size),
+				data
+			);
+			assert_opengl_no_error();
+			this->opengl_context.get().get_state_cache().get_statistics().buffer_bytes_uploaded += size;
+		}
+		this->set_size_bytes(size);
+		return;
+	}
+
+	glBufferData(
+		target, //
+		GLsizeiptr(size),
+		data,
+		to_gl_usage(u)
+	);
+	assert_opengl_no_error();
+	if (data) {
+		this->opengl_context.get().get_state_cache().get_statistics().buffer_bytes_uploaded += size;
+	}
+
+	this->usage = u;
+	this->set_size_bytes(size);
+	this->num_updates = 0;
+}
+
+void opengl_buffer::set_size_bytes(size_t size) noexcept
+{
+	if (!this->block) {
+		this->opengl_context.get().get_resource_census().on_resized(
+			resource_kind::buffer, //
+			this->size_bytes,
+			size
+		);
+	}
+	this->size_bytes = size;
+}
+
+void opengl_buffer::update(
+	GLenum target, //
+	size_t offset,
+	const void* data,
+	size_t size
+)
+{
+	if (offset + size > this->size_bytes) {
+		throw std::invalid_argument("opengl_buffer::update(): updated range is out of buffer bounds");
+	}
+
+	++this->num_updates;
+
+	bool whole = offset == 0 && size == this->size_bytes;
+
+	if (this->block &&
+		(whole || this->opengl_context.get().supported_extensions.get(extension::arb_copy_buffer)))
+	{
+		this->move_out_of_arena(target, !whole);
+	}
+
+	if (whole && !this->block) {
+		auto old_usage = this->usage;
+		auto u = old_usage;
+		if (this->auto_usage && u == buffer_usage::static_draw && this->num_updates >= auto_usage_num_updates) {
+			u = buffer_usage::dynamic_draw;
+		}
+
+		auto n = this->num_updates;
+		this->allocate(target, data, size, u);
+
+		// keep counting updates in case usage has not changed
+		if (u == old_usage) {
+			this->num_updates = n;
+		}
+		return;
+	}
+
+	glBufferSubData(
+		target, //
+		GLintptr(this->get_offset() + offset),
+		GLsizeiptr(size),
+		data
+	);
+	assert_opengl_no_error();
+	this->opengl_context.get().get_state_cache().get_statistics().buffer_bytes_uploaded += size;
+}
+
+void opengl_buffer::move_out_of_arena(
+	GLenum target, //
+	bool copy_data
+)
+{
+	ASSERT(this->arena)
+	ASSERT(this->block)
+
+	auto& state = this->opengl_context.get().get_state_cache();
+
+	GLuint old_buffer = this->buffer;
+	auto old_offset = this->block->offset;
+
+	this->buffer = gen_buffer();
+	state.bind_buffer(target, this->buffer);
+
+	// in case the data is not copied, the storage of the same size is allocated right after
+	this->opengl_context.get().get_resource_census().on_created(
+		resource_kind::buffer, //
+		this->size_bytes
+	);
+
+	if (copy_data) {
+		glBufferData(
+			target, //
+			GLsizeiptr(this->size_bytes),
+			nullptr,
+			to_gl_usage(this->usage)
+		);
+		assert_opengl_no_error();
+
+		// copy targets are not tracked by the state cache
+		glBindBuffer(GL_COPY_READ_BUFFER, old_buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, this->buffer);
+		glCopyBufferSubData(
+			GL_COPY_READ_BUFFER, //
+			GL_COPY_WRITE_BUFFER,
+			GLintptr(old_offset),
+			0,
+			GLsizeiptr(this->size_bytes)
+		);
+		assert_opengl_no_error();
+	}
+
+	// users of the buffer object find out that it has changed by the arena generation
+	this->arena->move_out(this->block);
+	this->arena = nullptr;
+	this->block = nullptr;
+}
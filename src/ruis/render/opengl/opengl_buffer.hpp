@@ -23,14 +23,81 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <GL/glew.h>
 
+#include "buffer_arena.hpp"
+#include "context.hpp"
+
 namespace ruis::render::opengl {
 
+/**
+ * @brief Buffer usage hint.
+ * Tells OpenGL how often the buffer data is going to be updated.
+ */
+enum class buffer_usage {
+	/**
+	 * @brief Data is set once and drawn many times.
+	 */
+	static_draw,
+
+	/**
+	 * @brief Data is updated repeatedly and drawn many times.
+	 */
+	dynamic_draw,
+
+	/**
+	 * @brief Data is updated before almost every draw.
+	 */
+	stream_draw
+};
+
 class opengl_buffer
 {
+	buffer_usage usage = buffer_usage::static_draw;
+
+	size_t size_bytes = 0;
+
+	// number of updates since the buffer storage was allocated
+	unsigned num_updates = 0;
+
+	bool auto_usage = true;
+
 public:
-	const GLuint buffer;
+	/**
+	 * @brief Number of updates after which a static buffer is migrated to dynamic usage.
+	 */
+	constexpr static const unsigned auto_usage_num_updates = 4;
+
+	const utki::shared_ref<const context> opengl_context;
 
-	opengl_buffer();
+private:
+	// arena the buffer is sub-allocated from, nullptr in case the buffer has dedicated buffer object
+	buffer_arena* arena;
+	buffer_arena::block* block;
+
+	GLuint buffer;
+
+public:
+	/**
+	 * @brief Create buffer with dedicated buffer object.
+	 * @param rendering_context - rendering context.
+	 */
+	opengl_buffer(const utki::shared_ref<const ruis::render::context>& rendering_context);
+
+	/**
+	 * @brief Create buffer of known size.
+	 * Small buffers with static usage are sub-allocated from the buffer arena of the context,
+	 * the rest get dedicated buffer objects.
+	 * The buffer storage still has to be initialized with allocate().
+	 * @param rendering_context - rendering context.
+	 * @param target - either GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER.
+	 * @param size - size of the buffer in bytes.
+	 * @param usage - usage hint.
+	 */
+	opengl_buffer(
+		const utki::shared_ref<const ruis::render::context>& rendering_context,
+		GLenum target,
+		size_t size,
+		buffer_usage usage
+	);
 
 	opengl_buffer(const opengl_buffer&) = delete;
 	opengl_buffer& operator=(const opengl_buffer&) = delete;
@@ -40,7 +107,115 @@ public:
 
 	virtual ~opengl_buffer();
 
+	buffer_usage get_usage() const noexcept
+	{
+		return this->usage;
+	}
+
+	size_t get_size_bytes() const noexcept
+	{
+		return this->size_bytes;
+	}
+
+	/**
+	 * @brief Get OpenGL buffer object.
+	 * In case the buffer is sub-allocated from a buffer arena, the buffer object is shared
+	 * with other buffers and the buffer data starts at get_offset().
+	 * The buffer object changes in case the buffer is moved out of the arena on update,
+	 * the generation of the arena is incremented then.
+	 * @return OpenGL buffer object.
+	 */
+	GLuint get_buffer() const noexcept
+	{
+		return this->buffer;
+	}
+
+	/**
+	 * @brief Get offset of the buffer data within the buffer object.
+	 * The offset can change in case the buffer arena is defragmented.
+	 * @return Offset in bytes.
+	 */
+	size_t get_offset() const noexcept
+	{
+		if (this->block) {
+			return this->block->offset;
+		}
+		return 0;
+	}
+
+	bool is_sub_allocated() const noexcept
+	{
+		return this->block != nullptr;
+	}
+
+	/**
+	 * @brief Enable or disable automatic usage migration.
+	 * In case enabled, a buffer with static usage which is updated frequently
+	 * is migrated to dynamic usage. The migration is done on the next update
+	 * of the whole buffer, since changing the usage re-allocates the buffer storage.
+	 * Enabled by default.
+	 * @param enable - whether to enable automatic usage migration.
+	 */
+	void set_auto_usage(bool enable) noexcept
+	{
+		this->auto_usage = enable;
+	}
+
+protected:
+	/**
+	 * @brief Allocate buffer storage.
+	 * The buffer must be bound to the target.
+	 * In case the buffer is sub-allocated, the data is uploaded to the allocated block
+	 * and the usage hint is ignored.
+	 * @param target - target the buffer is bound to.
+	 * @param data - data to initialize the buffer with. Can be nullptr.
+	 * @param size - size of the buffer in bytes.
+	 * @param u - usage hint.
+	 */
+	void allocate(
+		GLenum target, //
+		const void* data,
+		size_t size,
+		buffer_usage u
+	);
+
+	/**
+	 * @brief Update buffer data.
+	 * The buffer must be bound to the target.
+	 * In case the buffer is sub-allocated, it is moved out of the arena to a dedicated buffer object first,
+	 * so that updates do not stall draws using other buffers of the shared arena page and the buffer
+	 * can migrate to dynamic usage. Partial updates of sub-allocated buffers are done in place
+	 * in case copying between buffers is not supported.
+	 * In case the whole buffer is updated, the buffer storage is re-allocated,
+	 * so that OpenGL does not have to wait till the draws using the old data are finished.
+	 * @param target - target the buffer is bound to.
+	 * @param offset - offset in bytes within the buffer to update data at.
+	 * @param data - new data.
+	 * @param size - size of the new data in bytes.
+	 */
+	void update(
+		GLenum target, //
+		size_t offset,
+		const void* data,
+		size_t size
+	);
+
+public:
+	/**
+	 * @brief Set size of the buffer storage.
+	 * For users which allocate the storage of a dedicated buffer object directly,
+	 * with glBufferData() or glBufferStorage(), so that the size is accounted in the resource census.
+	 * Sizes of sub-allocated buffers are not accounted, as the arena accounts its pages.
+	 * @param size - size of the buffer storage in bytes.
+	 */
+	void set_size_bytes(size_t size) noexcept;
+
 private:
+	// the storage of the new buffer object is only allocated in case the data is copied
+	void move_out_of_arena(
+		GLenum target, //
+		bool copy_data
+	);
 };
 
 } // namespace ruis::render::opengl
@@ -21,52 +21,92 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "opengl_texture.hpp"
 
+#include <stdexcept>
+
+#include <utki/debug.hpp>
+
+#include "texture_residency.hpp"
 #include "util.hpp"
 
 using namespace ruis::render::opengl;
 
-opengl_texture::opengl_texture()
+opengl_texture::opengl_texture(
+	const utki::shared_ref<const ruis::render::context>& rendering_context, //
+	GLenum target
+) :
+	opengl_context(context::to_opengl_context(rendering_context)),
+	target(target)
 {
 	glGenTextures(1, &this->tex);
 	assert_opengl_no_error();
 	utki::assert(this->tex != 0, SL);
+
+	this->opengl_context.get().get_resource_census().on_created(resource_kind::texture);
 }
 
+opengl_texture::opengl_texture(
+	const utki::shared_ref<const ruis::render::context>& rendering_context, //
+	GLenum target,
+	GLuint texture
+) :
+	opengl_context(context::to_opengl_context(rendering_context)),
+	target(target),
+	tex(texture),
+	owns_texture(false)
+{}
+
 opengl_texture::~opengl_texture()
 {
+	if (!this->owns_texture) {
+		return;
+	}
+
+	this->opengl_context.get().get_resource_census().on_destroyed(
+		resource_kind::texture, //
+		this->census_size_bytes
+	);
+
+	this->opengl_context.get().get_state_cache().on_texture_deleted(this->tex);
 	glDeleteTextures(1, &this->tex);
 }
 
-void opengl_texture::set_active_texture(unsigned unit_num) const
+void opengl_texture::bind(const context& rendering_context, unsigned unit_num) const
 {
-	// OpenGL guarantees that GL_TEXTUREi = GL_TEXTURE0 + i
-	glActiveTexture(GL_TEXTURE0 + unit_num);
-	assert_opengl_no_error();
+	// evicted texture has to be uploaded back before use
+	if (!rendering_context.is_loader_thread()) {
+		rendering_context.get_texture_residency().on_bind(*this);
+	}
+
+	rendering_context.get_state_cache().bind_texture(unit_num, this->target, this->tex);
 }
 
-void opengl_texture::bind(unsigned unit_num) const
+void opengl_texture::set_census_size(size_t size_bytes) noexcept
 {
-	this->set_active_texture(unit_num);
-
-	glBindTexture(GL_TEXTURE_2D, this->tex);
-	assert_opengl_no_error();
+	ASSERT(this->owns_texture)
+	this->opengl_context.get().get_resource_census().on_resized(
+		resource_kind::texture, //
+		this->census_size_bytes,
+		size_bytes
+	);
+	this->census_size_bytes = size_bytes;
 }
 
 GLint opengl_texture::set_swizzeling(
-	rasterimage::format f, //
+	GLenum target, //
+	rasterimage::format f,
 	const utki::flags<extension>& supported_extensions
-) const
+)
 {
 	switch (f) {
 		default:
 			utki::assert(false, SL);
 		case rasterimage::format::grey:
 			if (supported_extensions.get(extension::ext_texture_swizzle)) {
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_RED);
+				glTexParameteri(target, GL_TEXTURE_SWIZZLE_R, GL_RED);
 				assert_opengl_no_error();
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+				glTexParameteri(target, GL_TEXTURE_SWIZZLE_G, GL_RED);
 				assert_opengl_no_error();
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+				glTexParameteri(target, GL_TEXTURE_SWIZZLE_B, GL_RED);
 				assert_opengl_no_error();
 				return GL_RED;
 			} else {
@@ -75,13 +115,13 @@ GLint opengl_texture::set_swizzeling(
 			}
 		case rasterimage::format::greya:
 			if (supported_extensions.get(extension::ext_texture_swizzle)) {
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_R, GL_RED);
+				glTexParameteri(target, GL_TEXTURE_SWIZZLE_R, GL_RED);
 				assert_opengl_no_error();
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_G, GL_RED);
+				glTexParameteri(target, GL_TEXTURE_SWIZZLE_G, GL_RED);
 				assert_opengl_no_error();
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_B, GL_RED);
+				glTexParameteri(target, GL_TEXTURE_SWIZZLE_B, GL_RED);
 				assert_opengl_no_error();
-				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_A, GL_GREEN);
+				glTexParameteri(target, GL_TEXTURE_SWIZZLE_A, GL_GREEN);
 				assert_opengl_no_error();
 				return GL_RG;
 			} else {
@@ -94,3 +134,102 @@ GLint opengl_texture::set_swizzeling(
 			return GL_RGBA;
 	}
 }
+
+GLint opengl_texture::to_internal_format(
+	GLint format, //
+	GLenum type,
+	const utki::flags<extension>& supported_extensions
+)
+{
+	switch (type) {
+		default:
+			utki::assert(false, SL);
+		case GL_UNSIGNED_BYTE:
+			// unsized internal format, as it always was
+			return format;
+		case GL_UNSIGNED_SHORT:
+			if (!supported_extensions.get(extension::ext_texture_norm16)) {
+				throw std::invalid_argument(
+					"opengl_texture::to_internal_format(): "
+					"16-bit textures are not supported by OpenGL implementation"
+				);
+			}
+			switch (format) {
+				default:
+					utki::assert(false, SL);
+				case GL_RED:
+					return GL_R16;
+				case GL_RG:
+					return GL_RG16;
+				case GL_RGB:
+					return GL_RGB16;
+				case GL_RGBA:
+					return GL_RGBA16;
+				case GL_LUMINANCE:
+					return GL_LUMINANCE16;
+				case GL_LUMINANCE_ALPHA:
+					return GL_LUMINANCE16_ALPHA16;
+			}
+		case GL_HALF_FLOAT:
+			// sized half float internal formats are defined by ARB_texture_float,
+			// ARB_half_float_pixel only adds the pixel transfer type
+			if (!supported_extensions.get(extension::arb_texture_float) ||
+				!supported_extensions.get(extension::arb_half_float_pixel))
+			{
+				throw std::invalid_argument(
+					"opengl_texture::to_internal_format(): "
+					"half float textures are not supported by OpenGL implementation"
+				);
+			}
+			switch (format) {
+				default:
+					utki::assert(false, SL);
+				case GL_RED:
+					return GL_R16F;
+				case GL_RG:
+					return GL_RG16F;
+				case GL_RGB:
+					return GL_RGB16F;
+				case GL_RGBA:
+					return GL_RGBA16F;
+				case GL_LUMINANCE:
+					return GL_LUMINANCE16F_ARB;
+				case GL_LUMINANCE_ALPHA:
+					return GL_LUMINANCE_ALPHA16F_ARB;
+			}
+		case GL_FLOAT:
+			if (!supported_extensions.get(extension::arb_texture_float)) {
+				throw std::invalid_argument(
+					"opengl_texture::to_internal_format(): "
+					"float textures are not supported by OpenGL implementation"
+				);
+			}
+			switch (format) {
+				default:
+					utki::assert(false, SL);
+				case GL_RED:
+					return GL_R32F;
+				case GL_RG:
+					return GL_RG32F;
+				case GL_RGB:
+					return GL_RGB32F;
+				case GL_RGBA:
+					return GL_RGBA32F;
+				case GL_LUMINANCE:
+					return GL_LUMINANCE32F_ARB;
+				case GL_LUMINANCE_ALPHA:
+					return GL_LUMINANCE_ALPHA32F_ARB;
+			}
+	}
+}
+
+GLenum opengl_texture::to_float_type(const utki::flags<extension>& supported_extensions)
+{
+	if (supported_extensions.get(extension::arb_texture_float)) {
+		return GL_FLOAT;
+	}
+	if (supported_extensions.get(extension::ext_texture_norm16)) {
+		return GL_UNSIGNED_SHORT;
+	}
+	return GL_UNSIGNED_BYTE;
+}
@@ -22,6 +22,7 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <GL/glew.h>
+#include <r4/rectangle.hpp>
 #include <rasterimage/image_variant.hpp>
 #include <utki/flags.hpp>
 
@@ -30,9 +31,38 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 namespace ruis::render::opengl {
 
 struct opengl_texture {
+	const utki::shared_ref<const context> opengl_context;
+
+	/**
+	 * @brief Texture target.
+	 * Either GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP.
+	 */
+	const GLenum target;
+
 	GLuint tex = 0;
 
-	opengl_texture();
+	/**
+	 * @brief Area of the texture object occupied by the texture image.
+	 * In OpenGL texture coordinates. For standalone textures it is the whole texture object,
+	 * for textures placed in a texture atlas it is the area within the atlas page.
+	 */
+	r4::rectangle<float> tex_rect = {
+		{0, 0},
+		{1, 1}
+	};
+
+private:
+	// false in case the texture object is owned by someone else, e.g. by a texture atlas
+	bool owns_texture = true;
+
+	// texture size accounted in the resource census
+	size_t census_size_bytes = 0;
+
+public:
+	opengl_texture(
+		const utki::shared_ref<const ruis::render::context>& rendering_context, //
+		GLenum target
+	);
 
 	opengl_texture(const opengl_texture&) = delete;
 	opengl_texture& operator=(const opengl_texture&) = delete;
@@ -42,15 +72,82 @@ struct opengl_texture {
 
 	~opengl_texture();
 
-	void bind(unsigned unit_num) const;
+	/**
+	 * @brief Bind texture to a texture unit.
+	 * The binding is skipped in case the texture is already bound to the texture unit.
+	 * In case the texture was evicted by the texture residency manager, its contents are uploaded back.
+	 * @param rendering_context - context within which the texture is bound.
+	 * @param unit_num - texture unit number.
+	 */
+	void bind(const context& rendering_context, unsigned unit_num) const;
+
+	/**
+	 * @brief Set up swizzling of the bound texture for the given image format.
+	 * @param target - texture target the texture is bound to.
+	 * @param f - image format.
+	 * @param supported_extensions - supported OpenGL extensions.
+	 * @return OpenGL format of the texel data to use for the texture.
+	 */
+	static GLint set_swizzeling(
+		GLenum target, //
+		rasterimage::format f,
+		const utki::flags<extension>& supported_extensions
+	);
+
+	/**
+	 * @brief Get OpenGL internal format for the texel data.
+	 * @param format - OpenGL format of the texel data, as returned by set_swizzeling().
+	 * @param type - OpenGL data type of the texel data components.
+	 * @param supported_extensions - supported OpenGL extensions.
+	 * @return For 8-bit components the format itself, sized internal format otherwise.
+	 * @throw std::invalid_argument - in case the data type is not supported by OpenGL implementation.
+	 */
+	static GLint to_internal_format(
+		GLint format, //
+		GLenum type,
+		const utki::flags<extension>& supported_extensions
+	);
+
+	/**
+	 * @brief Get OpenGL data type to upload float images as.
+	 * In case float textures are not supported, float images are converted
+	 * to 16-bit normalized or, if those are not supported either, to 8-bit components.
+	 * Half float textures are not an option then, as sized half float internal formats
+	 * come with the same ARB_texture_float extension.
+	 * @param supported_extensions - supported OpenGL extensions.
+	 * @return GL_FLOAT, GL_UNSIGNED_SHORT or GL_UNSIGNED_BYTE.
+	 */
+	static GLenum to_float_type(const utki::flags<extension>& supported_extensions);
 
 protected:
-	void set_active_texture(unsigned unit_num) const;
+	/**
+	 * @brief Create texture referring to a texture object owned by someone else.
+	 * The texture object is not deleted on destruction and is not counted in the resource census,
+	 * the owner of the texture object counts it.
+	 * @param rendering_context - rendering context.
+	 * @param target - texture target.
+	 * @param texture - texture object.
+	 */
+	opengl_texture(
+		const utki::shared_ref<const ruis::render::context>& rendering_context, //
+		GLenum target,
+		GLuint texture
+	);
 
 	GLint set_swizzeling(
 		rasterimage::format f, //
 		const utki::flags<extension>& supported_extensions
-	) const;
+	) const
+	{
+		return set_swizzeling(this->target, f, supported_extensions);
+	}
+
+	/**
+	 * @brief Set estimated texture size accounted in the resource census.
+	 * Only for textures owning their texture objects.
+	 * @param size_bytes - texture size in bytes, including mipmap levels.
+	 */
+	void set_census_size(size_t size_bytes) noexcept;
 };
 
 } // namespace ruis::render::opengl
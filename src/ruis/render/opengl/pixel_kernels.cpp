@@ -0,0 +1,511 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+#include "pixel_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include <utki/debug.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define RUIS_RENDER_OPENGL_SSE2
+#	include <emmintrin.h>
+#	if defined(__GNUC__) || defined(__clang__)
+// SSSE3 and F16C code is compiled with target attributes and selected at run time
+#		define RUIS_RENDER_OPENGL_X86_DISPATCH
+#		include <immintrin.h>
+#	endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#	define RUIS_RENDER_OPENGL_NEON
+#	include <arm_neon.h>
+#endif
+
+using namespace ruis::render::opengl;
+
+// NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic, cppcoreguidelines-pro-type-reinterpret-cast)
+
+namespace {
+constexpr size_t rgb_size = 3;
+constexpr size_t rgba_size = 4;
+constexpr uint8_t opaque = 0xff;
+
+#ifdef RUIS_RENDER_OPENGL_X86_DISPATCH
+bool has_ssse3()
+{
+	static const bool ret = __builtin_cpu_supports("ssse3");
+	return ret;
+}
+
+bool has_f16c()
+{
+	static const bool ret = __builtin_cpu_supports("f16c");
+	return ret;
+}
+#endif
+
+#ifdef DEBUG
+// In debug builds the vectorized kernels are checked against their scalar versions on every call.
+template <typename value_type>
+void assert_same_as_scalar(
+	const value_type* vectorized, //
+	const std::vector<value_type>& scalar
+)
+{
+	utki::assert(std::equal(scalar.begin(), scalar.end(), vectorized), SL);
+}
+#endif
+} // namespace
+
+void ruis::render::opengl::flip_rows(
+	utki::span<const uint8_t> src, //
+	size_t src_stride,
+	utki::span<uint8_t> dst,
+	size_t row_size,
+	size_t num_rows
+)
+{
+	if (num_rows == 0) {
+		return;
+	}
+
+	ASSERT(src_stride >= row_size)
+	ASSERT(src.size() >= (num_rows - 1) * src_stride + row_size)
+	ASSERT(dst.size() >= num_rows * row_size)
+
+	// rows are copied as a whole, memcpy is already vectorized by the standard library
+	const uint8_t* s = src.data() + (num_rows - 1) * src_stride;
+	uint8_t* d = dst.data();
+	for (size_t r = 0; r != num_rows; ++r) {
+		std::memcpy(d, s, row_size);
+		d += row_size;
+		s -= src_stride;
+	}
+}
+
+namespace {
+#ifdef RUIS_RENDER_OPENGL_X86_DISPATCH
+__attribute__((target("ssse3"))) size_t expand_rgb_to_rgba_ssse3(
+	const uint8_t* src, //
+	uint8_t* dst,
+	size_t num_pixels
+)
+{
+	// moves 4 pixels to 32-bit lanes, the alpha bytes are zeroed by the -1 indices
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+
+	// the last 4 pixels are loaded from the end of 48 bytes, so they are 4 bytes further in the register
+	const __m128i shuffle_last = _mm_setr_epi8(4, 5, 6, -1, 7, 8, 9, -1, 10, 11, 12, -1, 13, 14, 15, -1);
+
+	const __m128i alpha = _mm_set1_epi32(int32_t(0xff000000));
+
+	constexpr size_t step = 16;
+	size_t i = 0;
+	for (; i + step <= num_pixels; i += step) {
+		const uint8_t* s = src + i * rgb_size;
+		auto* d = reinterpret_cast<__m128i*>(dst + i * rgba_size);
+
+		__m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+		__m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 12));
+		__m128i v2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 24));
+		__m128i v3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 32));
+
+		_mm_storeu_si128(d, _mm_or_si128(_mm_shuffle_epi8(v0, shuffle), alpha));
+		_mm_storeu_si128(d + 1, _mm_or_si128(_mm_shuffle_epi8(v1, shuffle), alpha));
+		_mm_storeu_si128(d + 2, _mm_or_si128(_mm_shuffle_epi8(v2, shuffle), alpha));
+		_mm_storeu_si128(d + 3, _mm_or_si128(_mm_shuffle_epi8(v3, shuffle_last), alpha));
+	}
+	return i;
+}
+#endif
+
+#ifdef RUIS_RENDER_OPENGL_NEON
+size_t expand_rgb_to_rgba_neon(
+	const uint8_t* src, //
+	uint8_t* dst,
+	size_t num_pixels
+)
+{
+	constexpr size_t step = 16;
+	size_t i = 0;
+	for (; i + step <= num_pixels; i += step) {
+		uint8x16x3_t rgb = vld3q_u8(src + i * rgb_size);
+		uint8x16x4_t rgba;
+		rgba.val[0] = rgb.val[0];
+		rgba.val[1] = rgb.val[1];
+		rgba.val[2] = rgb.val[2];
+		rgba.val[3] = vdupq_n_u8(opaque);
+		vst4q_u8(dst + i * rgba_size, rgba);
+	}
+	return i;
+}
+#endif
+
+void expand_rgb_to_rgba_scalar(
+	const uint8_t* src, //
+	uint8_t* dst,
+	size_t begin,
+	size_t end
+)
+{
+	for (size_t i = begin; i != end; ++i) {
+		const uint8_t* s = src + i * rgb_size;
+		uint8_t* d = dst + i * rgba_size;
+		d[0] = s[0];
+		d[1] = s[1];
+		d[2] = s[2];
+		d[3] = opaque;
+	}
+}
+} // namespace
+
+void ruis::render::opengl::expand_rgb_to_rgba(
+	utki::span<const uint8_t> src, //
+	utki::span<uint8_t> dst
+)
+{
+	size_t num_pixels = src.size() / rgb_size;
+	ASSERT(dst.size() >= num_pixels * rgba_size)
+
+	size_t i = 0;
+
+#if defined(RUIS_RENDER_OPENGL_X86_DISPATCH)
+	if (has_ssse3()) {
+		i = expand_rgb_to_rgba_ssse3(src.data(), dst.data(), num_pixels);
+	}
+#elif defined(RUIS_RENDER_OPENGL_NEON)
+	i = expand_rgb_to_rgba_neon(src.data(), dst.data(), num_pixels);
+#endif
+
+#ifdef DEBUG
+	{
+		std::vector<uint8_t> expected(i * rgba_size);
+		expand_rgb_to_rgba_scalar(src.data(), expected.data(), 0, i);
+		assert_same_as_scalar(dst.data(), expected);
+	}
+#endif
+
+	expand_rgb_to_rgba_scalar(src.data(), dst.data(), i, num_pixels);
+}
+
+
+namespace {
+#ifdef RUIS_RENDER_OPENGL_SSE2
+// returns number of destination pixels made
+size_t downsample_row_rgba_sse2(
+	const uint8_t* row0, //
+	const uint8_t* row1,
+	size_t src_width,
+	uint8_t* dst
+)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i two = _mm_set1_epi16(2);
+
+	// 4 source pixels make 2 destination pixels
+	constexpr size_t step = 2;
+	size_t x = 0;
+	for (; (x + step) * 2 <= src_width; x += step) {
+		__m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 2 * rgba_size));
+		__m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 2 * rgba_size));
+
+		// vertical sums of pixels 0, 1 and 2, 3
+		__m128i s01 = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+		__m128i s23 = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+		// horizontal sums, pixel 0 + pixel 1 and pixel 2 + pixel 3
+		__m128i s = _mm_add_epi16(_mm_unpacklo_epi64(s01, s23), _mm_unpackhi_epi64(s01, s23));
+		s = _mm_srli_epi16(_mm_add_epi16(s, two), 2);
+
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * rgba_size), _mm_packus_epi16(s, s));
+	}
+	return x;
+}
+#endif
+
+#ifdef RUIS_RENDER_OPENGL_NEON
+// returns number of destination pixels made
+size_t downsample_row_rgba_neon(
+	const uint8_t* row0, //
+	const uint8_t* row1,
+	size_t src_width,
+	uint8_t* dst
+)
+{
+	// 16 source pixels make 8 destination pixels
+	constexpr size_t step = 8;
+	size_t x = 0;
+	for (; (x + step) * 2 <= src_width; x += step) {
+		uint8x16x4_t a = vld4q_u8(row0 + x * 2 * rgba_size);
+		uint8x16x4_t b = vld4q_u8(row1 + x * 2 * rgba_size);
+		uint8x8x4_t d;
+		for (unsigned c = 0; c != rgba_size; ++c) {
+			// pairwise add adjacent pixels of both rows
+			uint16x8_t s = vpadalq_u8(vpaddlq_u8(a.val[c]), b.val[c]);
+			d.val[c] = vrshrn_n_u16(s, 2);
+		}
+		vst4_u8(dst + x * rgba_size, d);
+	}
+	return x;
+}
+#endif
+
+void downsample_row_scalar(
+	const uint8_t* row0, //
+	const uint8_t* row1,
+	size_t src_width,
+	size_t num_channels,
+	uint8_t* dst,
+	size_t begin,
+	size_t end
+)
+{
+	for (size_t x = begin; x != end; ++x) {
+		size_t x0 = 2 * x;
+		size_t x1 = std::min(x0 + 1, src_width - 1);
+		for (size_t c = 0; c != num_channels; ++c) {
+			unsigned sum = unsigned(row0[x0 * num_channels + c]) + unsigned(row0[x1 * num_channels + c]) +
+				unsigned(row1[x0 * num_channels + c]) + unsigned(row1[x1 * num_channels + c]);
+			dst[x * num_channels + c] = uint8_t((sum + 2) >> 2);
+		}
+	}
+}
+
+void downsample_row(
+	const uint8_t* row0, //
+	const uint8_t* row1,
+	size_t src_width,
+	size_t num_channels,
+	uint8_t* dst,
+	size_t dst_width
+)
+{
+	size_t x = 0;
+
+	if (num_channels == rgba_size) {
+#if defined(RUIS_RENDER_OPENGL_SSE2)
+		x = downsample_row_rgba_sse2(row0, row1, src_width, dst);
+#elif defined(RUIS_RENDER_OPENGL_NEON)
+		x = downsample_row_rgba_neon(row0, row1, src_width, dst);
+#endif
+	}
+
+#ifdef DEBUG
+	{
+		std::vector<uint8_t> expected(x * num_channels);
+		downsample_row_scalar(row0, row1, src_width, num_channels, expected.data(), 0, x);
+		assert_same_as_scalar(dst, expected);
+	}
+#endif
+
+	downsample_row_scalar(row0, row1, src_width, num_channels, dst, x, dst_width);
+}
+} // namespace
+
+r4::vector2<uint32_t> ruis::render::opengl::downsample(
+	utki::span<const uint8_t> src, //
+	r4::vector2<uint32_t> src_dims,
+	size_t src_stride,
+	size_t num_channels,
+	std::vector<uint8_t>& dst
+)
+{
+	ASSERT(src_dims.x() != 0 && src_dims.y() != 0)
+	ASSERT(src_stride >= src_dims.x() * num_channels)
+	ASSERT(src.size() >= (src_dims.y() - 1) * src_stride + src_dims.x() * num_channels)
+
+	r4::vector2<uint32_t> dst_dims = {
+		std::max(src_dims.x() / 2, uint32_t(1)), //
+		std::max(src_dims.y() / 2, uint32_t(1))
+	};
+
+	size_t dst_stride = dst_dims.x() * num_channels;
+	dst.resize(dst_stride * dst_dims.y());
+
+	for (size_t y = 0; y != dst_dims.y(); ++y) {
+		size_t y0 = 2 * y;
+		size_t y1 = std::min(y0 + 1, size_t(src_dims.y() - 1));
+		downsample_row(
+			src.data() + y0 * src_stride, //
+			src.data() + y1 * src_stride,
+			src_dims.x(),
+			num_channels,
+			dst.data() + y * dst_stride,
+			dst_dims.x()
+		);
+	}
+
+	return dst_dims;
+}
+
+namespace {
+uint16_t float_to_half(float f)
+{
+	// NOLINTNEXTLINE(cppcoreguidelines-init-variables, "initialized by memcpy")
+	uint32_t x;
+	std::memcpy(&x, &f, sizeof(x));
+
+	auto sign = uint16_t((x >> 16) & 0x8000);
+	uint32_t abs = x & 0x7fffffff;
+
+	// NOLINTBEGIN(cppcoreguidelines-avoid-magic-numbers)
+
+	// infinity or NaN, keep NaN quiet
+	if (abs >= 0x7f800000) {
+		return uint16_t(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0));
+	}
+
+	// 65520 and above round to infinity
+	if (abs >= 0x477ff000) {
+		return uint16_t(sign | 0x7c00);
+	}
+
+	// below 2^-14, the smallest normal half float, the result is subnormal
+	if (abs < 0x38800000) {
+		// 2^-25 and below round to zero
+		if (abs <= 0x33000000) {
+			return sign;
+		}
+
+		uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+		uint32_t shift = 126 - (abs >> 23);
+		uint32_t h = mantissa >> shift;
+		uint32_t rem = mantissa & ((uint32_t(1) << shift) - 1);
+		uint32_t halfway = uint32_t(1) << (shift - 1);
+		if (rem > halfway || (rem == halfway && (h & 1))) {
+			++h;
+		}
+		return uint16_t(sign | h);
+	}
+
+	// rebias the exponent from 127 to 15, rounding can carry to the exponent which is fine
+	uint32_t h = (abs - 0x38000000) >> 13;
+	uint32_t rem = abs & 0x1fff;
+	if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) {
+		++h;
+	}
+	return uint16_t(sign | h);
+
+	// NOLINTEND(cppcoreguidelines-avoid-magic-numbers)
+}
+
+#ifdef RUIS_RENDER_OPENGL_X86_DISPATCH
+__attribute__((target("avx,f16c"))) size_t convert_float_to_half_f16c(
+	const float* src, //
+	uint16_t* dst,
+	size_t size
+)
+{
+	constexpr size_t step = 8;
+	size_t i = 0;
+	for (; i + step <= size; i += step) {
+		__m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), h);
+	}
+	return i;
+}
+#endif
+
+#if defined(RUIS_RENDER_OPENGL_NEON) && defined(__aarch64__)
+size_t convert_float_to_half_neon(
+	const float* src, //
+	uint16_t* dst,
+	size_t size
+)
+{
+	constexpr size_t step = 4;
+	size_t i = 0;
+	for (; i + step <= size; i += step) {
+		float16x4_t h = vcvt_f16_f32(vld1q_f32(src + i));
+		vst1_u16(dst + i, vreinterpret_u16_f16(h));
+	}
+	return i;
+}
+#endif
+} // namespace
+
+void ruis::render::opengl::convert_float_to_half(
+	utki::span<const float> src, //
+	utki::span<uint16_t> dst
+)
+{
+	ASSERT(src.size() == dst.size())
+
+	size_t i = 0;
+
+#if defined(RUIS_RENDER_OPENGL_X86_DISPATCH)
+	if (has_f16c()) {
+		i = convert_float_to_half_f16c(src.data(), dst.data(), src.size());
+	}
+#elif defined(RUIS_RENDER_OPENGL_NEON) && defined(__aarch64__)
+	i = convert_float_to_half_neon(src.data(), dst.data(), src.size());
+#endif
+
+#ifdef DEBUG
+	// NaN payloads are converted differently by the hardware, so NaNs are not checked
+	for (size_t j = 0; j != i; ++j) {
+		utki::assert(std::isnan(src[j]) || dst[j] == float_to_half(src[j]), SL);
+	}
+#endif
+
+	for (; i != src.size(); ++i) {
+		dst[i] = float_to_half(src[i]);
+	}
+}
+
+namespace {
+template <typename unorm_type>
+void convert_float_to_unorm(
+	utki::span<const float> src, //
+	utki::span<unorm_type> dst
+)
+{
+	ASSERT(src.size() == dst.size())
+
+	constexpr auto max = float(std::numeric_limits<unorm_type>::max());
+	constexpr auto half = 0.5f;
+
+	for (size_t i = 0; i != src.size(); ++i) {
+		// NaN becomes 0
+		auto v = src[i] > 0 ? std::min(src[i], 1.0f) : 0.0f;
+		dst[i] = unorm_type(v * max + half);
+	}
+}
+} // namespace
+
+void ruis::render::opengl::convert_float_to_unorm16(
+	utki::span<const float> src, //
+	utki::span<uint16_t> dst
+)
+{
+	convert_float_to_unorm(src, dst);
+}
+
+void ruis::render::opengl::convert_float_to_unorm8(
+	utki::span<const float> src, //
+	utki::span<uint8_t> dst
+)
+{
+	convert_float_to_unorm(src, dst);
+}
+
+// NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic, cppcoreguidelines-pro-type-reinterpret-cast)
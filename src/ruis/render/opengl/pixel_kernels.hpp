@@ -0,0 +1,120 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+#pragma once
+
+#include <vector>
+
+#include <r4/vector.hpp>
+#include <utki/span.hpp>
+
+namespace ruis::render::opengl {
+
+/*
+ * Pixel preparation kernels used before uploading pixels to textures.
+ * The kernels are vectorized with SSE2 (also SSSE3 and F16C detected at run time
+ * when compiling with GCC or Clang) on x86 and with NEON on ARM,
+ * with scalar fallback for other CPUs and for the remaining pixels.
+ * In debug builds the results of the vectorized code are checked against the scalar code.
+ * Unless stated otherwise, the pixels are 8 bits per component.
+ */
+
+/**
+ * @brief Copy rows in reverse order.
+ * @param src - source pixels.
+ * @param src_stride - distance between source rows in bytes.
+ * @param dst - destination pixels, rows are row_size bytes apart.
+ * @param row_size - size of a row in bytes.
+ * @param num_rows - number of rows.
+ */
+void flip_rows(
+	utki::span<const uint8_t> src, //
+	size_t src_stride,
+	utki::span<uint8_t> dst,
+	size_t row_size,
+	size_t num_rows
+);
+
+/**
+ * @brief Expand RGB pixels to RGBA with opaque alpha.
+ * @param src - source RGB pixels.
+ * @param dst - destination RGBA pixels, must be large enough to hold the source pixels.
+ */
+void expand_rgb_to_rgba(
+	utki::span<const uint8_t> src, //
+	utki::span<uint8_t> dst
+);
+
+/**
+ * @brief Downsample image twice in each dimension with 2x2 box filter.
+ * Makes next mipmap level of the image. For odd dimensions the last column or row is dropped.
+ * @param src - source pixels.
+ * @param src_dims - source image dimensions in pixels.
+ * @param src_stride - distance between source rows in bytes.
+ * @param num_channels - number of components per pixel.
+ * @param dst - destination pixels, resized to hold the downsampled image, rows are not padded.
+ * @return Dimensions of the downsampled image, not less than 1 pixel.
+ */
+r4::vector2<uint32_t> downsample(
+	utki::span<const uint8_t> src, //
+	r4::vector2<uint32_t> src_dims,
+	size_t src_stride,
+	size_t num_channels,
+	std::vector<uint8_t>& dst
+);
+
+/**
+ * @brief Convert 32-bit floats to 16-bit half floats.
+ * For OpenGL implementations which support half float textures, but not float ones.
+ * Values are rounded to nearest even, too large values become infinity.
+ * Uses F16C instructions on x86 when available and NEON on 64-bit ARM.
+ * @param src - source floats.
+ * @param dst - destination half floats, must be of the same size as the source.
+ */
+void convert_float_to_half(
+	utki::span<const float> src, //
+	utki::span<uint16_t> dst
+);
+
+/**
+ * @brief Convert 32-bit floats to 16-bit normalized unsigned integers.
+ * For OpenGL implementations which support neither float nor half float textures.
+ * Values are clamped to [0, 1] and rounded to nearest.
+ * @param src - source floats.
+ * @param dst - destination components, must be of the same size as the source.
+ */
+void convert_float_to_unorm16(
+	utki::span<const float> src, //
+	utki::span<uint16_t> dst
+);
+
+/**
+ * @brief Convert 32-bit floats to 8-bit normalized unsigned integers.
+ * For OpenGL implementations which support neither float nor 16-bit normalized textures.
+ * Values are clamped to [0, 1] and rounded to nearest.
+ * @param src - source floats.
+ * @param dst - destination components, must be of the same size as the source.
+ */
+void convert_float_to_unorm8(
+	utki::span<const float> src, //
+	utki::span<uint8_t> dst
+);
+
+} // namespace ruis::render::opengl
@@ -0,0 +1,244 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "program_binary_cache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include <utki/debug.hpp>
+
+using namespace ruis::render::opengl;
+
+namespace {
+constexpr const std::array<char, 4> file_magic = {'r', 'p', 'b', 'c'};
+constexpr const uint32_t file_version = 1;
+
+struct file_header {
+	std::array<char, 4> magic;
+	uint32_t version;
+	uint32_t format;
+	uint64_t compile_time_ns;
+	uint64_t size;
+};
+
+// 64-bit FNV-1a, the hash has to be the same from run to run, so std::hash cannot be used
+class fnv1a_hash
+{
+	constexpr static const uint64_t offset_basis = 14695981039346656037ULL;
+	constexpr static const uint64_t prime = 1099511628211ULL;
+
+	uint64_t value = offset_basis;
+
+public:
+	void update(std::string_view s) noexcept
+	{
+		for (auto c : s) {
+			this->value ^= uint64_t(uint8_t(c));
+			this->value *= prime;
+		}
+		// separate the strings, so that moving characters from one string to another changes the hash
+		constexpr uint64_t separator = 0xff;
+		this->value ^= separator;
+		this->value *= prime;
+	}
+
+	uint64_t get() const noexcept
+	{
+		return this->value;
+	}
+};
+} // namespace
+
+program_binary_cache::program_binary_cache(
+	bool supported, //
+	std::string gl_id
+) :
+	supported(supported),
+	gl_id(std::move(gl_id))
+{}
+
+void program_binary_cache::set_directory(std::string dir)
+{
+	if (!dir.empty()) {
+		std::error_code ec;
+		std::filesystem::create_directories(dir, ec);
+		if (ec) {
+			utki::log([&](auto& o) {
+				o << "program_binary_cache::set_directory(): could not create directory " << dir << ": "
+				  << ec.message() << std::endl;
+			});
+		}
+	}
+
+	std::lock_guard lock(this->mutex);
+	this->directory = std::move(dir);
+}
+
+bool program_binary_cache::is_enabled() const
+{
+	std::lock_guard lock(this->mutex);
+	return this->supported && !this->directory.empty();
+}
+
+program_binary_cache::statistics program_binary_cache::get_statistics() const
+{
+	std::lock_guard lock(this->mutex);
+	return this->stats;
+}
+
+uint64_t program_binary_cache::make_key(
+	std::string_view declarations, //
+	std::string_view vertex_shader_code,
+	std::string_view fragment_shader_code
+) const noexcept
+{
+	fnv1a_hash h;
+	h.update(this->gl_id);
+	h.update(declarations);
+	h.update(vertex_shader_code);
+	h.update(fragment_shader_code);
+	return h.get();
+}
+
+std::string program_binary_cache::make_path(uint64_t key) const
+{
+	std::stringstream ss;
+	ss << std::hex << std::setw(sizeof(key) * 2) << std::setfill('0') << key << ".bin";
+	return (std::filesystem::path(this->directory) / ss.str()).string();
+}
+
+std::optional<program_binary_cache::binary> program_binary_cache::load(uint64_t key) const
+{
+	std::string path;
+	{
+		std::lock_guard lock(this->mutex);
+		if (!this->supported || this->directory.empty()) {
+			return {};
+		}
+		path = this->make_path(key);
+	}
+
+	std::error_code ec;
+	auto file_size = std::filesystem::file_size(path, ec);
+	if (ec || file_size < sizeof(file_header)) {
+		return {};
+	}
+
+	std::ifstream f(path, std::ios::binary);
+	if (!f) {
+		return {};
+	}
+
+	file_header h{};
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "header is read as raw bytes")
+	f.read(reinterpret_cast<char*>(&h), sizeof(h));
+	if (!f || h.magic != file_magic || h.version != file_version) {
+		return {};
+	}
+
+	// do not trust the stored size, a truncated or corrupted file must not cause a huge allocation
+	if (h.size != file_size - sizeof(file_header)) {
+		return {};
+	}
+
+	binary ret{
+		.format = GLenum(h.format),
+		.data = std::vector<uint8_t>(size_t(h.size)),
+		.compile_time = std::chrono::nanoseconds(h.compile_time_ns)
+	};
+
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "binary is read as raw bytes")
+	f.read(reinterpret_cast<char*>(ret.data.data()), std::streamsize(ret.data.size()));
+	if (!f) {
+		return {};
+	}
+
+	return ret;
+}
+
+void program_binary_cache::store(uint64_t key, const binary& b)
+{
+	std::string path;
+	{
+		std::lock_guard lock(this->mutex);
+		if (!this->supported || this->directory.empty()) {
+			return;
+		}
+		path = this->make_path(key);
+	}
+
+	// write to a temporary file first, so that a partially written entry is never read
+	auto tmp_path = path + ".tmp";
+
+	{
+		std::ofstream f(tmp_path, std::ios::binary | std::ios::trunc);
+
+		file_header h{
+			.magic = file_magic,
+			.version = file_version,
+			.format = uint32_t(b.format),
+			.compile_time_ns = uint64_t(b.compile_time.count()),
+			.size = uint64_t(b.data.size())
+		};
+
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "header is written as raw bytes")
+		f.write(reinterpret_cast<const char*>(&h), sizeof(h));
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "binary is written as raw bytes")
+		f.write(reinterpret_cast<const char*>(b.data.data()), std::streamsize(b.data.size()));
+
+		if (!f) {
+			utki::log([&](auto& o) {
+				o << "program_binary_cache::store(): could not write " << tmp_path << std::endl;
+			});
+			return;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tmp_path, path, ec);
+	if (ec) {
+		utki::log([&](auto& o) {
+			o << "program_binary_cache::store(): could not rename " << tmp_path << ": " << ec.message() << std::endl;
+		});
+		std::filesystem::remove(tmp_path, ec);
+	}
+}
+
+void program_binary_cache::on_hit(std::chrono::nanoseconds time_saved)
+{
+	std::lock_guard lock(this->mutex);
+	++this->stats.num_hits;
+	this->stats.time_saved += std::max(time_saved, std::chrono::nanoseconds(0));
+}
+
+void program_binary_cache::on_miss(bool rejected)
+{
+	std::lock_guard lock(this->mutex);
+	++this->stats.num_misses;
+	if (rejected) {
+		++this->stats.num_rejected;
+	}
+}
@@ -0,0 +1,166 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <GL/glew.h>
+
+namespace ruis::render::opengl {
+
+/**
+ * @brief On-disk cache of linked shader program binaries.
+ * Program binaries are retrieved with glGetProgramBinary() after linking and are loaded
+ * with glProgramBinary() next time the same program is created, which saves compiling and linking.
+ * Entries are keyed by a hash of the shader sources and the OpenGL vendor, renderer, version
+ * and shading language version strings, the version string usually includes the driver build.
+ * Program binaries can be rejected by the driver anyway, e.g. after a driver update which did not
+ * change the version string, in that case the program is compiled from sources and the entry is overwritten.
+ * The cache is disabled until the cache directory is set.
+ * The cache is thread safe, because programs can be created on resource loader threads.
+ */
+class program_binary_cache
+{
+public:
+	struct statistics {
+		size_t num_hits = 0;
+		size_t num_misses = 0;
+
+		/**
+		 * @brief Number of cached binaries rejected by the driver.
+		 * Rejected binaries are also counted as misses.
+		 */
+		size_t num_rejected = 0;
+
+		/**
+		 * @brief Compile and link time saved by loading cached binaries.
+		 * The compile and link time is measured when the binary is stored to the cache.
+		 */
+		std::chrono::nanoseconds time_saved{0};
+	};
+
+	struct binary {
+		GLenum format;
+		std::vector<uint8_t> data;
+
+		/**
+		 * @brief Time it took to compile and link the program.
+		 */
+		std::chrono::nanoseconds compile_time;
+	};
+
+private:
+	const bool supported;
+
+	// vendor, renderer and version strings of the OpenGL implementation
+	const std::string gl_id;
+
+	mutable std::mutex mutex;
+
+	std::string directory;
+
+	statistics stats;
+
+public:
+	/**
+	 * @param supported - whether program binaries are supported by OpenGL implementation.
+	 * @param gl_id - string identifying the OpenGL implementation and its version.
+	 */
+	program_binary_cache(
+		bool supported, //
+		std::string gl_id
+	);
+
+	program_binary_cache(const program_binary_cache&) = delete;
+	program_binary_cache& operator=(const program_binary_cache&) = delete;
+
+	program_binary_cache(program_binary_cache&&) = delete;
+	program_binary_cache& operator=(program_binary_cache&&) = delete;
+
+	~program_binary_cache() = default;
+
+	/**
+	 * @brief Set directory to store the cache entries in.
+	 * The directory is created in case it does not exist.
+	 * @param dir - cache directory, empty string disables the cache.
+	 */
+	void set_directory(std::string dir);
+
+	/**
+	 * @brief Check if the cache is used.
+	 * @return true if program binaries are supported and the cache directory is set.
+	 */
+	bool is_enabled() const;
+
+	statistics get_statistics() const;
+
+	/**
+	 * @brief Calculate cache key of a program.
+	 * @param declarations - source code prepended to both shaders.
+	 * @param vertex_shader_code - vertex shader source.
+	 * @param fragment_shader_code - fragment shader source.
+	 * @return Cache key.
+	 */
+	uint64_t make_key(
+		std::string_view declarations, //
+		std::string_view vertex_shader_code,
+		std::string_view fragment_shader_code
+	) const noexcept;
+
+	/**
+	 * @brief Load program binary.
+	 * @param key - cache key of the program.
+	 * @return Program binary in case the entry exists and is readable.
+	 */
+	std::optional<binary> load(uint64_t key) const;
+
+	/**
+	 * @brief Store program binary.
+	 * Errors are logged and otherwise ignored, the cache is an optimization only.
+	 * @param key - cache key of the program.
+	 * @param b - program binary.
+	 */
+	void store(uint64_t key, const binary& b);
+
+	/**
+	 * @brief Report cache hit.
+	 * @param time_saved - compile and link time saved.
+	 */
+	void on_hit(std::chrono::nanoseconds time_saved);
+
+	/**
+	 * @brief Report cache miss.
+	 * @param rejected - whether the miss is because the driver rejected the cached binary.
+	 */
+	void on_miss(bool rejected);
+
+private:
+	std::string make_path(uint64_t key) const;
+};
+
+} // namespace ruis::render::opengl
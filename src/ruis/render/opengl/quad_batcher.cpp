@@ -0,0 +1,318 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "quad_batcher.hpp"
+
+#include <array>
+
+#include "texture_2d.hpp"
+#include "util.hpp"
+
+using namespace ruis::render::opengl;
+
+namespace {
+// quad corners in the order forming counter-clockwise triangles
+const std::array<r4::vector2<float>, 4> quad_corners = {
+	{{0, 0}, {0, 1}, {1, 1}, {1, 0}}
+};
+
+constexpr const std::array<uint16_t, 6> quad_indices = {0, 1, 2, 0, 2, 3};
+} // namespace
+
+quad_batcher::quad_batcher(
+	const utki::shared_ref<const ruis::render::context>& rendering_context,
+	size_t stream_buffer_size
+) :
+	opengl_context(context::to_opengl_context(rendering_context)),
+	instanced(this->opengl_context.get().is_instancing_supported()),
+	rgba_shader(rendering_context, texture_mode::rgba, this->instanced),
+	alpha_shader(rendering_context, texture_mode::alpha, this->instanced),
+	corner_buffer(rendering_context),
+	index_buffer(rendering_context),
+	stream(rendering_context, stream_buffer_size)
+{
+	auto& state = this->opengl_context.get().get_state_cache();
+
+	state.bind_default_element_array_buffer(this->index_buffer.get_buffer());
+
+	if (this->instanced) {
+		glBufferData(
+			GL_ELEMENT_ARRAY_BUFFER, //
+			GLsizeiptr(sizeof(quad_indices)),
+			quad_indices.data(),
+			GL_STATIC_DRAW
+		);
+		assert_opengl_no_error();
+		this->index_buffer.set_size_bytes(sizeof(quad_indices));
+
+		state.bind_buffer(GL_ARRAY_BUFFER, this->corner_buffer.get_buffer());
+		glBufferData(
+			GL_ARRAY_BUFFER, //
+			GLsizeiptr(sizeof(quad_corners)),
+			quad_corners.data(),
+			GL_STATIC_DRAW
+		);
+		assert_opengl_no_error();
+		this->corner_buffer.set_size_bytes(sizeof(quad_corners));
+	} else {
+		std::vector<uint16_t> indices;
+		indices.reserve(max_quads_per_draw * quad_indices.size());
+		for (size_t i = 0; i != max_quads_per_draw; ++i) {
+			for (auto index : quad_indices) {
+				indices.push_back(uint16_t(i * quad_corners.size() + index));
+			}
+		}
+
+		glBufferData(
+			GL_ELEMENT_ARRAY_BUFFER, //
+			GLsizeiptr(indices.size() * sizeof(indices.front())),
+			indices.data(),
+			GL_STATIC_DRAW
+		);
+		assert_opengl_no_error();
+		this->index_buffer.set_size_bytes(indices.size() * sizeof(indices.front()));
+	}
+}
+
+size_t quad_batcher::get_num_quads() const noexcept
+{
+	if (this->instanced) {
+		return this->instances.size();
+	}
+	return this->vertices.size() / quad_corners.size();
+}
+
+void quad_batcher::set_matrix(const r4::matrix4<float>& m)
+{
+	if (this->matrix == m) {
+		return;
+	}
+	this->flush();
+	this->matrix = m;
+}
+
+void quad_batcher::add(
+	const ruis::render::texture_2d& tex, //
+	const quad& q,
+	texture_mode tm
+)
+{
+	ASSERT(dynamic_cast<const texture_2d*>(&tex))
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+	const opengl_texture* t = &static_cast<const texture_2d&>(tex);
+
+	// textures placed in the same atlas page share the texture object, so those can be batched together
+	if (!this->texture || this->texture->tex != t->tex || this->mode != tm ||
+		this->get_num_quads() == max_quads_per_draw)
+	{
+		this->flush();
+		this->texture = t;
+		this->mode = tm;
+	}
+
+	// Map the quad texture rectangle to the area of the texture object occupied by the texture.
+	// Texture coordinates of the quad go from top to bottom while the texture rectangle goes
+	// from bottom to top, and the shader flips the vertical texture coordinate.
+	const auto& r = t->tex_rect;
+	r4::rectangle<float> tex_rect = {
+		{
+			r.p.x() + q.tex_rect.p.x() * r.d.x(), //
+			1 - r.p.y() - r.d.y() + q.tex_rect.p.y() * r.d.y()
+		},
+		{
+			q.tex_rect.d.x() * r.d.x(), //
+			q.tex_rect.d.y() * r.d.y()
+		}
+	};
+
+	if (this->instanced) {
+		this->instances.push_back({
+			.rect = {q.rect.p.x(), q.rect.p.y(), q.rect.d.x(), q.rect.d.y()},
+			.tex_rect = {tex_rect.p.x(), tex_rect.p.y(), tex_rect.d.x(), tex_rect.d.y()},
+			.color = q.color,
+			.transform = q.transform
+		});
+		return;
+	}
+
+	for (const auto& c : quad_corners) {
+		r4::vector4<float> p = {
+			q.rect.p.x() + c.x() * q.rect.d.x(), //
+			q.rect.p.y() + c.y() * q.rect.d.y(),
+			0,
+			1
+		};
+
+		this->vertices.push_back({
+			.pos = q.transform * p,
+			.tex_coord =
+				{
+					tex_rect.p.x() + c.x() * tex_rect.d.x(), //
+					tex_rect.p.y() + c.y() * tex_rect.d.y()
+				},
+			.color = q.color
+		});
+	}
+}
+
+void quad_batcher::set_up_attributes(
+	state_cache& state, //
+	size_t offset
+)
+{
+	constexpr auto vec2_size = sizeof(r4::vector2<float>);
+	constexpr auto vec4_size = sizeof(r4::vector4<float>);
+
+	state.bind_default_element_array_buffer(this->index_buffer.get_buffer());
+
+	if (this->instanced) {
+		state.bind_buffer(GL_ARRAY_BUFFER, this->corner_buffer.get_buffer());
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+		assert_opengl_no_error();
+
+		// attributes a1 to a7 are 4 component vectors following each other in the instance structure
+		constexpr auto num_instance_attribs = sizeof(instance) / vec4_size;
+		static_assert(num_instance_attribs == 7);
+
+		state.bind_buffer(GL_ARRAY_BUFFER, this->stream.get_buffer());
+		for (unsigned i = 0; i != num_instance_attribs; ++i) {
+			glVertexAttribPointer(
+				1 + i, //
+				4,
+				GL_FLOAT,
+				GL_FALSE,
+				GLsizei(sizeof(instance)),
+				// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, performance-no-int-to-ptr)
+				reinterpret_cast<const GLvoid*>(offset + i * vec4_size)
+			);
+			assert_opengl_no_error();
+		}
+
+		state.set_enabled_vertex_attribs(1 + num_instance_attribs);
+		state.set_instanced_vertex_attribs(((uint32_t(1) << num_instance_attribs) - 1) << 1);
+	} else {
+		state.bind_buffer(GL_ARRAY_BUFFER, this->stream.get_buffer());
+
+		static_assert(sizeof(vertex) == vec4_size + vec2_size + vec4_size);
+
+		glVertexAttribPointer(
+			0, //
+			4,
+			GL_FLOAT,
+			GL_FALSE,
+			GLsizei(sizeof(vertex)),
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, performance-no-int-to-ptr)
+			reinterpret_cast<const GLvoid*>(offset)
+		);
+		assert_opengl_no_error();
+		glVertexAttribPointer(
+			1, //
+			2,
+			GL_FLOAT,
+			GL_FALSE,
+			GLsizei(sizeof(vertex)),
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, performance-no-int-to-ptr)
+			reinterpret_cast<const GLvoid*>(offset + vec4_size)
+		);
+		assert_opengl_no_error();
+		glVertexAttribPointer(
+			2, //
+			4,
+			GL_FLOAT,
+			GL_FALSE,
+			GLsizei(sizeof(vertex)),
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, performance-no-int-to-ptr)
+			reinterpret_cast<const GLvoid*>(offset + vec4_size + vec2_size)
+		);
+		assert_opengl_no_error();
+
+		state.set_enabled_vertex_attribs(3);
+		state.set_instanced_vertex_attribs(0);
+	}
+}
+
+void quad_batcher::flush()
+{
+	auto num_quads = this->get_num_quads();
+	if (num_quads == 0) {
+		return;
+	}
+
+	const auto& ctx = this->opengl_context.get();
+
+	// the quads are drawn right away, so those cannot be recorded
+	utki::assert(!ctx.is_recording(), SL);
+
+	ASSERT(this->texture)
+
+	const auto& shader = this->mode == texture_mode::alpha ? this->alpha_shader : this->rgba_shader;
+	shader.set_up(this->matrix, *this->texture);
+
+	size_t offset = 0;
+	if (this->instanced) {
+		offset = this->stream.write(utki::make_span(
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "needed to upload raw data")
+			reinterpret_cast<const uint8_t*>(this->instances.data()),
+			this->instances.size() * sizeof(instance)
+		));
+	} else {
+		offset = this->stream.write(utki::make_span(
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "needed to upload raw data")
+			reinterpret_cast<const uint8_t*>(this->vertices.data()),
+			this->vertices.size() * sizeof(vertex)
+		));
+	}
+
+	auto& state = ctx.get_state_cache();
+	this->set_up_attributes(state, offset);
+
+	if (this->instanced) {
+		draw_elements_instanced(
+			GL_TRIANGLES, //
+			GLsizei(quad_indices.size()),
+			GL_UNSIGNED_SHORT,
+			nullptr,
+			GLsizei(num_quads)
+		);
+		state.get_statistics().add_draw(GL_TRIANGLES, quad_indices.size(), num_quads);
+	} else {
+		glDrawElements(
+			GL_TRIANGLES, //
+			GLsizei(num_quads * quad_indices.size()),
+			GL_UNSIGNED_SHORT,
+			nullptr
+		);
+		assert_opengl_no_error();
+		state.get_statistics().add_draw(GL_TRIANGLES, num_quads * quad_indices.size());
+	}
+
+	++this->stats.num_draws;
+	this->stats.num_quads += num_quads;
+
+	this->instances.clear();
+	this->vertices.clear();
+}
+
+void quad_batcher::end_frame()
+{
+	this->flush();
+	this->stream.end_frame();
+}
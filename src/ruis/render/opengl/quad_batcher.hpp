@@ -0,0 +1,229 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <vector>
+
+#include <r4/matrix.hpp>
+#include <r4/rectangle.hpp>
+#include <r4/vector.hpp>
+#include <ruis/render/texture_2d.hpp>
+
+#include "shaders/shader_quads.hpp"
+
+#include "context.hpp"
+#include "opengl_buffer.hpp"
+#include "stream_buffer.hpp"
+
+namespace ruis::render::opengl {
+
+/**
+ * @brief Batcher of textured quads.
+ * Accumulates quads and draws consecutive quads sharing same texture and texture mode
+ * with a single draw call. Per-quad parameters are written to a streaming ring buffer.
+ * In case instanced drawing is supported, one instance per quad is drawn with glDrawElementsInstanced().
+ * Otherwise, the quads are expanded to vertices on CPU side and drawn with glDrawElements().
+ *
+ * Quads are drawn in the order they were added, so the batcher can be used for drawing
+ * with blending enabled. The current OpenGL state of the context (framebuffer, viewport, blending, etc.)
+ * is used for drawing at the time of flush.
+ */
+class quad_batcher
+{
+public:
+	using texture_mode = shader_quads::texture_mode;
+
+	struct quad {
+		/**
+		 * @brief Quad rectangle.
+		 */
+		r4::rectangle<float> rect;
+
+		/**
+		 * @brief Texture coordinates rectangle.
+		 */
+		r4::rectangle<float> tex_rect = {
+			{0, 0},
+			{1, 1}
+		};
+
+		r4::vector4<float> color = {1, 1, 1, 1};
+
+		/**
+		 * @brief Quad transformation matrix.
+		 * Applied to quad rectangle vertices before the batch transformation matrix.
+		 */
+		r4::matrix4<float> transform = r4::matrix4<float>().set_identity();
+	};
+
+	struct statistics {
+		/**
+		 * @brief Number of quads drawn.
+		 */
+		size_t num_quads = 0;
+
+		/**
+		 * @brief Number of draw calls issued.
+		 */
+		size_t num_draws = 0;
+	};
+
+private:
+	const utki::shared_ref<const context> opengl_context;
+
+	const bool instanced;
+
+	shader_quads rgba_shader;
+	shader_quads alpha_shader;
+
+	// instanced: quad corners
+	opengl_buffer corner_buffer;
+
+	// instanced: indices of a single quad,
+	// non-instanced: indices of max_quads_per_draw quads
+	opengl_buffer index_buffer;
+
+	// per-instance data or expanded vertices
+	stream_buffer stream;
+
+	struct instance {
+		r4::vector4<float> rect;
+		r4::vector4<float> tex_rect;
+		r4::vector4<float> color;
+		r4::matrix4<float> transform;
+	};
+
+	struct vertex {
+		r4::vector4<float> pos;
+		r4::vector2<float> tex_coord;
+		r4::vector4<float> color;
+	};
+
+	std::vector<instance> instances;
+	std::vector<vertex> vertices;
+
+	r4::matrix4<float> matrix = r4::matrix4<float>().set_identity();
+
+	const opengl_texture* texture = nullptr;
+	texture_mode mode = texture_mode::rgba;
+
+	statistics stats;
+
+public:
+	/**
+	 * @brief Maximum number of quads drawn with a single draw call.
+	 * Quads are indexed with 16 bit indices in non-instanced mode.
+	 */
+	constexpr static const size_t max_quads_per_draw = 0x10000 / 4;
+
+	/**
+	 * @brief Default size of the streaming buffer in bytes.
+	 * Enough to hold several draws of max_quads_per_draw quads.
+	 */
+	constexpr static const size_t default_stream_buffer_size = size_t(8) * 1024 * 1024;
+
+	/**
+	 * @param rendering_context - rendering context.
+	 * @param stream_buffer_size - size of the streaming buffer in bytes.
+	 */
+	quad_batcher(
+		const utki::shared_ref<const ruis::render::context>& rendering_context,
+		size_t stream_buffer_size = default_stream_buffer_size
+	);
+
+	quad_batcher(const quad_batcher&) = delete;
+	quad_batcher& operator=(const quad_batcher&) = delete;
+
+	quad_batcher(quad_batcher&&) = delete;
+	quad_batcher& operator=(quad_batcher&&) = delete;
+
+	~quad_batcher() = default;
+
+	bool is_instanced() const noexcept
+	{
+		return this->instanced;
+	}
+
+	/**
+	 * @brief Set transformation matrix for the quads added next.
+	 * Flushes the accumulated quads in case the matrix differs from the current one.
+	 * @param m - transformation matrix.
+	 */
+	void set_matrix(const r4::matrix4<float>& m);
+
+	/**
+	 * @brief Add quad.
+	 * Flushes the accumulated quads in case the texture or texture mode differs
+	 * from the ones of the accumulated quads.
+	 * The texture must stay alive till the quad is flushed.
+	 * @param tex - texture to draw the quad with.
+	 * @param q - quad to add.
+	 * @param tm - texture mode.
+	 */
+	void add(
+		const ruis::render::texture_2d& tex, //
+		const quad& q,
+		texture_mode tm = texture_mode::rgba
+	);
+
+	/**
+	 * @brief Draw accumulated quads.
+	 * The context must not be in recording mode.
+	 */
+	void flush();
+
+	/**
+	 * @brief Get drawing statistics.
+	 * The returned object can be reset by assigning an empty value to it.
+	 * @return Drawing statistics.
+	 */
+	statistics& get_statistics() noexcept
+	{
+		return this->stats;
+	}
+
+	/**
+	 * @brief Notify about the end of a frame.
+	 * Flushes the accumulated quads and lets the streaming buffer place a fence
+	 * and collect per-frame statistics.
+	 */
+	void end_frame();
+
+	/**
+	 * @brief Get streaming buffer statistics of the last finished frame.
+	 * @return Streaming buffer statistics.
+	 */
+	const stream_buffer::statistics& get_stream_statistics() const noexcept
+	{
+		return this->stream.get_frame_statistics();
+	}
+
+private:
+	size_t get_num_quads() const noexcept;
+
+	void set_up_attributes(
+		state_cache& state, //
+		size_t offset
+	);
+};
+
+} // namespace ruis::render::opengl
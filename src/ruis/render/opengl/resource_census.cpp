@@ -0,0 +1,138 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "resource_census.hpp"
+
+#include <utki/debug.hpp>
+
+using namespace ruis::render::opengl;
+
+const char* ruis::render::opengl::to_string(resource_kind kind)
+{
+	switch (kind) {
+		case resource_kind::texture:
+			return "textures";
+		case resource_kind::buffer:
+			return "buffers";
+		case resource_kind::program:
+			return "programs";
+		case resource_kind::frame_buffer:
+			return "frame buffers";
+		case resource_kind::enum_size:
+			break;
+	}
+	utki::assert(false, SL);
+	return "";
+}
+
+size_t resource_census::snapshot::total_size_bytes() const noexcept
+{
+	size_t ret = 0;
+	for (const auto& c : this->resources) {
+		ret += c.size_bytes;
+	}
+	return ret;
+}
+
+resource_census::resource_census()
+{
+	this->last_report_snapshot = this->get_snapshot();
+}
+
+void resource_census::on_created(resource_kind kind, size_t size_bytes) noexcept
+{
+	auto& c = this->resources[size_t(kind)];
+	c.num_created.fetch_add(1, std::memory_order_relaxed);
+	c.size_bytes.fetch_add(size_bytes, std::memory_order_relaxed);
+}
+
+void resource_census::on_destroyed(resource_kind kind, size_t size_bytes) noexcept
+{
+	auto& c = this->resources[size_t(kind)];
+	c.num_destroyed.fetch_add(1, std::memory_order_relaxed);
+	c.size_bytes.fetch_sub(size_bytes, std::memory_order_relaxed);
+}
+
+void resource_census::on_resized(
+	resource_kind kind, //
+	size_t old_size_bytes,
+	size_t new_size_bytes
+) noexcept
+{
+	auto& c = this->resources[size_t(kind)];
+	c.size_bytes.fetch_add(new_size_bytes, std::memory_order_relaxed);
+	c.size_bytes.fetch_sub(old_size_bytes, std::memory_order_relaxed);
+}
+
+resource_census::snapshot resource_census::get_snapshot() const noexcept
+{
+	snapshot ret;
+	ret.time = std::chrono::steady_clock::now();
+
+	for (size_t i = 0; i != this->resources.size(); ++i) {
+		const auto& src = this->resources[i];
+		auto& dst = ret.resources[i];
+
+		// read number of destroyed resources first, so that number of alive resources never goes negative
+		dst.num_destroyed = src.num_destroyed.load(std::memory_order_relaxed);
+		dst.num_created = src.num_created.load(std::memory_order_relaxed);
+		dst.size_bytes = src.size_bytes.load(std::memory_order_relaxed);
+	}
+
+	return ret;
+}
+
+resource_census::rates resource_census::calc_rates(
+	const snapshot& prev, //
+	const snapshot& cur,
+	resource_kind kind
+) noexcept
+{
+	auto seconds = std::chrono::duration<float>(cur.time - prev.time).count();
+	if (seconds <= 0) {
+		return {};
+	}
+
+	return {
+		.created_per_second = float(cur[kind].num_created - prev[kind].num_created) / seconds,
+		.destroyed_per_second = float(cur[kind].num_destroyed - prev[kind].num_destroyed) / seconds
+	};
+}
+
+void resource_census::write_report(std::ostream& o)
+{
+	auto cur = this->get_snapshot();
+
+	constexpr auto bytes_per_kilobyte = 1024;
+
+	o << "OpenGL resources:" << '\n';
+	for (size_t i = 0; i != size_t(resource_kind::enum_size); ++i) {
+		auto kind = resource_kind(i);
+		const auto& c = cur[kind];
+		auto r = calc_rates(this->last_report_snapshot, cur, kind);
+
+		o << "  " << to_string(kind) << ": " << c.num_alive() << " alive, " << (c.size_bytes / bytes_per_kilobyte)
+		  << " KiB, " << r.created_per_second << " created/s, " << r.destroyed_per_second << " destroyed/s" << '\n';
+	}
+	o << "  total: " << (cur.total_size_bytes() / bytes_per_kilobyte) << " KiB" << std::endl;
+
+	this->last_report_snapshot = cur;
+}
@@ -0,0 +1,163 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+
+namespace ruis::render::opengl {
+
+enum class resource_kind {
+	texture,
+	buffer,
+	program,
+	frame_buffer,
+
+	enum_size
+};
+
+/**
+ * @brief Census of OpenGL resources.
+ * Live counters of OpenGL objects of the context, maintained where the objects are created and deleted.
+ * Shared objects are counted once with their whole storage, e.g. texture atlas pages and buffer arena pages,
+ * while textures placed in the atlas and buffers sub-allocated from the arena are not counted.
+ * Internal objects, like stream buffers and pixel buffer objects of the texture uploader, are counted as well.
+ * Textures evicted by the texture residency manager are counted with zero size.
+ * Sizes are estimates computed from dimensions, formats and number of mipmap levels of textures
+ * and sizes of buffers, the actual memory use depends on OpenGL implementation.
+ * The counters are updated atomically, because resources are also created on resource loader threads.
+ */
+class resource_census
+{
+public:
+	struct counters {
+		size_t num_created = 0;
+		size_t num_destroyed = 0;
+
+		/**
+		 * @brief Estimated size of alive resources in bytes.
+		 */
+		size_t size_bytes = 0;
+
+		size_t num_alive() const noexcept
+		{
+			return this->num_created - this->num_destroyed;
+		}
+	};
+
+	struct snapshot {
+		std::chrono::steady_clock::time_point time;
+		std::array<counters, size_t(resource_kind::enum_size)> resources;
+
+		const counters& operator[](resource_kind kind) const noexcept
+		{
+			return this->resources[size_t(kind)];
+		}
+
+		size_t total_size_bytes() const noexcept;
+	};
+
+	struct rates {
+		/**
+		 * @brief Resources created per second.
+		 */
+		float created_per_second = 0;
+
+		/**
+		 * @brief Resources destroyed per second.
+		 */
+		float destroyed_per_second = 0;
+	};
+
+private:
+	struct atomic_counters {
+		std::atomic<size_t> num_created = 0;
+		std::atomic<size_t> num_destroyed = 0;
+		std::atomic<size_t> size_bytes = 0;
+	};
+
+	std::array<atomic_counters, size_t(resource_kind::enum_size)> resources;
+
+	// snapshot taken by the last report, the rates in the next report are calculated against it
+	snapshot last_report_snapshot;
+
+public:
+	resource_census();
+
+	resource_census(const resource_census&) = delete;
+	resource_census& operator=(const resource_census&) = delete;
+
+	resource_census(resource_census&&) = delete;
+	resource_census& operator=(resource_census&&) = delete;
+
+	~resource_census() = default;
+
+	void on_created(resource_kind kind, size_t size_bytes = 0) noexcept;
+
+	void on_destroyed(resource_kind kind, size_t size_bytes = 0) noexcept;
+
+	/**
+	 * @brief Update size of alive resource.
+	 * @param kind - resource kind.
+	 * @param old_size_bytes - previously accounted size of the resource.
+	 * @param new_size_bytes - new size of the resource.
+	 */
+	void on_resized(
+		resource_kind kind, //
+		size_t old_size_bytes,
+		size_t new_size_bytes
+	) noexcept;
+
+	/**
+	 * @brief Get current values of the counters.
+	 * @return Snapshot of the counters.
+	 */
+	snapshot get_snapshot() const noexcept;
+
+	/**
+	 * @brief Calculate creation and destruction rates between two snapshots.
+	 * @param prev - earlier snapshot.
+	 * @param cur - later snapshot.
+	 * @param kind - resource kind.
+	 * @return Rates of the resource kind.
+	 */
+	static rates calc_rates(
+		const snapshot& prev, //
+		const snapshot& cur,
+		resource_kind kind
+	) noexcept;
+
+	/**
+	 * @brief Write human readable report.
+	 * Reports number of alive resources, their estimated sizes and creation and destruction
+	 * rates since the previous report, or since creation of the census for the first report.
+	 * @param o - stream to write the report to.
+	 */
+	void write_report(std::ostream& o);
+};
+
+const char* to_string(resource_kind kind);
+
+} // namespace ruis::render::opengl
@@ -0,0 +1,225 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+#include "resource_loader.hpp"
+
+#include "state_cache.hpp"
+#include "util.hpp"
+
+using namespace ruis::render::opengl;
+
+resource_loader::resource_loader(
+	utki::shared_ref<const context> rendering_context, //
+	std::function<void()> bind_shared_context,
+	std::function<void()> unbind_shared_context
+) :
+	opengl_context(std::move(rendering_context)),
+	bind_shared_context(std::move(bind_shared_context)),
+	unbind_shared_context(std::move(unbind_shared_context))
+{
+	utki::assert(this->bind_shared_context, SL);
+	utki::assert(this->unbind_shared_context, SL);
+
+	this->thread = std::thread([this]() {
+		this->thread_func();
+	});
+}
+
+resource_loader::~resource_loader()
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->quit = true;
+	}
+	this->cond_var.notify_one();
+
+	this->thread.join();
+
+	// the loader thread has finished, so all created resources are flushed to the GPU,
+	// hand those over regardless of the fences state
+	for (auto& r : this->created) {
+		if (r.sync) {
+			glDeleteSync(r.sync);
+			assert_opengl_no_error();
+		}
+		r.hand_over();
+	}
+}
+
+void resource_loader::push(task_type task)
+{
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+		this->tasks.push_back(std::move(task));
+	}
+	this->cond_var.notify_one();
+}
+
+void resource_loader::thread_func()
+{
+	const auto& ctx = this->opengl_context.get();
+
+	this->bind_shared_context();
+
+	// the shared context has its own OpenGL state, objects bound in the rendering context are not bound there
+	state_cache state(
+		ctx.supported_extensions.get(extension::arb_vertex_array_object), //
+		ctx.is_instancing_supported()
+	);
+	state.resync();
+
+	context::loader_thread.gl_state = &state;
+
+	const bool sync_supported = ctx.supported_extensions.get(extension::arb_sync);
+
+	for (;;) {
+		task_type task;
+		{
+			std::unique_lock<std::mutex> lock(this->mutex);
+			this->cond_var.wait(lock, [this]() {
+				return this->quit || !this->tasks.empty();
+			});
+			if (this->quit) {
+				break;
+			}
+			task = std::move(this->tasks.front());
+			this->tasks.pop_front();
+		}
+
+		auto hand_over = task(ctx);
+
+		GLsync sync = nullptr;
+		if (sync_supported) {
+			sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			assert_opengl_no_error();
+
+			// make sure the fence gets to the GPU, otherwise waiting for it in the rendering context may never end
+			glFlush();
+			assert_opengl_no_error();
+		} else {
+			// no fences, wait until the resource is completely created
+			glFinish();
+			assert_opengl_no_error();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(this->mutex);
+			this->created.push_back({
+				.sync = sync, //
+				.hand_over = std::move(hand_over)
+			});
+		}
+	}
+
+	context::loader_thread.gl_state = nullptr;
+
+	this->unbind_shared_context();
+}
+
+void resource_loader::end_frame()
+{
+	utki::assert(!this->opengl_context.get().is_loader_thread(), SL);
+
+	std::vector<created_resource> ready;
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		// fences are signalled in the order those were inserted, so stop at the first non-signalled one
+		auto i = this->created.begin();
+		for (; i != this->created.end(); ++i) {
+			if (!i->sync) {
+				continue;
+			}
+
+			auto res = glClientWaitSync(i->sync, 0, 0);
+			assert_opengl_no_error();
+			if (res == GL_TIMEOUT_EXPIRED) {
+				break;
+			}
+			utki::assert(res != GL_WAIT_FAILED, SL);
+
+			glDeleteSync(i->sync);
+			assert_opengl_no_error();
+			i->sync = nullptr;
+		}
+
+		ready.insert(
+			ready.end(), //
+			std::make_move_iterator(this->created.begin()),
+			std::make_move_iterator(i)
+		);
+		this->created.erase(this->created.begin(), i);
+	}
+
+	// hand over outside of the lock, because requester's code may be triggered by the futures
+	for (auto& r : ready) {
+		r.hand_over();
+	}
+}
+
+size_t resource_loader::get_num_pending()
+{
+	std::lock_guard<std::mutex> lock(this->mutex);
+	return this->tasks.size() + this->created.size();
+}
+
+std::future<utki::shared_ref<ruis::render::texture_2d>> resource_loader::load_texture_2d(
+	rasterimage::image_variant&& imvar, //
+	ruis::render::context::texture_2d_parameters params
+)
+{
+	return this->load([imvar = std::move(imvar), params](const context& ctx) {
+		return ctx.make_texture_2d(imvar, params);
+	});
+}
+
+std::future<utki::shared_ref<ruis::render::vertex_buffer>> resource_loader::load_vertex_buffer( //
+	std::vector<r4::vector4<float>> vertices
+)
+{
+	return this->load([vertices = std::move(vertices)](const context& ctx) {
+		return ctx.make_vertex_buffer(utki::make_span(vertices));
+	});
+}
+
+std::future<utki::shared_ref<ruis::render::vertex_buffer>> resource_loader::load_vertex_buffer( //
+	std::vector<r4::vector2<float>> vertices
+)
+{
+	return this->load([vertices = std::move(vertices)](const context& ctx) {
+		return ctx.make_vertex_buffer(utki::make_span(vertices));
+	});
+}
+
+std::future<utki::shared_ref<ruis::render::index_buffer>> resource_loader::load_index_buffer( //
+	std::vector<uint16_t> indices
+)
+{
+	return this->load([indices = std::move(indices)](const context& ctx) {
+		return ctx.make_index_buffer(utki::make_span(indices));
+	});
+}
+
+std::future<utki::shared_ref<ruis::render::context::shaders>> resource_loader::load_shaders()
+{
+	return this->load([](const context& ctx) {
+		return ctx.make_shaders();
+	});
+}
@@ -0,0 +1,176 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+#include <utki/shared_ref.hpp>
+
+#include "context.hpp"
+
+namespace ruis::render::opengl {
+
+/**
+ * @brief Creator of rendering resources on a background thread.
+ * The loader thread binds an OpenGL context sharing objects with the rendering context
+ * and runs resource creation requests there, so that loading assets does not stall rendering.
+ * After a resource is created, a fence is inserted on the loader thread. The resource is handed
+ * over to the requester only after the fence is signalled, i.e. once the resource is usable
+ * in the rendering context. Hand-over is done by end_frame() called on the rendering thread.
+ *
+ * Creating a shared OpenGL context is platform specific, so it is provided by the windowing layer
+ * via bind and unbind functions called on the loader thread.
+ *
+ * Resources created on the loader thread do not use buffer arenas, texture atlas and vertex array objects,
+ * because those are owned by the rendering context and are not shared between OpenGL contexts.
+ * Frame buffers cannot be created on the loader thread.
+ */
+class resource_loader
+{
+	const utki::shared_ref<const context> opengl_context;
+
+	const std::function<void()> bind_shared_context;
+	const std::function<void()> unbind_shared_context;
+
+	// runs on the loader thread, returns function handing the result over to the requester
+	using task_type = std::function<std::function<void()>(const context&)>;
+
+	struct created_resource {
+		// nullptr if sync objects are not supported
+		GLsync sync;
+		std::function<void()> hand_over;
+	};
+
+	std::mutex mutex;
+	std::condition_variable cond_var;
+	bool quit = false;
+
+	std::deque<task_type> tasks;
+	std::vector<created_resource> created;
+
+	std::thread thread;
+
+public:
+	/**
+	 * @param rendering_context - rendering context to create resources for.
+	 * @param bind_shared_context - function binding an OpenGL context sharing objects with the rendering context.
+	 *                              Called on the loader thread.
+	 * @param unbind_shared_context - function unbinding the shared OpenGL context. Called on the loader thread.
+	 */
+	resource_loader(
+		utki::shared_ref<const context> rendering_context, //
+		std::function<void()> bind_shared_context,
+		std::function<void()> unbind_shared_context
+	);
+
+	resource_loader(const resource_loader&) = delete;
+	resource_loader& operator=(const resource_loader&) = delete;
+
+	resource_loader(resource_loader&&) = delete;
+	resource_loader& operator=(resource_loader&&) = delete;
+
+	/**
+	 * @brief Stop the loader thread.
+	 * Must be called on the rendering thread. Not started requests are dropped,
+	 * their futures get std::future_error with broken_promise error code.
+	 */
+	~resource_loader();
+
+	/**
+	 * @brief Request resource creation.
+	 * Can be called from any thread.
+	 * @param create - function creating the resource with the given context.
+	 *                 Called on the loader thread.
+	 * @return Future which becomes ready on the rendering thread once the resource is usable there.
+	 *         In case the create function throws, the future holds the exception.
+	 */
+	template <typename function_type>
+	auto load(function_type create)
+	{
+		using result_type = decltype(create(std::declval<const context&>()));
+
+		auto promise = std::make_shared<std::promise<result_type>>();
+		auto future = promise->get_future();
+
+		this->push([create = std::move(create), promise](const context& ctx) -> std::function<void()> {
+			try {
+				// the result is not necessarily default constructible, so keep it in a shared_ptr
+				auto result = std::make_shared<result_type>(create(ctx));
+				return [promise, result]() {
+					promise->set_value(std::move(*result));
+				};
+			} catch (...) {
+				return [promise, e = std::current_exception()]() {
+					promise->set_exception(e);
+				};
+			}
+		});
+
+		return future;
+	}
+
+	std::future<utki::shared_ref<ruis::render::texture_2d>> load_texture_2d(
+		rasterimage::image_variant&& imvar, //
+		ruis::render::context::texture_2d_parameters params
+	);
+
+	std::future<utki::shared_ref<ruis::render::vertex_buffer>> load_vertex_buffer( //
+		std::vector<r4::vector4<float>> vertices
+	);
+
+	std::future<utki::shared_ref<ruis::render::vertex_buffer>> load_vertex_buffer( //
+		std::vector<r4::vector2<float>> vertices
+	);
+
+	std::future<utki::shared_ref<ruis::render::index_buffer>> load_index_buffer( //
+		std::vector<uint16_t> indices
+	);
+
+	std::future<utki::shared_ref<ruis::render::context::shaders>> load_shaders();
+
+	/**
+	 * @brief Hand over created resources.
+	 * Checks fences of the created resources and makes futures of the usable resources ready.
+	 * Must be called on the rendering thread, e.g. once per frame.
+	 */
+	void end_frame();
+
+	/**
+	 * @brief Get number of requests which are not handed over yet.
+	 * @return Number of pending requests.
+	 */
+	size_t get_num_pending();
+
+private:
+	void push(task_type task);
+
+	void thread_func();
+};
+
+} // namespace ruis::render::opengl
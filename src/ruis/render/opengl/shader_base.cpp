@@ -21,13 +21,20 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "shader_base.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <vector>
 
 #include <GL/glew.h>
 #include <utki/debug.hpp>
 #include <utki/string.hpp>
 
+#include "draw_recorder.hpp"
 #include "index_buffer.hpp"
+#include "opengl_texture.hpp"
+#include "program_binary_cache.hpp"
+#include "uniform_blocks.hpp"
 #include "util.hpp"
 #include "vertex_array.hpp"
 #include "vertex_buffer.hpp"
@@ -42,6 +49,18 @@ const std::array<GLenum, size_t(ruis::render::vertex_array::mode::enum_size)> sh
 };
 
 namespace {
+template <typename value_type>
+utki::span<const uint8_t> to_bytes(const value_type& v)
+{
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "needed to compare values bitwise")
+	return utki::make_span(reinterpret_cast<const uint8_t*>(&v), sizeof(v));
+}
+
+bool is_parallel_compile_supported(const context& c)
+{
+	return c.supported_extensions.get(ruis::render::opengl::extension::khr_parallel_shader_compile);
+}
+
 // return true if not compiled
 bool check_for_compile_errors(GLuint shader)
 {
@@ -98,7 +117,7 @@ bool check_for_link_errors(GLuint program)
 
 } // namespace
 
-shader_wrapper::shader_wrapper(const char* code, GLenum type) :
+shader_wrapper::shader_wrapper(const char* declarations, const char* code, GLenum type) :
 	s([&type]() {
 		auto s = glCreateShader(type);
 		if (s == 0) {
@@ -107,26 +126,163 @@ shader_wrapper::shader_wrapper(const char* code, GLenum type) :
 		return s;
 	}())
 {
-	const char* c = code;
+	std::array<const char*, 2> sources = {declarations, code};
 
-	glShaderSource(this->s, 1, &c, nullptr);
+	glShaderSource(this->s, GLsizei(sources.size()), sources.data(), nullptr);
 	glCompileShader(this->s);
+}
+
+void shader_wrapper::check_compile_status(const char* code) const
+{
 	if (check_for_compile_errors(this->s)) {
 		utki::log([&](auto& o) {
-			o << "Error while compiling:\n" << c << std::endl;
+			o << "Error while compiling:\n" << code << std::endl;
 		});
-		glDeleteShader(this->s);
 		throw std::logic_error("compiling shader failed");
 	}
 }
 
-program_wrapper::program_wrapper(const char* vertex_shader_code, const char* fragment_shader_code) :
-	vertex_shader(vertex_shader_code, GL_VERTEX_SHADER),
-	fragment_shader(fragment_shader_code, GL_FRAGMENT_SHADER),
+program_wrapper::program_wrapper(
+	const context& rendering_context, //
+	const char* vertex_shader_code,
+	const char* fragment_shader_code
+) :
+	rendering_context(rendering_context),
+	vertex_shader_code(vertex_shader_code),
+	fragment_shader_code(fragment_shader_code),
 	p(glCreateProgram())
 {
-	glAttachShader(this->p, vertex_shader.s);
-	glAttachShader(this->p, fragment_shader.s);
+	if (this->p == 0) {
+		throw std::runtime_error("glCreateProgram() failed");
+	}
+
+	try {
+		if (rendering_context.is_loader_thread()) {
+			// building resources in the background is the purpose of the loader thread
+			this->link();
+		} else if (is_parallel_compile_supported(rendering_context)) {
+			this->start_build();
+		}
+	} catch (...) {
+		glDeleteProgram(this->p);
+		throw;
+	}
+}
+
+bool program_wrapper::is_ready() const
+{
+	switch (this->state) {
+		case build_state::pending:
+			return false;
+		case build_state::linked:
+			return true;
+		case build_state::started:
+			break;
+	}
+
+	if (!is_parallel_compile_supported(this->rendering_context)) {
+		// completion status cannot be queried without blocking
+		return false;
+	}
+
+	GLint completed = GL_FALSE;
+	glGetProgramiv(this->p, GL_COMPLETION_STATUS_KHR, &completed);
+	assert_opengl_no_error();
+	return completed != GL_FALSE;
+}
+
+bool program_wrapper::link()
+{
+	if (this->state == build_state::linked) {
+		return false;
+	}
+
+	if (this->state == build_state::pending) {
+		this->start_build();
+	}
+
+	if (this->state == build_state::started) {
+		this->finish_build();
+	}
+
+	ASSERT(this->state == build_state::linked)
+
+	utki::log_debug([&](auto& o) {
+		o << "shader program " << this->p << " built: compile time = "
+		  << std::chrono::duration_cast<std::chrono::microseconds>(this->stats.compile_time).count()
+		  << " us, link time = "
+		  << std::chrono::duration_cast<std::chrono::microseconds>(this->stats.link_time).count() << " us"
+		  << (this->stats.from_binary ? ", from binary" : "") << std::endl;
+	});
+
+	return true;
+}
+
+void program_wrapper::start_build()
+{
+	ASSERT(this->state == build_state::pending)
+
+	const char* declarations = this->rendering_context.get_uniform_blocks().get_glsl_declarations();
+
+	auto& cache = this->rendering_context.get_program_binary_cache();
+
+	if (cache.is_enabled()) {
+		this->binary_cache_key = cache.make_key(
+			declarations, //
+			this->vertex_shader_code,
+			this->fragment_shader_code
+		);
+
+		bool rejected = false;
+		if (auto b = cache.load(this->binary_cache_key)) {
+			auto start = std::chrono::steady_clock::now();
+
+			glProgramBinary(this->p, b->format, b->data.data(), GLsizei(b->data.size()));
+
+			// Binary format not supported anymore, e.g. after driver update, results in GL_INVALID_ENUM error,
+			// which is expected, so clear it. Other reasons of rejection result in link failure.
+			glGetError();
+
+			GLint linked = GL_FALSE;
+			glGetProgramiv(this->p, GL_LINK_STATUS, &linked);
+
+			auto load_time = std::chrono::steady_clock::now() - start;
+
+			if (linked != GL_FALSE) {
+				cache.on_hit(b->compile_time - load_time);
+				this->stats.link_time = load_time;
+				this->stats.from_binary = true;
+				this->state = build_state::linked;
+				return;
+			}
+
+			rejected = true;
+
+			// start with a fresh program object, the rejected binary could leave it in an unknown state
+			glDeleteProgram(this->p);
+			this->p = glCreateProgram();
+			if (this->p == 0) {
+				throw std::runtime_error("glCreateProgram() failed");
+			}
+		}
+
+		cache.on_miss(rejected);
+
+		glProgramParameteri(this->p, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		assert_opengl_no_error();
+	}
+
+	auto start = std::chrono::steady_clock::now();
+
+	// the shaders are compiled in the background in case the OpenGL implementation supports it
+	this->vertex_shader.emplace(declarations, this->vertex_shader_code, GL_VERTEX_SHADER);
+	this->fragment_shader.emplace(declarations, this->fragment_shader_code, GL_FRAGMENT_SHADER);
+
+	auto compiled = std::chrono::steady_clock::now();
+	this->stats.compile_time += compiled - start;
+
+	glAttachShader(this->p, this->vertex_shader->s);
+	glAttachShader(this->p, this->fragment_shader->s);
 
 	// the variable is initialized via output argument, so no need to initialize
 	// it here
@@ -134,60 +290,353 @@ program_wrapper::program_wrapper(const char* vertex_shader_code, const char* fra
 	// NOLINTNEXTLINE(cppcoreguidelines-init-variables)
 	GLint max_num_attribs;
 	glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &max_num_attribs);
-	ASSERT(max_num_attribs >= 0)
 
-	for (GLuint i = 0; i < GLuint(max_num_attribs); ++i) {
-		std::stringstream ss;
-		ss << "a" << i;
-		//		TRACE(<< ss.str() << std::endl)
-		glBindAttribLocation(this->p, i, ss.str().c_str());
-		assert_opengl_no_error();
-	}
+	shader_reflection::bind_attribute_locations(this->p, max_num_attribs);
 
+	// in case some of the shaders fails to compile, the link fails as well,
+	// so the compile status is checked only after linking
 	glLinkProgram(this->p);
+
+	this->stats.link_time += std::chrono::steady_clock::now() - compiled;
+
+	this->state = build_state::started;
+}
+
+void program_wrapper::finish_build()
+{
+	ASSERT(this->state == build_state::started)
+	ASSERT(this->vertex_shader)
+	ASSERT(this->fragment_shader)
+
+	auto start = std::chrono::steady_clock::now();
+
+	this->vertex_shader->check_compile_status(this->vertex_shader_code);
+	this->fragment_shader->check_compile_status(this->fragment_shader_code);
+
+	auto compiled = std::chrono::steady_clock::now();
+	this->stats.compile_time += compiled - start;
+
 	if (check_for_link_errors(this->p)) {
 		LOG([&](auto& o) {
-			o << "Error while linking shader program" << vertex_shader_code << std::endl
-			  << fragment_shader_code << std::endl;
+			o << "Error while linking shader program" << this->vertex_shader_code << std::endl
+			  << this->fragment_shader_code << std::endl;
 		})
-		glDeleteProgram(this->p);
 		throw std::logic_error("linking shader program failed");
 	}
+
+	this->stats.link_time += std::chrono::steady_clock::now() - compiled;
+
+	this->state = build_state::linked;
+
+	// the linked program does not need the shader objects anymore
+	glDetachShader(this->p, this->vertex_shader->s);
+	glDetachShader(this->p, this->fragment_shader->s);
+	this->vertex_shader.reset();
+	this->fragment_shader.reset();
+
+	auto& cache = this->rendering_context.get_program_binary_cache();
+	if (!cache.is_enabled()) {
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(this->p, GL_PROGRAM_BINARY_LENGTH, &length);
+	assert_opengl_no_error();
+	if (length <= 0) {
+		return;
+	}
+
+	program_binary_cache::binary b{
+		.format = 0,
+		.data = std::vector<uint8_t>(size_t(length)),
+		.compile_time = this->stats.compile_time + this->stats.link_time
+	};
+	glGetProgramBinary(this->p, length, nullptr, &b.format, b.data.data());
+	assert_opengl_no_error();
+
+	cache.store(this->binary_cache_key, b);
 }
 
-shader_base::shader_base(const char* vertex_shader_code, const char* fragment_shader_code) :
-	program(vertex_shader_code, fragment_shader_code),
-	matrix_uniform(this->get_uniform("matrix"))
-{}
+shader_base::shader_base(
+	const utki::shared_ref<const ruis::render::context>& rendering_context,
+	const char* vertex_shader_code,
+	const char* fragment_shader_code
+) :
+	program(
+		context::to_opengl_context(rendering_context).get(), //
+		vertex_shader_code,
+		fragment_shader_code
+	),
+	matrix_uniform(this->get_uniform(uniform::matrix)),
+	opengl_context(context::to_opengl_context(rendering_context))
+{
+	// size of linked program is not known, so only the number of programs is accounted
+	this->opengl_context.get().get_resource_census().on_created(resource_kind::program);
+}
 
-GLint shader_base::get_uniform(const char* n)
+shader_base::~shader_base()
 {
-	GLint ret = glGetUniformLocation(this->program.p, n);
-	if (ret < 0) {
-		throw std::logic_error(utki::cat("no uniform found in the shader program: ", n));
+	this->opengl_context.get().get_resource_census().on_destroyed(resource_kind::program);
+	this->opengl_context.get().get_state_cache().on_program_deleted(this->program.p);
+}
+
+void shader_base::link() const
+{
+	ASSERT(!this->linked)
+
+	this->program.link();
+
+	const auto& blocks = this->opengl_context.get().get_uniform_blocks();
+
+	this->reflection.reflect(this->program.p, blocks.is_supported());
+
+	blocks.set_up_program(this->program.p, this->reflection);
+
+	for (size_t i = 0; i != size_t(uniform::enum_size); ++i) {
+		if ((this->required_uniforms & (uint32_t(1) << i)) == 0) {
+			continue;
+		}
+		if (!this->reflection.is_uniform_active(uniform(i))) {
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+			throw std::logic_error(utki::cat("no uniform found in the shader program: ", uniform_names[i]));
+		}
 	}
-	return ret;
+
+	this->linked = true;
+
+	this->opengl_context.get().get_state_cache().use_program(this->program.p);
+	this->set_initial_uniforms();
 }
 
-void shader_base::render(const r4::matrix4<float>& m, const ruis::render::vertex_array& va) const
+void shader_base::set_shared_uniforms() const
+{
+	const auto& ctx = this->opengl_context.get();
+	auto& blocks = ctx.get_uniform_blocks();
+
+	// per-pass data depends on the viewport, which is set before drawing
+	blocks.set_viewport_size(ctx.get_state_cache().get_viewport().d);
+
+	if (blocks.is_supported()) {
+		return;
+	}
+
+	// Uniform buffer objects are not supported, so upload the data as plain uniforms.
+	// The uniform cache skips the upload in case this program already has the same values.
+	if (this->reflection.is_uniform_active(uniform::frame_time)) {
+		const auto& v = blocks.get_frame_data().frame_time;
+		this->set_uniform4f(uniform::frame_time, v.x(), v.y(), v.z(), v.w());
+	}
+	if (this->reflection.is_uniform_active(uniform::pass_viewport)) {
+		const auto& v = blocks.get_pass_data().pass_viewport;
+		this->set_uniform4f(uniform::pass_viewport, v.x(), v.y(), v.z(), v.w());
+	}
+}
+
+bool shader_base::update_uniform_cache(uniform id, GLenum type, utki::span<const uint8_t> value) const
 {
 	ASSERT(this->is_bound())
+	ASSERT(this->reflection.get_type(id) == type)
+
+	auto& stats = this->opengl_context.get().get_uniform_upload_statistics();
+
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+	auto& e = this->uniform_cache[size_t(id)];
+
+	if (e.has_value) {
+		if (std::memcmp(e.value.data(), value.data(), value.size_bytes()) == 0) {
+			++stats.num_skipped;
+			return false;
+		}
+	}
+
+	ASSERT(value.size() <= e.value.size())
+	std::memcpy(e.value.data(), value.data(), value.size_bytes());
+	e.has_value = true;
+
+	++stats.num_issued;
+	++this->opengl_context.get().get_state_cache().get_statistics().num_uniform_uploads;
+	return true;
+}
+
+void shader_base::set_uniform_sampler(uniform id, GLint texture_unit_num) const
+{
+	if (!this->update_uniform_cache(id, GL_SAMPLER_2D, to_bytes(texture_unit_num))) {
+		return;
+	}
+	glUniform1i(this->reflection.get_location(id), texture_unit_num);
+	assert_opengl_no_error();
+}
+
+void shader_base::set_uniform_matrix3f(uniform id, const r4::matrix3<float>& m) const
+{
+	if (!this->update_uniform_cache(id, GL_FLOAT_MAT3, to_bytes(m))) {
+		return;
+	}
+	glUniformMatrix3fv(this->reflection.get_location(id), 1, GL_TRUE, m.front().data());
+	assert_opengl_no_error();
+}
+
+void shader_base::set_uniform_matrix4f(uniform id, const r4::matrix4<float>& m) const
+{
+	if (!this->update_uniform_cache(id, GL_FLOAT_MAT4, to_bytes(m))) {
+		return;
+	}
+	glUniformMatrix4fv(this->reflection.get_location(id), 1, GL_TRUE, m.front().data());
+	assert_opengl_no_error();
+}
+
+void shader_base::set_uniform2f(uniform id, float x, float y) const
+{
+	std::array<float, 2> v = {x, y};
+	if (!this->update_uniform_cache(id, GL_FLOAT_VEC2, to_bytes(v))) {
+		return;
+	}
+	glUniform2f(this->reflection.get_location(id), x, y);
+	assert_opengl_no_error();
+}
+
+void shader_base::set_uniform3f(uniform id, float x, float y, float z) const
+{
+	std::array<float, 3> v = {x, y, z};
+	if (!this->update_uniform_cache(id, GL_FLOAT_VEC3, to_bytes(v))) {
+		return;
+	}
+	glUniform3f(this->reflection.get_location(id), x, y, z);
+	assert_opengl_no_error();
+}
+
+void shader_base::set_uniform4f(uniform id, float x, float y, float z, float a) const
+{
+	std::array<float, 4> v = {x, y, z, a};
+	if (!this->update_uniform_cache(id, GL_FLOAT_VEC4, to_bytes(v))) {
+		return;
+	}
+	glUniform4f(this->reflection.get_location(id), x, y, z, a);
+	assert_opengl_no_error();
+}
+
+void shader_base::set_uniform_tex_rect(uniform id, const draw_parameters& params) const
+{
+	ASSERT(params.texture)
+	const auto& r = params.texture->tex_rect;
+	this->set_uniform4f(id, r.p.x(), r.p.y(), r.d.x(), r.d.y());
+}
+
+void shader_base::render(
+	const r4::matrix4<float>& m, //
+	const ruis::render::vertex_array& va,
+	const draw_parameters& params
+) const
+{
+	ASSERT(dynamic_cast<const vertex_array*>(&va))
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+	const auto& ogl_va = static_cast<const vertex_array&>(va);
+
+	const auto& ctx = this->opengl_context.get();
+	if (auto recorder = ctx.get_recorder()) {
+		recorder->record_draw(*this, m, ogl_va, params);
+		return;
+	}
+
+	this->draw(m, ogl_va, params);
+}
+
+void shader_base::set_up_draw(
+	const r4::matrix4<float>& m, //
+	const vertex_array& va,
+	const draw_parameters& params
+) const
+{
+	const auto& ctx = this->opengl_context.get();
+
+	if (params.texture) {
+		params.texture->bind(ctx, texture_unit_number);
+	}
+
+	this->bind();
+
+	this->set_parameters(params);
+
+	this->set_matrix(m);
+
+	va.bind(ctx);
+}
+
+void shader_base::draw_multi(
+	const r4::matrix4<float>& m, //
+	const vertex_array& va,
+	utki::span<const GLsizei> counts,
+	utki::span<const GLvoid* const> indices,
+	utki::span<const GLint> base_vertices,
+	const draw_parameters& params
+) const
+{
+	ASSERT(!va.is_instanced())
+
+	this->set_up_draw(m, va, params);
 
 	ASSERT(dynamic_cast<const index_buffer*>(&va.indices.get()))
 	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
 	const auto& ivbo = static_cast<const index_buffer&>(va.indices.get());
 
-	this->set_matrix(m);
+	auto gl_mode = mode_to_gl_mode(va.rendering_mode);
 
-	ASSERT(dynamic_cast<const vertex_array*>(&va))
+	multi_draw_elements(gl_mode, counts, ivbo.element_type, indices, base_vertices);
+
+	auto& stats = this->opengl_context.get().get_state_cache().get_statistics();
+
+	++stats.num_draws;
+	for (auto c : counts) {
+		stats.add_primitives(gl_mode, size_t(c));
+	}
+}
+
+void shader_base::draw(
+	const r4::matrix4<float>& m, //
+	const vertex_array& va,
+	const draw_parameters& params
+) const
+{
+	const auto& ctx = this->opengl_context.get();
+
+	this->set_up_draw(m, va, params);
+
+	ASSERT(dynamic_cast<const index_buffer*>(&va.indices.get()))
 	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
-	const auto& ogl_va = static_cast<const vertex_array&>(va);
+	const auto& ivbo = static_cast<const index_buffer&>(va.indices.get());
 
-	ogl_va.bind_buffers();
+	auto gl_mode = mode_to_gl_mode(va.rendering_mode);
 
-	//	TRACE(<< "ivbo.elementsCount = " << ivbo.elementsCount << "
-	// ivbo.elementType = " << ivbo.elementType << std::endl)
+	// index buffer can be sub-allocated from a buffer arena, then indices start at non-zero offset
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, performance-no-int-to-ptr)
+	auto indices = reinterpret_cast<const GLvoid*>(ivbo.get_offset());
 
-	glDrawElements(mode_to_gl_mode(va.rendering_mode), ivbo.elements_count, ivbo.element_type, nullptr);
-	assert_opengl_no_error();
+	auto& stats = ctx.get_state_cache().get_statistics();
+
+	if (!va.is_instanced()) {
+		glDrawElements(gl_mode, ivbo.elements_count, ivbo.element_type, indices);
+		assert_opengl_no_error();
+		stats.add_draw(gl_mode, size_t(ivbo.elements_count));
+		return;
+	}
+
+	if (ctx.is_instancing_supported()) {
+		draw_elements_instanced(
+			gl_mode, //
+			ivbo.elements_count,
+			ivbo.element_type,
+			indices,
+			GLsizei(va.get_num_instances())
+		);
+		stats.add_draw(gl_mode, size_t(ivbo.elements_count), va.get_num_instances());
+		return;
+	}
+
+	// instanced drawing is not supported, draw instances one by one
+	for (size_t i = 0; i != va.get_num_instances(); ++i) {
+		va.set_instance_attributes(i);
+		glDrawElements(gl_mode, ivbo.elements_count, ivbo.element_type, indices);
+		assert_opengl_no_error();
+		stats.add_draw(gl_mode, size_t(ivbo.elements_count));
+	}
 }
@@ -21,21 +21,37 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <optional>
 #include <vector>
 
 #include <GL/glew.h>
 #include <r4/matrix.hpp>
+#include <r4/vector.hpp>
 #include <ruis/render/vertex_array.hpp>
 #include <utki/config.hpp>
 #include <utki/debug.hpp>
+#include <utki/span.hpp>
 
+#include "context.hpp"
+#include "shader_reflection.hpp"
 #include "util.hpp"
 
 namespace ruis::render::opengl {
 
 struct shader_wrapper {
 	GLuint s;
-	shader_wrapper(const char* code, GLenum type);
+
+	/**
+	 * @brief Create shader object and start compiling it.
+	 * The compile status is not checked, call check_compile_status() for that.
+	 * This allows the OpenGL implementation to compile the shader in the background.
+	 * @param declarations - source code to prepend to the shader source.
+	 * @param code - shader source.
+	 * @param type - shader type.
+	 */
+	shader_wrapper(const char* declarations, const char* code, GLenum type);
 
 	shader_wrapper(const shader_wrapper&) = delete;
 	shader_wrapper& operator=(const shader_wrapper&) = delete;
@@ -47,14 +63,87 @@ struct shader_wrapper {
 	{
 		glDeleteShader(this->s);
 	}
+
+	/**
+	 * @brief Wait for the shader compilation to finish and check its status.
+	 * @param code - shader source, for logging in case of compile errors.
+	 * @throw std::logic_error - in case the shader failed to compile.
+	 */
+	void check_compile_status(const char* code) const;
 };
 
-struct program_wrapper {
-	shader_wrapper vertex_shader;
-	shader_wrapper fragment_shader;
+/**
+ * @brief Shader program.
+ * Building the program is split in two steps. First, the shaders are compiled and the program is linked
+ * without checking the results, so that the OpenGL implementation can do it in the background, e.g. with
+ * GL_KHR_parallel_shader_compile. Second, on first use of the program, the results are checked, which blocks
+ * until the build is finished.
+ *
+ * In case the OpenGL implementation does not compile shaders in parallel, starting the build would block
+ * anyway, so the first step is also postponed till the first use of the program. This way,
+ * programs which are never used are never built.
+ */
+class program_wrapper
+{
+public:
+	/**
+	 * @brief Time spent on building the program.
+	 * The times are measured on the calling thread, i.e. with parallel shader compilation
+	 * those include only the time the calling thread was blocked by the build.
+	 */
+	struct build_statistics {
+		std::chrono::nanoseconds compile_time{0};
+		std::chrono::nanoseconds link_time{0};
+
+		/**
+		 * @brief Whether the program was loaded from the program binary cache.
+		 * In this case the compile time is zero and the link time is the time of loading the binary.
+		 */
+		bool from_binary = false;
+	};
+
+private:
+	const context& rendering_context;
+
+	// sources are used when the build is started, as well as for logging build errors,
+	// the shader sources are string literals, so the pointers stay valid
+	const char* const vertex_shader_code;
+	const char* const fragment_shader_code;
+
+	enum class build_state {
+		pending,
+		started,
+		linked
+	};
+
+	build_state state = build_state::pending;
+
+	// the shaders are kept until the build results are checked
+	std::optional<shader_wrapper> vertex_shader;
+	std::optional<shader_wrapper> fragment_shader;
+
+	uint64_t binary_cache_key = 0;
+
+	build_statistics stats;
+
+public:
 	GLuint p;
 
-	program_wrapper(const char* vertex_shader_code, const char* fragment_shader_code);
+	/**
+	 * @brief Create shader program.
+	 * In case the program binary cache of the context is enabled and has the program binary,
+	 * the program is loaded from the binary. Otherwise the program is compiled and linked
+	 * from the sources and its binary is stored to the cache.
+	 * In case the program is created on the resource loader thread, it is built right away.
+	 * @param rendering_context - rendering context to create the program in.
+	 * @param vertex_shader_code - vertex shader source.
+	 * @param fragment_shader_code - fragment shader source.
+	 */
+	program_wrapper(
+		const context& rendering_context, //
+		const char* vertex_shader_code,
+		const char* fragment_shader_code
+	);
 
 	program_wrapper(const program_wrapper&) = delete;
 	program_wrapper& operator=(const program_wrapper&) = delete;
@@ -66,16 +155,95 @@ struct program_wrapper {
 	{
 		glDeleteProgram(this->p);
 	}
+
+	/**
+	 * @brief Check if the program is linked and ready for use.
+	 * Does not block.
+	 * @return true if link() will not block.
+	 */
+	bool is_ready() const;
+
+	/**
+	 * @brief Finish building the program.
+	 * Blocks until the program is linked. Does nothing if the program is already linked.
+	 * @return true if the program has just been linked by this call.
+	 * @throw std::logic_error - in case the program failed to build.
+	 */
+	bool link();
+
+	bool is_linked() const noexcept
+	{
+		return this->state == build_state::linked;
+	}
+
+	const build_statistics& get_build_statistics() const noexcept
+	{
+		return this->stats;
+	}
+
+private:
+	void start_build();
+	void finish_build();
+};
+
+struct opengl_texture;
+
+/**
+ * @brief Per-draw shader parameters.
+ * Not all the parameters are used by every shader.
+ */
+struct draw_parameters {
+	const opengl_texture* texture = nullptr;
+	r4::vector4<float> color = {1, 1, 1, 1};
 };
 
 class shader_base
 {
-	program_wrapper program;
+	friend class draw_recorder;
+
+	mutable program_wrapper program;
+
+	shader_reflection reflection;
+
+	// bit N is set if the uniform with key N is used by the shader
+	uint32_t required_uniforms = 0;
+	static_assert(size_t(uniform::enum_size) <= sizeof(required_uniforms) * 8);
+
+	// Last uploaded uniform values.
+	// Uniform values are a part of the program object state, so the values stay valid
+	// until they are changed. This allows skipping uploading the same values over again.
+	struct uniform_cache_entry {
+		bool has_value = false;
+		std::array<uint8_t, sizeof(r4::matrix4<float>)> value;
+	};
+
+	mutable std::array<uniform_cache_entry, size_t(uniform::enum_size)> uniform_cache;
+
+	const uniform matrix_uniform;
+
+	// Returns true if the uniform value differs from the last uploaded one
+	// and thus has to be uploaded.
+	bool update_uniform_cache(uniform id, GLenum type, utki::span<const uint8_t> value) const;
 
-	const GLint matrix_uniform;
+	// Whether the program is introspected and initial uniform values are set.
+	// The program can be linked before that, e.g. when loaded on the resource loader thread.
+	mutable bool linked = false;
+
+	// Finish building the program, if not yet, and introspect it.
+	void link() const;
+
+	// Update the data shared by all the shaders, see uniform_blocks.
+	void set_shared_uniforms() const;
+
+protected:
+	const utki::shared_ref<const context> opengl_context;
 
 public:
-	shader_base(const char* vertex_shader_code, const char* fragment_shader_code);
+	shader_base(
+		const utki::shared_ref<const ruis::render::context>& rendering_context,
+		const char* vertex_shader_code,
+		const char* fragment_shader_code
+	);
 
 	shader_base(const shader_base&) = delete;
 	shader_base& operator=(const shader_base&) = delete;
@@ -83,61 +251,74 @@ public:
 	shader_base(shader_base&&) = delete;
 	shader_base& operator=(shader_base&&) = delete;
 
-	virtual ~shader_base() = default;
-
-protected:
-	GLint get_uniform(const char* n);
+	virtual ~shader_base();
 
-	void bind() const
+	GLuint get_program_object() const noexcept
 	{
-		glUseProgram(this->program.p);
-		assert_opengl_no_error();
+		return this->program.p;
 	}
 
-	bool is_bound() const noexcept
+	/**
+	 * @brief Get time spent on building the shader program.
+	 * @return build statistics of the shader program.
+	 */
+	const program_wrapper::build_statistics& get_build_statistics() const noexcept
 	{
-		GLint prog = 0;
-		glGetIntegerv(GL_CURRENT_PROGRAM, &prog);
-
-		ASSERT(prog >= 0)
-		return GLuint(prog) == this->program.p;
+		return this->program.get_build_statistics();
 	}
 
-	void set_uniform_sampler(GLint id, GLint texture_unit_num) const
+protected:
+	// texture unit used for the texture of draw_parameters
+	constexpr static const unsigned texture_unit_number = 0;
+
+	/**
+	 * @brief Declare that the shader uses the uniform.
+	 * The uniform is checked to be active in the program when the program is linked,
+	 * which happens on first use of the shader. In case there is no such active uniform in the program,
+	 * the std::logic_error is thrown at that moment.
+	 * @param u - uniform key.
+	 * @return the uniform key to be passed to set_uniform*() methods.
+	 */
+	uniform get_uniform(uniform u)
 	{
-		glUniform1i(id, texture_unit_num);
-		assert_opengl_no_error();
+		this->required_uniforms |= uint32_t(1) << unsigned(u);
+		return u;
 	}
 
-	void set_uniform_matrix3f(GLint id, const r4::matrix3<float>& m) const
+	void bind() const
 	{
-		glUniformMatrix3fv(id, 1, GL_TRUE, m.front().data());
-		assert_opengl_no_error();
+		if (!this->linked) {
+			this->link();
+		}
+		this->opengl_context.get().get_state_cache().use_program(this->program.p);
+		this->set_shared_uniforms();
 	}
 
-	void set_uniform_matrix4f(GLint id, const r4::matrix4<float>& m) const
+	bool is_bound() const noexcept
 	{
-		glUniformMatrix4fv(id, 1, GL_TRUE, m.front().data());
-		assert_opengl_no_error();
+		return this->opengl_context.get().get_state_cache().get_program() == this->program.p;
 	}
 
-	void set_uniform2f(GLint id, float x, float y) const
-	{
-		glUniform2f(id, x, y);
-		assert_opengl_no_error();
-	}
+	void set_uniform_sampler(uniform id, GLint texture_unit_num) const;
 
-	void set_uniform3f(GLint id, float x, float y, float z) const
-	{
-		glUniform3f(id, x, y, z);
-		assert_opengl_no_error();
-	}
+	void set_uniform_matrix3f(uniform id, const r4::matrix3<float>& m) const;
 
-	void set_uniform4f(GLint id, float x, float y, float z, float a) const
-	{
-		glUniform4f(id, x, y, z, a);
-		assert_opengl_no_error();
-	}
+	void set_uniform_matrix4f(uniform id, const r4::matrix4<float>& m) const;
+
+	void set_uniform2f(uniform id, float x, float y) const;
+
+	void set_uniform3f(uniform id, float x, float y, float z) const;
+
+	void set_uniform4f(uniform id, float x, float y, float z, float a) const;
+
+	/**
+	 * @brief Upload texture rectangle of the draw texture.
+	 * Texturing shaders map texture coordinates to the texture rectangle, so that textures
+	 * placed in a texture atlas are sampled from their area of the atlas page.
+	 * @param id - vec4 tex_rect uniform.
+	 * @param params - draw parameters with non-null texture.
+	 */
+	void set_uniform_tex_rect(uniform id, const draw_parameters& params) const;
 
 	void set_matrix(const r4::matrix4<float>& m) const
 	{
@@ -152,7 +333,58 @@ protected:
 		return mode_map[unsigned(mode)];
 	}
 
-	void render(const r4::matrix4<float>& m, const ruis::render::vertex_array& va) const;
+	/**
+	 * @brief Render vertex array.
+	 * In case the context is in recording mode, the draw is recorded to be executed later.
+	 * Otherwise the draw is executed right away.
+	 * @param m - transformation matrix.
+	 * @param va - vertex array to render.
+	 * @param params - shader parameters.
+	 */
+	void render(
+		const r4::matrix4<float>& m, //
+		const ruis::render::vertex_array& va,
+		const draw_parameters& params = {}
+	) const;
+
+	/**
+	 * @brief Upload shader specific parameters.
+	 * Called with the shader program bound.
+	 * @param params - shader parameters.
+	 */
+	virtual void set_parameters(const draw_parameters& params) const {}
+
+	/**
+	 * @brief Set initial uniform values.
+	 * Called once, right after the shader program is linked, with the program bound.
+	 * Intended for uniforms which never change, e.g. texture unit numbers of samplers.
+	 */
+	virtual void set_initial_uniforms() const {}
+
+private:
+	void set_up_draw(
+		const r4::matrix4<float>& m, //
+		const vertex_array& va,
+		const draw_parameters& params
+	) const;
+
+	void draw(
+		const r4::matrix4<float>& m, //
+		const vertex_array& va,
+		const draw_parameters& params
+	) const;
+
+	// Draw several index ranges with vertex attribute setup of the given vertex array
+	// by a single draw call, see vertex_array::get_base_vertex().
+	// The base_vertices is empty in case all the base vertices are zero.
+	void draw_multi(
+		const r4::matrix4<float>& m, //
+		const vertex_array& va,
+		utki::span<const GLsizei> counts,
+		utki::span<const GLvoid* const> indices,
+		utki::span<const GLint> base_vertices,
+		const draw_parameters& params
+	) const;
 };
 
 } // namespace ruis::render::opengl
@@ -0,0 +1,142 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "shader_reflection.hpp"
+
+#include <algorithm>
+
+#include "util.hpp"
+
+using namespace ruis::render::opengl;
+
+namespace {
+// names longer than that are truncated, those do not match any of the known names anyway
+constexpr const size_t max_name_length = 64;
+
+std::string_view trim_array_suffix(std::string_view name)
+{
+	// uniform arrays are reported with [0] suffix
+	constexpr std::string_view array_suffix = "[0]";
+	if (name.size() >= array_suffix.size() && name.substr(name.size() - array_suffix.size()) == array_suffix) {
+		name.remove_suffix(array_suffix.size());
+	}
+	return name;
+}
+} // namespace
+
+void shader_reflection::bind_attribute_locations(GLuint program, GLint max_num_attribs)
+{
+	ASSERT(max_num_attribs >= 0)
+
+	auto num_attribs = std::min(unsigned(max_num_attribs), max_vertex_attributes);
+
+	for (GLuint i = 0; i != num_attribs; ++i) {
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+		glBindAttribLocation(program, i, attribute_names[i]);
+		assert_opengl_no_error();
+	}
+}
+
+void shader_reflection::reflect(GLuint program, bool uniform_blocks_supported)
+{
+	this->active_attributes = 0;
+	this->uniforms = {};
+	this->blocks.fill(GL_INVALID_INDEX);
+
+	std::array<char, max_name_length> name{};
+
+	GLint num_attribs = 0;
+	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &num_attribs);
+	assert_opengl_no_error();
+
+	for (GLuint i = 0; i < GLuint(num_attribs); ++i) {
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = GL_NONE;
+		glGetActiveAttrib(program, i, GLsizei(name.size()), &length, &size, &type, name.data());
+		assert_opengl_no_error();
+
+		std::string_view n(name.data(), size_t(length));
+
+		auto j = std::find_if(
+			attribute_names.begin(), //
+			attribute_names.end(),
+			[&n](const char* a) {
+				return n == a;
+			}
+		);
+		if (j == attribute_names.end()) {
+			// built-in attribute, e.g. gl_VertexID
+			continue;
+		}
+
+		this->active_attributes |= uint32_t(1) << std::distance(attribute_names.begin(), j);
+	}
+
+	GLint num_uniforms = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &num_uniforms);
+	assert_opengl_no_error();
+
+	for (GLuint i = 0; i < GLuint(num_uniforms); ++i) {
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = GL_NONE;
+		glGetActiveUniform(program, i, GLsizei(name.size()), &length, &size, &type, name.data());
+		assert_opengl_no_error();
+
+		auto n = trim_array_suffix(std::string_view(name.data(), size_t(length)));
+
+		auto j = std::find(uniform_names.begin(), uniform_names.end(), n);
+		if (j == uniform_names.end()) {
+			continue;
+		}
+
+		// index of the active uniform is not its location, so query the location,
+		// the name is null-terminated by glGetActiveUniform()
+		auto& u = this->uniforms[size_t(std::distance(uniform_names.begin(), j))];
+		u.location = glGetUniformLocation(program, name.data());
+		u.type = type;
+	}
+	if (!uniform_blocks_supported) {
+		return;
+	}
+
+	GLint num_blocks = 0;
+	glGetProgramiv(program, GL_ACTIVE_UNIFORM_BLOCKS, &num_blocks);
+	assert_opengl_no_error();
+
+	for (GLuint i = 0; i < GLuint(num_blocks); ++i) {
+		GLsizei length = 0;
+		glGetActiveUniformBlockName(program, i, GLsizei(name.size()), &length, name.data());
+		assert_opengl_no_error();
+
+		auto j = std::find(
+			uniform_block_names.begin(), //
+			uniform_block_names.end(),
+			std::string_view(name.data(), size_t(length))
+		);
+		if (j == uniform_block_names.end()) {
+			continue;
+		}
+
+		this->blocks[size_t(std::distance(uniform_block_names.begin(), j))] = i;
+	}
+}
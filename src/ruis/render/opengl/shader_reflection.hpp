@@ -0,0 +1,206 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+#include <GL/glew.h>
+
+namespace ruis::render::opengl {
+
+/**
+ * @brief Uniforms known to the shader programs.
+ * Uniforms are referred to by these compile-time keys instead of names.
+ * To use a new uniform in a shader, add its key here and its name to the uniform_names table.
+ */
+enum class uniform {
+	matrix,
+	texture0,
+	tex_rect,
+	uniform_color,
+
+	// fallback for the uniform blocks, see uniform_blocks
+	frame_time,
+	pass_viewport,
+
+	enum_size
+};
+
+/**
+ * @brief Names of the uniforms as declared in the shader sources.
+ * Indexed by uniform key.
+ */
+constexpr std::array<std::string_view, size_t(uniform::enum_size)> uniform_names = {
+	"matrix", // matrix
+	"texture0", // texture0
+	"tex_rect", // tex_rect
+	"uniform_color", // uniform_color
+	"frame_time", // frame_time
+	"pass_viewport" // pass_viewport
+};
+
+/**
+ * @brief Uniform blocks shared by all the shader programs.
+ * See uniform_blocks.
+ */
+enum class uniform_block {
+	per_frame,
+	per_pass,
+
+	enum_size
+};
+
+/**
+ * @brief Names of the uniform blocks as declared in the shader sources.
+ * Indexed by uniform block key.
+ */
+constexpr std::array<std::string_view, size_t(uniform_block::enum_size)> uniform_block_names = {
+	"per_frame", // per_frame
+	"per_pass" // per_pass
+};
+
+/**
+ * @brief Maximum number of vertex attributes.
+ * Vertex attributes are named a0, a1, ..., and the attribute aN is bound to location N.
+ * It is the minimum value of GL_MAX_VERTEX_ATTRIBS guaranteed by desktop OpenGL and OpenGL ES 3.
+ */
+constexpr const unsigned max_vertex_attributes = 16;
+
+/**
+ * @brief Names of the vertex attributes.
+ * Indexed by attribute location.
+ */
+constexpr std::array<const char*, max_vertex_attributes> attribute_names = {
+	"a0",
+	"a1",
+	"a2",
+	"a3",
+	"a4",
+	"a5",
+	"a6",
+	"a7",
+	"a8",
+	"a9",
+	"a10",
+	"a11",
+	"a12",
+	"a13",
+	"a14",
+	"a15" //
+};
+
+/**
+ * @brief Active attributes and uniforms of a linked shader program.
+ * The program is introspected once after linking into a fixed size table,
+ * so looking up uniform locations does not involve any string operations or memory allocations.
+ */
+class shader_reflection
+{
+	// bit N is set if the attribute aN is active
+	uint32_t active_attributes = 0;
+
+	struct uniform_info {
+		GLint location = -1;
+		GLenum type = GL_NONE;
+	};
+
+	std::array<uniform_info, size_t(uniform::enum_size)> uniforms;
+
+	std::array<GLuint, size_t(uniform_block::enum_size)> blocks = []() {
+		std::array<GLuint, size_t(uniform_block::enum_size)> ret{};
+		ret.fill(GL_INVALID_INDEX);
+		return ret;
+	}();
+
+public:
+	/**
+	 * @brief Bind vertex attribute names to locations.
+	 * Must be called before linking the program.
+	 * @param program - program object.
+	 * @param max_num_attribs - value of GL_MAX_VERTEX_ATTRIBS.
+	 */
+	static void bind_attribute_locations(GLuint program, GLint max_num_attribs);
+
+	/**
+	 * @brief Introspect linked program.
+	 * Unknown attributes, uniforms and uniform blocks, i.e. those which are not in the attribute_names,
+	 * uniform_names and uniform_block_names tables, are ignored.
+	 * @param program - linked program object.
+	 * @param uniform_blocks_supported - whether uniform buffer objects are supported by OpenGL implementation.
+	 */
+	void reflect(GLuint program, bool uniform_blocks_supported);
+
+	bool is_attribute_active(unsigned location) const noexcept
+	{
+		return location < max_vertex_attributes && (this->active_attributes & (uint32_t(1) << location)) != 0;
+	}
+
+	uint32_t get_active_attributes() const noexcept
+	{
+		return this->active_attributes;
+	}
+
+	bool is_uniform_active(uniform u) const noexcept
+	{
+		return this->get_location(u) >= 0;
+	}
+
+	/**
+	 * @brief Get uniform location.
+	 * @param u - uniform key.
+	 * @return uniform location.
+	 * @return -1 in case the uniform is not active in the program.
+	 */
+	GLint get_location(uniform u) const noexcept
+	{
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+		return this->uniforms[size_t(u)].location;
+	}
+
+	/**
+	 * @brief Get uniform type.
+	 * @param u - uniform key.
+	 * @return uniform type, e.g. GL_FLOAT_MAT4.
+	 * @return GL_NONE in case the uniform is not active in the program.
+	 */
+	GLenum get_type(uniform u) const noexcept
+	{
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+		return this->uniforms[size_t(u)].type;
+	}
+
+	/**
+	 * @brief Get uniform block index.
+	 * @param b - uniform block key.
+	 * @return uniform block index.
+	 * @return GL_INVALID_INDEX in case the uniform block is not active in the program.
+	 */
+	GLuint get_block_index(uniform_block b) const noexcept
+	{
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+		return this->blocks[size_t(b)];
+	}
+};
+
+} // namespace ruis::render::opengl
@@ -24,8 +24,9 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 using namespace ruis::render::opengl;
 
 shader_color::shader_color(utki::shared_ref<const ruis::render::context> rendering_context) :
-	ruis::render::coloring_shader(std::move(rendering_context)),
+	ruis::render::coloring_shader(rendering_context),
 	shader_base(
+		rendering_context,
 		R"qwertyuiop(
 			attribute vec4 a0;
 
@@ -43,7 +44,7 @@ shader_color::shader_color(utki::shared_ref<const ruis::render::context> renderi
 			}
 		)qwertyuiop"
 	),
-	color_uniform(this->get_uniform("uniform_color"))
+	color_uniform(this->get_uniform(uniform::uniform_color))
 {}
 
 void shader_color::render(
@@ -52,15 +53,20 @@ void shader_color::render(
 	const r4::vector4<float>& color
 ) const
 {
-	this->bind();
+	this->shader_base::render(
+		m, //
+		va,
+		{.color = color}
+	);
+}
 
+void shader_color::set_parameters(const draw_parameters& params) const
+{
 	this->set_uniform4f(
 		this->color_uniform, //
-		color.x(),
-		color.y(),
-		color.z(),
-		color.w()
+		params.color.x(),
+		params.color.y(),
+		params.color.z(),
+		params.color.w()
 	);
-
-	this->shader_base::render(m, va);
 }
@@ -31,7 +31,7 @@ class shader_color :
 	public ruis::render::coloring_shader, //
 	public shader_base
 {
-	GLint color_uniform;
+	uniform color_uniform;
 
 public:
 	shader_color(utki::shared_ref<const ruis::render::context> rendering_context);
@@ -49,6 +49,9 @@ public:
 		const ruis::render::vertex_array& va,
 		const r4::vector4<float>& color
 	) const override;
+
+protected:
+	void set_parameters(const draw_parameters& params) const override;
 };
 
 } // namespace ruis::render::opengl
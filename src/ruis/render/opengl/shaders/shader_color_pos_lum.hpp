@@ -31,7 +31,7 @@ class shader_color_pos_lum :
 	public ruis::render::coloring_shader, //
 	private ruis::render::opengl::shader_base
 {
-	GLint color_uniform;
+	uniform color_uniform;
 
 public:
 	shader_color_pos_lum(utki::shared_ref<const ruis::render::context> rendering_context);
@@ -51,6 +51,9 @@ public:
 		const ruis::render::vertex_array& va,
 		const r4::vector4<float>& color
 	) const override;
+
+protected:
+	void set_parameters(const draw_parameters& params) const override;
 };
 
 } // namespace ruis::render::opengl
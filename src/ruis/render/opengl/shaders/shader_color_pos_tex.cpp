@@ -26,8 +26,9 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 using namespace ruis::render::opengl;
 
 shader_color_pos_tex::shader_color_pos_tex(utki::shared_ref<const ruis::render::context> rendering_context) :
-	ruis::render::coloring_texturing_shader(std::move(rendering_context)),
+	ruis::render::coloring_texturing_shader(rendering_context),
 	shader_base(
+		rendering_context,
 		R"qwertyuiop(
 			attribute vec4 a0;
 
@@ -35,11 +36,14 @@ shader_color_pos_tex::shader_color_pos_tex(utki::shared_ref<const ruis::render::
 
 			uniform mat4 matrix;
 
+			// area of the texture object occupied by the texture image
+			uniform vec4 tex_rect;
+
 			varying vec2 tc0;
 
 			void main(void){
 				gl_Position = matrix * a0;
-				tc0 = vec2(a1.x, 1.0 - a1.y);
+				tc0 = tex_rect.xy + vec2(a1.x, 1.0 - a1.y) * tex_rect.zw;
 			}
 		)qwertyuiop",
 		R"qwertyuiop(		
@@ -54,8 +58,9 @@ shader_color_pos_tex::shader_color_pos_tex(utki::shared_ref<const ruis::render::
 			}
 		)qwertyuiop"
 	),
-	texture_uniform(this->get_uniform("texture0")),
-	color_uniform(this->get_uniform("uniform_color"))
+	texture_uniform(this->get_uniform(uniform::texture0)),
+	tex_rect_uniform(this->get_uniform(uniform::tex_rect)),
+	color_uniform(this->get_uniform(uniform::uniform_color))
 {}
 
 void shader_color_pos_tex::render(
@@ -65,25 +70,36 @@ void shader_color_pos_tex::render(
 	const ruis::render::texture_2d& tex
 ) const
 {
-	constexpr auto texture_unit_number = 0;
-
 	ASSERT(dynamic_cast<const texture_2d*>(&tex))
-	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
-	static_cast<const texture_2d&>(tex).bind(texture_unit_number);
-	this->bind();
-
-	this->set_uniform_sampler(
-		this->texture_uniform, //
-		texture_unit_number
+	this->shader_base::render(
+		m, //
+		va,
+		{
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+			.texture = &static_cast<const texture_2d&>(tex),
+			.color = color
+		}
 	);
+}
+
+void shader_color_pos_tex::set_parameters(const draw_parameters& params) const
+{
+	this->set_uniform_tex_rect(this->tex_rect_uniform, params);
 
 	this->set_uniform4f(
 		this->color_uniform, //
-		color.x(),
-		color.y(),
-		color.z(),
-		color.w()
+		params.color.x(),
+		params.color.y(),
+		params.color.z(),
+		params.color.w()
 	);
+}
 
-	this->shader_base::render(m, va);
+void shader_color_pos_tex::set_initial_uniforms() const
+{
+	// the texture unit used for the sampler never changes, so set it only once
+	this->set_uniform_sampler(
+		this->texture_uniform, //
+		texture_unit_number
+	);
 }
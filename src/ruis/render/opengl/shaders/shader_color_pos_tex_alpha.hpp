@@ -31,8 +31,9 @@ class shader_color_pos_tex_alpha :
 	public ruis::render::coloring_texturing_shader, //
 	public shader_base
 {
-	GLint texture_uniform;
-	GLint color_uniform;
+	uniform texture_uniform;
+	uniform tex_rect_uniform;
+	uniform color_uniform;
 
 public:
 	shader_color_pos_tex_alpha(utki::shared_ref<const ruis::render::context> rendering_context);
@@ -51,6 +52,11 @@ public:
 		const r4::vector4<float>& color,
 		const ruis::render::texture_2d& tex
 	) const override;
+
+protected:
+	void set_parameters(const draw_parameters& params) const override;
+
+	void set_initial_uniforms() const override;
 };
 
 } // namespace ruis::render::opengl
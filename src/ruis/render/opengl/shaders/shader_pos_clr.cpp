@@ -24,8 +24,9 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 using namespace ruis::render::opengl;
 
 shader_pos_clr::shader_pos_clr(utki::shared_ref<const ruis::render::context> rendering_context) :
-	ruis::render::shader(std::move(rendering_context)),
+	ruis::render::shader(rendering_context),
 	shader_base(
+		rendering_context,
 		R"qwertyuiop(
 			uniform mat4 matrix;
 
@@ -51,7 +52,5 @@ shader_pos_clr::shader_pos_clr(utki::shared_ref<const ruis::render::context> ren
 
 void shader_pos_clr::render(const r4::matrix4<float>& m, const ruis::render::vertex_array& va) const
 {
-	this->bind();
-
 	this->shader_base::render(m, va);
 }
@@ -31,7 +31,8 @@ class shader_pos_tex :
 	public ruis::render::texturing_shader, //
 	public shader_base
 {
-	GLint texture_uniform;
+	uniform texture_uniform;
+	uniform tex_rect_uniform;
 
 public:
 	shader_pos_tex(utki::shared_ref<const ruis::render::context> rendering_context);
@@ -49,6 +50,11 @@ public:
 		const ruis::render::vertex_array& va,
 		const ruis::render::texture_2d& tex
 	) const override;
+
+protected:
+	void set_parameters(const draw_parameters& params) const override;
+
+	void set_initial_uniforms() const override;
 };
 
 } // namespace ruis::render::opengl
@@ -0,0 +1,147 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "shader_quads.hpp"
+
+using namespace ruis::render::opengl;
+
+namespace {
+const char* get_vertex_shader_code(bool instanced)
+{
+	if (instanced) {
+		return R"qwertyuiop(
+			attribute vec2 a0; // quad corner
+
+			attribute vec4 a1; // quad rectangle
+
+			attribute vec4 a2; // texture coordinates rectangle
+
+			attribute vec4 a3; // color
+
+			// quad transformation matrix rows
+			attribute vec4 a4;
+			attribute vec4 a5;
+			attribute vec4 a6;
+			attribute vec4 a7;
+
+			uniform mat4 matrix;
+
+			varying vec2 tc0;
+
+			varying vec4 clr;
+
+			void main(void){
+				vec4 p = vec4(a1.xy + a0 * a1.zw, 0.0, 1.0);
+				gl_Position = matrix * vec4(dot(a4, p), dot(a5, p), dot(a6, p), dot(a7, p));
+
+				vec2 tc = a2.xy + a0 * a2.zw;
+				tc0 = vec2(tc.x, 1.0 - tc.y);
+
+				clr = a3;
+			}
+		)qwertyuiop";
+	}
+
+	return R"qwertyuiop(
+		attribute vec4 a0; // position
+
+		attribute vec2 a1; // texture coordinates
+
+		attribute vec4 a2; // color
+
+		uniform mat4 matrix;
+
+		varying vec2 tc0;
+
+		varying vec4 clr;
+
+		void main(void){
+			gl_Position = matrix * a0;
+			tc0 = vec2(a1.x, 1.0 - a1.y);
+			clr = a2;
+		}
+	)qwertyuiop";
+}
+
+const char* get_fragment_shader_code(shader_quads::texture_mode mode)
+{
+	switch (mode) {
+		case shader_quads::texture_mode::alpha:
+			return R"qwertyuiop(
+				uniform sampler2D texture0;
+
+				varying vec2 tc0;
+
+				varying vec4 clr;
+
+				void main(void){
+					gl_FragColor = vec4(clr.x, clr.y, clr.z, clr.w * texture2D(texture0, tc0).x);
+				}
+			)qwertyuiop";
+		case shader_quads::texture_mode::rgba:
+			break;
+	}
+
+	return R"qwertyuiop(
+		uniform sampler2D texture0;
+
+		varying vec2 tc0;
+
+		varying vec4 clr;
+
+		void main(void){
+			gl_FragColor = texture2D(texture0, tc0) * clr;
+		}
+	)qwertyuiop";
+}
+} // namespace
+
+shader_quads::shader_quads(
+	const utki::shared_ref<const ruis::render::context>& rendering_context, //
+	texture_mode mode,
+	bool instanced
+) :
+	shader_base(
+		rendering_context, //
+		get_vertex_shader_code(instanced),
+		get_fragment_shader_code(mode)
+	),
+	texture_uniform(this->get_uniform(uniform::texture0))
+{}
+
+void shader_quads::set_up(
+	const r4::matrix4<float>& m, //
+	const opengl_texture& tex
+) const
+{
+	tex.bind(this->opengl_context.get(), texture_unit_number);
+	this->bind();
+	this->set_matrix(m);
+}
+
+void shader_quads::set_initial_uniforms() const
+{
+	// the texture unit used for the sampler never changes, so set it only once
+	this->set_uniform_sampler(
+		this->texture_uniform, //
+		texture_unit_number
+	);
+}
@@ -0,0 +1,98 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include "../opengl_texture.hpp"
+#include "../shader_base.hpp"
+
+namespace ruis::render::opengl {
+
+/**
+ * @brief Shader for drawing batches of textured quads.
+ * Per-quad parameters are passed as vertex attributes, so that a batch of quads
+ * sharing the same texture is drawn with a single draw call.
+ *
+ * In instanced variant the vertex attributes are:
+ * - a0: per-vertex quad corner, from (0, 0) to (1, 1)
+ * - a1: per-instance quad rectangle (x, y, width, height)
+ * - a2: per-instance texture coordinates rectangle (x, y, width, height)
+ * - a3: per-instance color
+ * - a4 - a7: per-instance transformation matrix rows
+ *
+ * In non-instanced variant the quads are expanded to vertices on CPU side and the vertex attributes are:
+ * - a0: position, already transformed by the quad transformation matrix
+ * - a1: texture coordinates
+ * - a2: color
+ */
+class shader_quads : public shader_base
+{
+	uniform texture_uniform;
+
+public:
+	enum class texture_mode {
+		/**
+		 * @brief Fragment color is texture color multiplied by quad color.
+		 */
+		rgba,
+
+		/**
+		 * @brief Fragment color is quad color with alpha multiplied by texture's first channel.
+		 * Used for glyphs.
+		 */
+		alpha
+	};
+
+	/**
+	 * @param rendering_context - rendering context.
+	 * @param mode - texture mode.
+	 * @param instanced - whether to create instanced variant of the shader.
+	 */
+	shader_quads(
+		const utki::shared_ref<const ruis::render::context>& rendering_context, //
+		texture_mode mode,
+		bool instanced
+	);
+
+	shader_quads(const shader_quads&) = delete;
+	shader_quads& operator=(const shader_quads&) = delete;
+
+	shader_quads(shader_quads&&) = delete;
+	shader_quads& operator=(shader_quads&&) = delete;
+
+	~shader_quads() override = default;
+
+	/**
+	 * @brief Prepare for drawing a batch of quads.
+	 * Binds the texture and the shader program and sets the transformation matrix.
+	 * @param m - transformation matrix.
+	 * @param tex - texture to draw quads with.
+	 */
+	void set_up(
+		const r4::matrix4<float>& m, //
+		const opengl_texture& tex
+	) const;
+
+protected:
+	void set_initial_uniforms() const override;
+};
+
+} // namespace ruis::render::opengl
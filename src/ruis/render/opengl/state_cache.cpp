@@ -0,0 +1,576 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "state_cache.hpp"
+
+#include <algorithm>
+
+#include <utki/debug.hpp>
+
+#include "util.hpp"
+
+using namespace ruis::render::opengl;
+
+namespace {
+// enabled vertex attribute arrays are tracked with 32-bit mask
+constexpr unsigned max_tracked_vertex_attribs = 32;
+
+GLint get_integer(GLenum pname)
+{
+	// the variable is initialized via output argument, so no need to initialize
+	// it here
+
+	// NOLINTNEXTLINE(cppcoreguidelines-init-variables)
+	GLint ret;
+	glGetIntegerv(pname, &ret);
+	return ret;
+}
+
+GLuint get_object_name(GLenum pname)
+{
+	auto ret = get_integer(pname);
+	ASSERT(ret >= 0)
+	return GLuint(ret);
+}
+
+r4::rectangle<uint32_t> get_rectangle(GLenum pname)
+{
+	std::array<GLint, 4> r{};
+	glGetIntegerv(pname, r.data());
+
+#ifdef DEBUG
+	for (auto n : r) {
+		ASSERT(n >= 0)
+	}
+#endif
+
+	return {
+		uint32_t(r[0]), //
+		uint32_t(r[1]),
+		uint32_t(r[2]),
+		uint32_t(r[3])
+	};
+}
+
+bool are_equal(const r4::rectangle<uint32_t>& a, const r4::rectangle<uint32_t>& b)
+{
+	return a.p == b.p && a.d == b.d;
+}
+
+void set_capability(GLenum cap, bool enable)
+{
+	if (enable) {
+		glEnable(cap);
+	} else {
+		glDisable(cap);
+	}
+	assert_opengl_no_error();
+}
+} // namespace
+
+bool render_state::operator==(const render_state& s) const noexcept
+{
+	return this->framebuffer == s.framebuffer && //
+		are_equal(this->viewport, s.viewport) && //
+		are_equal(this->scissor, s.scissor) && //
+		this->scissor_enabled == s.scissor_enabled && //
+		this->depth_enabled == s.depth_enabled && //
+		this->blend_enabled == s.blend_enabled && //
+		this->blend_factors == s.blend_factors;
+}
+
+void state_cache::statistics::add_draw(
+	GLenum mode, //
+	size_t count,
+	size_t num_instances
+) noexcept
+{
+	++this->num_draws;
+	this->add_primitives(mode, count, num_instances);
+}
+
+void state_cache::statistics::add_primitives(
+	GLenum mode, //
+	size_t count,
+	size_t num_instances
+) noexcept
+{
+	size_t num_primitives = [&]() -> size_t {
+		switch (mode) {
+			case GL_TRIANGLES:
+				return count / 3;
+			case GL_TRIANGLE_STRIP:
+			case GL_TRIANGLE_FAN:
+				return count < 3 ? 0 : count - 2;
+			case GL_LINES:
+				return count / 2;
+			case GL_LINE_STRIP:
+				return count < 2 ? 0 : count - 1;
+			case GL_LINE_LOOP:
+				return count < 2 ? 0 : count;
+			default:
+				return count;
+		}
+	}();
+
+	this->num_primitives += num_primitives * num_instances;
+}
+
+render_state state_cache::get_render_state() const noexcept
+{
+	return {
+		.framebuffer = this->framebuffer,
+		.viewport = this->viewport,
+		.scissor = this->scissor,
+		.scissor_enabled = this->scissor_enabled,
+		.depth_enabled = this->depth_enabled,
+		.blend_enabled = this->blend_enabled,
+		.blend_factors = this->blend_factors
+	};
+}
+
+void state_cache::set_render_state(const render_state& s)
+{
+	this->bind_framebuffer(s.framebuffer);
+	this->set_viewport(s.viewport);
+	this->set_scissor(s.scissor);
+	this->enable_scissor(s.scissor_enabled);
+	this->enable_depth(s.depth_enabled);
+	this->enable_blend(s.blend_enabled);
+	this->set_blend_func(s.blend_factors);
+}
+
+void state_cache::resync()
+{
+	this->viewport = get_rectangle(GL_VIEWPORT);
+	this->scissor = get_rectangle(GL_SCISSOR_BOX);
+
+	// "? true : false" is to avoid warning under MSVC
+	this->scissor_enabled = glIsEnabled(GL_SCISSOR_TEST) ? true : false;
+	this->depth_enabled = glIsEnabled(GL_DEPTH_TEST) ? true : false;
+	this->blend_enabled = glIsEnabled(GL_BLEND) ? true : false;
+
+	this->blend_factors = {
+		GLenum(get_integer(GL_BLEND_SRC_RGB)),
+		GLenum(get_integer(GL_BLEND_DST_RGB)),
+		GLenum(get_integer(GL_BLEND_SRC_ALPHA)),
+		GLenum(get_integer(GL_BLEND_DST_ALPHA))
+	};
+
+	this->framebuffer = get_object_name(GL_FRAMEBUFFER_BINDING);
+	this->program = get_object_name(GL_CURRENT_PROGRAM);
+	this->array_buffer = get_object_name(GL_ARRAY_BUFFER_BINDING);
+	this->element_array_buffer = get_object_name(GL_ELEMENT_ARRAY_BUFFER_BINDING);
+
+	if (this->vertex_array_objects_supported) {
+		this->vertex_array_object = get_object_name(GL_VERTEX_ARRAY_BINDING);
+	}
+
+	{
+		auto max_attribs = get_integer(GL_MAX_VERTEX_ATTRIBS);
+		ASSERT(max_attribs > 0)
+		this->num_vertex_attribs = std::min(unsigned(max_attribs), max_tracked_vertex_attribs);
+	}
+
+	if (this->vertex_array_object == 0) {
+		this->enabled_vertex_attribs = 0;
+		this->instanced_vertex_attribs = 0;
+		for (unsigned i = 0; i != this->num_vertex_attribs; ++i) {
+			// NOLINTNEXTLINE(cppcoreguidelines-init-variables)
+			GLint enabled;
+			glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+			if (enabled != 0) {
+				this->enabled_vertex_attribs |= (uint32_t(1) << i);
+			}
+
+			if (this->instanced_arrays_supported) {
+				// NOLINTNEXTLINE(cppcoreguidelines-init-variables)
+				GLint divisor;
+				glGetVertexAttribiv(i, GL_VERTEX_ATTRIB_ARRAY_DIVISOR, &divisor);
+				if (divisor != 0) {
+					this->instanced_vertex_attribs |= (uint32_t(1) << i);
+				}
+			}
+		}
+	} else {
+		// The state of the default vertex array object cannot be queried without binding it,
+		// so assume the worst case.
+		this->default_element_array_buffer = 0;
+		this->enabled_vertex_attribs = ~uint32_t(0);
+		if (this->num_vertex_attribs < max_tracked_vertex_attribs) {
+			this->enabled_vertex_attribs &= (uint32_t(1) << this->num_vertex_attribs) - 1;
+		}
+		this->instanced_vertex_attribs = this->instanced_arrays_supported ? this->enabled_vertex_attribs : 0;
+	}
+
+	{
+		auto active_texture = get_integer(GL_ACTIVE_TEXTURE);
+		ASSERT(active_texture >= GL_TEXTURE0)
+		this->active_texture_unit = unsigned(active_texture - GL_TEXTURE0);
+	}
+
+	{
+		auto num_units = get_integer(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS);
+		ASSERT(num_units > 0)
+		this->texture_units.resize(size_t(num_units));
+
+		for (unsigned i = 0; i != this->texture_units.size(); ++i) {
+			// OpenGL guarantees that GL_TEXTUREi = GL_TEXTURE0 + i
+			glActiveTexture(GL_TEXTURE0 + i);
+			auto& unit = this->texture_units[i];
+			unit.texture_2d = get_object_name(GL_TEXTURE_BINDING_2D);
+			unit.texture_cube = get_object_name(GL_TEXTURE_BINDING_CUBE_MAP);
+		}
+
+		glActiveTexture(GL_TEXTURE0 + this->active_texture_unit);
+	}
+
+	assert_opengl_no_error();
+}
+
+void state_cache::set_viewport(const r4::rectangle<uint32_t>& r)
+{
+	if (are_equal(this->viewport, r)) {
+		return;
+	}
+
+	glViewport(
+		GLint(r.p.x()), //
+		GLint(r.p.y()),
+		GLint(r.d.x()),
+		GLint(r.d.y())
+	);
+	assert_opengl_no_error();
+
+	this->viewport = r;
+}
+
+void state_cache::set_scissor(const r4::rectangle<uint32_t>& r)
+{
+	if (are_equal(this->scissor, r)) {
+		return;
+	}
+
+	glScissor(
+		GLint(r.p.x()), //
+		GLint(r.p.y()),
+		GLint(r.d.x()),
+		GLint(r.d.y())
+	);
+	assert_opengl_no_error();
+
+	this->scissor = r;
+}
+
+void state_cache::enable_scissor(bool enable)
+{
+	if (this->scissor_enabled == enable) {
+		return;
+	}
+	set_capability(GL_SCISSOR_TEST, enable);
+	this->scissor_enabled = enable;
+}
+
+void state_cache::enable_depth(bool enable)
+{
+	if (this->depth_enabled == enable) {
+		return;
+	}
+	set_capability(GL_DEPTH_TEST, enable);
+	this->depth_enabled = enable;
+}
+
+void state_cache::enable_blend(bool enable)
+{
+	if (this->blend_enabled == enable) {
+		return;
+	}
+	set_capability(GL_BLEND, enable);
+	this->blend_enabled = enable;
+}
+
+void state_cache::set_blend_func(const blend_factors_type& factors)
+{
+	if (this->blend_factors == factors) {
+		return;
+	}
+
+	glBlendFuncSeparate(
+		factors[0], //
+		factors[1],
+		factors[2],
+		factors[3]
+	);
+	assert_opengl_no_error();
+
+	this->blend_factors = factors;
+}
+
+void state_cache::bind_framebuffer(GLuint fbo)
+{
+	if (this->framebuffer == fbo) {
+		return;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	assert_opengl_no_error();
+
+	this->framebuffer = fbo;
+	++this->stats.num_framebuffer_switches;
+}
+
+void state_cache::on_framebuffer_deleted(GLuint fbo) noexcept
+{
+	if (this->framebuffer == fbo) {
+		this->framebuffer = 0;
+	}
+}
+
+void state_cache::use_program(GLuint prog)
+{
+	if (this->program == prog) {
+		return;
+	}
+
+	glUseProgram(prog);
+	assert_opengl_no_error();
+
+	this->program = prog;
+	++this->stats.num_program_switches;
+}
+
+void state_cache::on_program_deleted(GLuint prog)
+{
+	if (this->program == prog) {
+		this->use_program(0);
+	}
+}
+
+GLuint state_cache::get_buffer(GLenum target) const noexcept
+{
+	switch (target) {
+		case GL_ARRAY_BUFFER:
+			return this->array_buffer;
+		case GL_ELEMENT_ARRAY_BUFFER:
+			return this->element_array_buffer;
+		default:
+			ASSERT(false)
+			return 0;
+	}
+}
+
+void state_cache::bind_buffer(GLenum target, GLuint buffer)
+{
+	GLuint* binding = [&]() {
+		switch (target) {
+			case GL_ARRAY_BUFFER:
+				return &this->array_buffer;
+			default:
+				ASSERT(target == GL_ELEMENT_ARRAY_BUFFER)
+				return &this->element_array_buffer;
+		}
+	}();
+
+	if (*binding == buffer) {
+		return;
+	}
+
+	glBindBuffer(target, buffer);
+	assert_opengl_no_error();
+
+	*binding = buffer;
+}
+
+void state_cache::on_buffer_deleted(GLuint buffer) noexcept
+{
+	if (this->array_buffer == buffer) {
+		this->array_buffer = 0;
+	}
+	if (this->element_array_buffer == buffer) {
+		this->element_array_buffer = 0;
+	}
+	// the name may be reused by the driver, so the binding saved for VAO 0 must not survive the deletion
+	if (this->default_element_array_buffer == buffer) {
+		this->default_element_array_buffer = 0;
+	}
+}
+
+void state_cache::bind_vertex_array(GLuint vao, GLuint element_buffer)
+{
+	ASSERT(vao == 0 || this->vertex_array_objects_supported)
+
+	if (this->vertex_array_object != vao) {
+		glBindVertexArray(vao);
+		assert_opengl_no_error();
+
+		if (this->vertex_array_object == 0) {
+			this->default_element_array_buffer = this->element_array_buffer;
+		}
+
+		if (vao == 0) {
+			this->element_array_buffer = this->default_element_array_buffer;
+		} else {
+			this->element_array_buffer = element_buffer;
+		}
+
+		this->vertex_array_object = vao;
+	}
+
+	if (!this->vertex_array_objects_to_delete.empty()) {
+		// none of the vertex array objects to delete can be currently bound,
+		// because their owners do not exist anymore
+		glDeleteVertexArrays(
+			GLsizei(this->vertex_array_objects_to_delete.size()),
+			this->vertex_array_objects_to_delete.data()
+		);
+		assert_opengl_no_error();
+		this->vertex_array_objects_to_delete.clear();
+	}
+}
+
+void state_cache::bind_default_element_array_buffer(GLuint buffer)
+{
+	this->bind_vertex_array(0);
+	this->bind_buffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+}
+
+void state_cache::delete_vertex_array_object(GLuint vao)
+{
+	this->vertex_array_objects_to_delete.push_back(vao);
+}
+
+void state_cache::set_enabled_vertex_attribs(unsigned num_attribs)
+{
+	ASSERT(this->vertex_array_object == 0)
+	ASSERT(num_attribs <= this->num_vertex_attribs)
+
+	uint32_t required = num_attribs < max_tracked_vertex_attribs ? (uint32_t(1) << num_attribs) - 1 : ~uint32_t(0);
+
+	if (this->enabled_vertex_attribs == required) {
+		return;
+	}
+
+	for (unsigned i = 0; i != this->num_vertex_attribs; ++i) {
+		uint32_t mask = uint32_t(1) << i;
+		if ((this->enabled_vertex_attribs & mask) == (required & mask)) {
+			continue;
+		}
+		if ((required & mask) != 0) {
+			glEnableVertexAttribArray(i);
+		} else {
+			glDisableVertexAttribArray(i);
+		}
+		assert_opengl_no_error();
+	}
+
+	this->enabled_vertex_attribs = required;
+}
+
+void state_cache::set_instanced_vertex_attribs(uint32_t mask)
+{
+	ASSERT(this->vertex_array_object == 0)
+	ASSERT(this->instanced_arrays_supported || mask == 0)
+
+	if (this->instanced_vertex_attribs == mask) {
+		return;
+	}
+
+	for (unsigned i = 0; i != this->num_vertex_attribs; ++i) {
+		uint32_t bit = uint32_t(1) << i;
+		if ((this->instanced_vertex_attribs & bit) == (mask & bit)) {
+			continue;
+		}
+		vertex_attrib_divisor(i, (mask & bit) != 0 ? 1 : 0);
+	}
+
+	this->instanced_vertex_attribs = mask;
+}
+
+void state_cache::set_active_texture(unsigned unit_num)
+{
+	if (this->active_texture_unit == unit_num) {
+		return;
+	}
+
+	// OpenGL guarantees that GL_TEXTUREi = GL_TEXTURE0 + i
+	glActiveTexture(GL_TEXTURE0 + unit_num);
+	assert_opengl_no_error();
+
+	this->active_texture_unit = unit_num;
+}
+
+GLuint state_cache::get_texture(unsigned unit_num, GLenum target) const noexcept
+{
+	ASSERT(unit_num < this->texture_units.size())
+	const auto& unit = this->texture_units[unit_num];
+	switch (target) {
+		case GL_TEXTURE_2D:
+			return unit.texture_2d;
+		case GL_TEXTURE_CUBE_MAP:
+			return unit.texture_cube;
+		default:
+			ASSERT(false)
+			return 0;
+	}
+}
+
+GLuint& state_cache::texture_binding(unsigned unit_num, GLenum target) noexcept
+{
+	ASSERT(unit_num < this->texture_units.size())
+	auto& unit = this->texture_units[unit_num];
+	switch (target) {
+		default:
+			ASSERT(false)
+			[[fallthrough]];
+		case GL_TEXTURE_2D:
+			return unit.texture_2d;
+		case GL_TEXTURE_CUBE_MAP:
+			return unit.texture_cube;
+	}
+}
+
+void state_cache::bind_texture(unsigned unit_num, GLenum target, GLuint texture)
+{
+	auto& binding = this->texture_binding(unit_num, target);
+	if (binding == texture) {
+		return;
+	}
+
+	this->set_active_texture(unit_num);
+
+	glBindTexture(target, texture);
+	assert_opengl_no_error();
+
+	binding = texture;
+	++this->stats.num_texture_binds;
+}
+
+void state_cache::on_texture_deleted(GLuint texture) noexcept
+{
+	for (auto& unit : this->texture_units) {
+		if (unit.texture_2d == texture) {
+			unit.texture_2d = 0;
+		}
+		if (unit.texture_cube == texture) {
+			unit.texture_cube = 0;
+		}
+	}
+}
@@ -0,0 +1,376 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <GL/glew.h>
+#include <r4/rectangle.hpp>
+
+namespace ruis::render::opengl {
+
+/**
+ * @brief Framebuffer and fixed-function pipeline state affecting draws and clears.
+ */
+struct render_state {
+	GLuint framebuffer = 0;
+	r4::rectangle<uint32_t> viewport = {0, 0, 0, 0};
+	r4::rectangle<uint32_t> scissor = {0, 0, 0, 0};
+	bool scissor_enabled = false;
+	bool depth_enabled = false;
+	bool blend_enabled = false;
+	std::array<GLenum, 4> blend_factors = {GL_ONE, GL_ZERO, GL_ONE, GL_ZERO};
+
+	bool operator==(const render_state& s) const noexcept;
+
+	bool operator!=(const render_state& s) const noexcept
+	{
+		return !this->operator==(s);
+	}
+};
+
+/**
+ * @brief CPU-side mirror of the OpenGL state.
+ * All OpenGL state changes done by the renderer go through the state cache.
+ * This allows skipping OpenGL calls which would not change the state and
+ * answering state queries without calling glGet*() functions, which may stall the pipeline.
+ * All methods must be called with the owning OpenGL context bound.
+ */
+class state_cache
+{
+public:
+	constexpr static const auto num_blend_factors = 4;
+
+	using blend_factors_type = std::array<GLenum, num_blend_factors>;
+
+	/**
+	 * @brief Counters of OpenGL calls issued through the owning OpenGL context.
+	 * State changes are counted only when those are actually issued to OpenGL,
+	 * i.e. not skipped by the cache.
+	 */
+	struct statistics {
+		size_t num_draws = 0;
+		size_t num_primitives = 0;
+		size_t num_program_switches = 0;
+		size_t num_texture_binds = 0;
+		size_t num_framebuffer_switches = 0;
+		size_t num_uniform_uploads = 0;
+		size_t num_clears = 0;
+		size_t buffer_bytes_uploaded = 0;
+		size_t texture_bytes_uploaded = 0;
+
+		/**
+		 * @brief Account a draw call.
+		 * @param mode - OpenGL primitive mode.
+		 * @param count - number of vertices or indices drawn.
+		 * @param num_instances - number of instances drawn.
+		 */
+		void add_draw(
+			GLenum mode, //
+			size_t count,
+			size_t num_instances = 1
+		) noexcept;
+
+		/**
+		 * @brief Account primitives drawn without accounting a draw call.
+		 * Used for draw calls which draw several index ranges.
+		 * @param mode - OpenGL primitive mode.
+		 * @param count - number of vertices or indices drawn.
+		 * @param num_instances - number of instances drawn.
+		 */
+		void add_primitives(
+			GLenum mode, //
+			size_t count,
+			size_t num_instances = 1
+		) noexcept;
+	};
+
+private:
+	statistics stats;
+
+	const bool vertex_array_objects_supported;
+	const bool instanced_arrays_supported;
+
+	r4::rectangle<uint32_t> viewport = {0, 0, 0, 0};
+	r4::rectangle<uint32_t> scissor = {0, 0, 0, 0};
+
+	bool scissor_enabled = false;
+	bool depth_enabled = false;
+	bool blend_enabled = false;
+
+	blend_factors_type blend_factors = {GL_ONE, GL_ZERO, GL_ONE, GL_ZERO};
+
+	GLuint framebuffer = 0;
+	GLuint program = 0;
+	GLuint array_buffer = 0;
+
+	// element array buffer binding is a part of the vertex array object state
+	GLuint element_array_buffer = 0;
+
+	GLuint vertex_array_object = 0;
+
+	// element array buffer binding of the default vertex array object,
+	// saved while some other vertex array object is bound
+	GLuint default_element_array_buffer = 0;
+
+	// number of vertex attributes supported by OpenGL implementation, but not more than 32
+	unsigned num_vertex_attribs = 0;
+
+	// bit mask of enabled vertex attribute arrays of the default vertex array object
+	uint32_t enabled_vertex_attribs = 0;
+
+	// bit mask of vertex attribute arrays of the default vertex array object
+	// which have vertex attribute divisor set to 1
+	uint32_t instanced_vertex_attribs = 0;
+
+	std::vector<GLuint> vertex_array_objects_to_delete;
+
+	struct texture_unit {
+		GLuint texture_2d = 0;
+		GLuint texture_cube = 0;
+	};
+
+	unsigned active_texture_unit = 0;
+	std::vector<texture_unit> texture_units;
+
+public:
+	/**
+	 * @param vertex_array_objects_supported - whether vertex array objects are supported by OpenGL implementation.
+	 * @param instanced_arrays_supported - whether vertex attribute divisors are supported by OpenGL implementation.
+	 */
+	state_cache(
+		bool vertex_array_objects_supported, //
+		bool instanced_arrays_supported
+	) :
+		vertex_array_objects_supported(vertex_array_objects_supported),
+		instanced_arrays_supported(instanced_arrays_supported)
+	{}
+
+	/**
+	 * @brief Get statistics of OpenGL calls.
+	 * Code issuing draws, clears and data uploads updates the returned object.
+	 * @return Statistics since the last reset_statistics() call.
+	 */
+	statistics& get_statistics() noexcept
+	{
+		return this->stats;
+	}
+
+	const statistics& get_statistics() const noexcept
+	{
+		return this->stats;
+	}
+
+	void reset_statistics() noexcept
+	{
+		this->stats = {};
+	}
+
+	/**
+	 * @brief Re-read the whole state from OpenGL.
+	 * Needs to be called in case the OpenGL state was changed bypassing the cache,
+	 * e.g. by some third party code sharing the same OpenGL context.
+	 */
+	void resync();
+
+	render_state get_render_state() const noexcept;
+
+	void set_render_state(const render_state& s);
+
+	const r4::rectangle<uint32_t>& get_viewport() const noexcept
+	{
+		return this->viewport;
+	}
+
+	void set_viewport(const r4::rectangle<uint32_t>& r);
+
+	const r4::rectangle<uint32_t>& get_scissor() const noexcept
+	{
+		return this->scissor;
+	}
+
+	void set_scissor(const r4::rectangle<uint32_t>& r);
+
+	bool is_scissor_enabled() const noexcept
+	{
+		return this->scissor_enabled;
+	}
+
+	void enable_scissor(bool enable);
+
+	bool is_depth_enabled() const noexcept
+	{
+		return this->depth_enabled;
+	}
+
+	void enable_depth(bool enable);
+
+	bool is_blend_enabled() const noexcept
+	{
+		return this->blend_enabled;
+	}
+
+	void enable_blend(bool enable);
+
+	const blend_factors_type& get_blend_func() const noexcept
+	{
+		return this->blend_factors;
+	}
+
+	/**
+	 * @brief Set blend factors.
+	 * @param factors - blend factors in the order of glBlendFuncSeparate() arguments.
+	 */
+	void set_blend_func(const blend_factors_type& factors);
+
+	GLuint get_framebuffer() const noexcept
+	{
+		return this->framebuffer;
+	}
+
+	void bind_framebuffer(GLuint fbo);
+
+	/**
+	 * @brief Notify the cache that the framebuffer object is deleted.
+	 * OpenGL reverts the binding to 0 in case currently bound framebuffer is deleted.
+	 * @param fbo - deleted framebuffer object name.
+	 */
+	void on_framebuffer_deleted(GLuint fbo) noexcept;
+
+	GLuint get_program() const noexcept
+	{
+		return this->program;
+	}
+
+	void use_program(GLuint prog);
+
+	/**
+	 * @brief Notify the cache that the program object is about to be deleted.
+	 * Program object which is in use is not deleted by OpenGL until it is not in use anymore,
+	 * so the program is unbound in case it is currently in use.
+	 * @param prog - program object name which is about to be deleted.
+	 */
+	void on_program_deleted(GLuint prog);
+
+	/**
+	 * @param target - either GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER.
+	 */
+	GLuint get_buffer(GLenum target) const noexcept;
+
+	/**
+	 * @param target - either GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER.
+	 * @param buffer - buffer object name.
+	 */
+	void bind_buffer(GLenum target, GLuint buffer);
+
+	/**
+	 * @brief Notify the cache that the buffer object is deleted.
+	 * OpenGL reverts the binding to 0 in case currently bound buffer is deleted.
+	 * @param buffer - deleted buffer object name.
+	 */
+	void on_buffer_deleted(GLuint buffer) noexcept;
+
+	GLuint get_vertex_array_object() const noexcept
+	{
+		return this->vertex_array_object;
+	}
+
+	/**
+	 * @brief Bind vertex array object.
+	 * Vertex array objects must be supported in order to bind a non-default vertex array object.
+	 * @param vao - vertex array object name. 0 for the default vertex array object.
+	 * @param element_buffer - element array buffer bound to the vertex array object.
+	 *                         Ignored in case of default vertex array object.
+	 */
+	void bind_vertex_array(GLuint vao, GLuint element_buffer = 0);
+
+	/**
+	 * @brief Bind element array buffer to the default vertex array object.
+	 * Element array buffer binding is a part of vertex array object state,
+	 * so the default vertex array object is bound first to make sure no other
+	 * vertex array object is modified, e.g. when uploading index data.
+	 * @param buffer - buffer object name.
+	 */
+	void bind_default_element_array_buffer(GLuint buffer);
+
+	/**
+	 * @brief Delete vertex array object.
+	 * Vertex array objects are not shared between OpenGL contexts, so the deletion is
+	 * postponed till the next bind_vertex_array() call, because at that time
+	 * the owning context is guaranteed to be bound.
+	 * @param vao - vertex array object name to delete.
+	 */
+	void delete_vertex_array_object(GLuint vao);
+
+	/**
+	 * @brief Set enabled vertex attribute arrays.
+	 * Enables vertex attribute arrays [0, num_attribs) and disables the rest.
+	 * Only applicable to the default vertex array object.
+	 * @param num_attribs - number of enabled vertex attribute arrays.
+	 */
+	void set_enabled_vertex_attribs(unsigned num_attribs);
+
+	/**
+	 * @brief Set per-instance vertex attribute arrays.
+	 * Sets vertex attribute divisor to 1 for the vertex attribute arrays marked in the mask
+	 * and to 0 for the rest.
+	 * Only applicable to the default vertex array object.
+	 * Instanced arrays must be supported in order to set a non-zero mask.
+	 * @param mask - bit mask of per-instance vertex attribute arrays, bit i corresponds to vertex attribute i.
+	 */
+	void set_instanced_vertex_attribs(uint32_t mask);
+
+	unsigned get_active_texture() const noexcept
+	{
+		return this->active_texture_unit;
+	}
+
+	void set_active_texture(unsigned unit_num);
+
+	/**
+	 * @param unit_num - texture unit number.
+	 * @param target - either GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP.
+	 */
+	GLuint get_texture(unsigned unit_num, GLenum target) const noexcept;
+
+	/**
+	 * @brief Bind texture to a texture unit.
+	 * Activates the texture unit in case the texture is not already bound to it.
+	 * @param unit_num - texture unit number.
+	 * @param target - either GL_TEXTURE_2D or GL_TEXTURE_CUBE_MAP.
+	 * @param texture - texture object name.
+	 */
+	void bind_texture(unsigned unit_num, GLenum target, GLuint texture);
+
+	/**
+	 * @brief Notify the cache that the texture object is deleted.
+	 * OpenGL reverts the binding to 0 for all texture units the deleted texture is bound to.
+	 * @param texture - deleted texture object name.
+	 */
+	void on_texture_deleted(GLuint texture) noexcept;
+
+private:
+	GLuint& texture_binding(unsigned unit_num, GLenum target) noexcept;
+};
+
+} // namespace ruis::render::opengl
@@ -0,0 +1,212 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "stream_buffer.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "util.hpp"
+
+using namespace ruis::render::opengl;
+
+namespace {
+constexpr const GLbitfield persistent_map_flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+// 1 second, in nanoseconds
+constexpr const GLuint64 fence_wait_timeout = 1000000000;
+} // namespace
+
+stream_buffer::stream_buffer(
+	const utki::shared_ref<const ruis::render::context>& rendering_context, //
+	size_t capacity
+) :
+	opengl_buffer(rendering_context),
+	capacity(capacity),
+	persistent(
+		this->opengl_context.get().supported_extensions.get(extension::arb_buffer_storage) &&
+		this->opengl_context.get().supported_extensions.get(extension::arb_sync)
+	)
+{
+	ASSERT(this->capacity > 0)
+
+	this->opengl_context.get().get_state_cache().bind_buffer(GL_ARRAY_BUFFER, this->get_buffer());
+
+	this->set_size_bytes(this->capacity);
+
+	if (!this->persistent) {
+		glBufferData(
+			GL_ARRAY_BUFFER, //
+			GLsizeiptr(this->capacity),
+			nullptr,
+			GL_STREAM_DRAW
+		);
+		assert_opengl_no_error();
+		return;
+	}
+
+	glBufferStorage(
+		GL_ARRAY_BUFFER, //
+		GLsizeiptr(this->capacity),
+		nullptr,
+		persistent_map_flags
+	);
+	assert_opengl_no_error();
+
+	this->mapped = static_cast<uint8_t*>(glMapBufferRange(
+		GL_ARRAY_BUFFER, //
+		0,
+		GLsizeiptr(this->capacity),
+		persistent_map_flags
+	));
+	assert_opengl_no_error();
+
+	if (!this->mapped) {
+		throw std::runtime_error("stream_buffer::stream_buffer(): glMapBufferRange() failed");
+	}
+}
+
+stream_buffer::~stream_buffer()
+{
+	// deleting the buffer object unmaps it, so no need to unmap explicitly
+	for (const auto& f : this->fences) {
+		glDeleteSync(f.sync);
+	}
+}
+
+size_t stream_buffer::write(
+	utki::span<const uint8_t> data, //
+	size_t alignment
+)
+{
+	ASSERT(alignment > 0)
+
+	if (data.size() > this->capacity) {
+		throw std::invalid_argument("stream_buffer::write(): data size exceeds buffer capacity");
+	}
+
+	auto pos = (this->head + alignment - 1) / alignment * alignment;
+	auto offset = size_t(pos % this->capacity);
+
+	if (offset + data.size() > this->capacity) {
+		// data does not fit till the end of the buffer, wrap around
+		pos += this->capacity - offset;
+		offset = 0;
+
+		if (!this->persistent) {
+			// orphan the buffer storage, the driver will allocate new storage
+			// in case the old one is still in use
+			this->opengl_context.get().get_state_cache().bind_buffer(GL_ARRAY_BUFFER, this->get_buffer());
+			glBufferData(
+				GL_ARRAY_BUFFER, //
+				GLsizeiptr(this->capacity),
+				nullptr,
+				GL_STREAM_DRAW
+			);
+			assert_opengl_no_error();
+			this->tail = pos;
+		}
+	}
+
+	if (this->persistent) {
+		// wait till the region to write to is not in use anymore
+		while (pos + data.size() - this->tail > this->capacity) {
+			if (this->fences.empty()) {
+				if (this->tail == this->head) {
+					// nothing is in use
+					this->tail = pos;
+					break;
+				}
+				// the data written since the last fence is in use by already issued draws
+				this->fence();
+			}
+			this->wait_oldest_fence();
+		}
+
+		std::memcpy(
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+			this->mapped + offset,
+			data.data(),
+			data.size()
+		);
+
+		// buffer is used for drawing right after writing, so bind it for consistency with non-persistent case
+		this->opengl_context.get().get_state_cache().bind_buffer(GL_ARRAY_BUFFER, this->get_buffer());
+	} else {
+		this->opengl_context.get().get_state_cache().bind_buffer(GL_ARRAY_BUFFER, this->get_buffer());
+		glBufferSubData(
+			GL_ARRAY_BUFFER, //
+			GLintptr(offset),
+			GLsizeiptr(data.size()),
+			data.data()
+		);
+		assert_opengl_no_error();
+	}
+
+	this->head = pos + data.size();
+	this->frame_stats.bytes_streamed += data.size();
+	this->opengl_context.get().get_state_cache().get_statistics().buffer_bytes_uploaded += data.size();
+
+	return offset;
+}
+
+void stream_buffer::fence()
+{
+	if (this->fenced_head == this->head) {
+		return;
+	}
+
+	if (this->persistent) {
+		GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		assert_opengl_no_error();
+		this->fences.push_back({sync, this->head});
+	}
+
+	this->fenced_head = this->head;
+}
+
+void stream_buffer::end_frame()
+{
+	this->fence();
+	this->last_frame_stats = this->frame_stats;
+	this->frame_stats = {};
+}
+
+void stream_buffer::wait_oldest_fence()
+{
+	ASSERT(!this->fences.empty())
+
+	auto& f = this->fences.front();
+
+	auto res = glClientWaitSync(f.sync, 0, 0);
+	if (res == GL_TIMEOUT_EXPIRED) {
+		++this->frame_stats.num_stalls;
+		do {
+			res = glClientWaitSync(f.sync, GL_SYNC_FLUSH_COMMANDS_BIT, fence_wait_timeout);
+		} while (res == GL_TIMEOUT_EXPIRED);
+	}
+	utki::assert(res != GL_WAIT_FAILED, SL);
+
+	glDeleteSync(f.sync);
+
+	this->tail = f.end;
+	this->fences.pop_front();
+}
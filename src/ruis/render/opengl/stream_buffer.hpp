@@ -0,0 +1,162 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+#include <GL/glew.h>
+#include <utki/span.hpp>
+
+#include "opengl_buffer.hpp"
+
+namespace ruis::render::opengl {
+
+/**
+ * @brief Ring buffer for streaming transient vertex and index data.
+ * The data is written to consecutive regions of the buffer, wrapping around at the end.
+ * Written data can be drawn from the buffer using the offset returned by write().
+ *
+ * In case GL_ARB_buffer_storage and GL_ARB_sync are supported, the buffer is persistently mapped
+ * and the data is written straight into GPU-visible memory. Regions of the buffer are reused
+ * only after the fence placed after the draws using those regions is signaled.
+ * Otherwise, the data is uploaded with glBufferSubData() and the buffer storage is orphaned
+ * on wrap around, so that the driver takes care of not overwriting the data in use.
+ */
+class stream_buffer : public opengl_buffer
+{
+public:
+	struct statistics {
+		/**
+		 * @brief Number of bytes written.
+		 */
+		size_t bytes_streamed = 0;
+
+		/**
+		 * @brief Number of times the CPU had to wait for GPU to release a buffer region.
+		 */
+		size_t num_stalls = 0;
+	};
+
+private:
+	const size_t capacity;
+
+	const bool persistent;
+
+	// persistently mapped buffer memory, nullptr if not persistent
+	uint8_t* mapped = nullptr;
+
+	// Positions within the ring are absolute, i.e. not wrapped around,
+	// the offset within the buffer is position modulo capacity.
+
+	// position of the next write
+	uint64_t head = 0;
+
+	// start of the region which may still be in use by GPU
+	uint64_t tail = 0;
+
+	// head position at the moment of placing the last fence
+	uint64_t fenced_head = 0;
+
+	struct fence_entry {
+		GLsync sync;
+
+		// end of the region guarded by the fence
+		uint64_t end;
+	};
+
+	std::deque<fence_entry> fences;
+
+	statistics frame_stats;
+	statistics last_frame_stats;
+
+public:
+	constexpr static const size_t default_alignment = 16;
+
+	/**
+	 * @param rendering_context - rendering context.
+	 * @param capacity - buffer size in bytes.
+	 */
+	stream_buffer(
+		const utki::shared_ref<const ruis::render::context>& rendering_context, //
+		size_t capacity
+	);
+
+	stream_buffer(const stream_buffer&) = delete;
+	stream_buffer& operator=(const stream_buffer&) = delete;
+
+	stream_buffer(stream_buffer&&) = delete;
+	stream_buffer& operator=(stream_buffer&&) = delete;
+
+	~stream_buffer() override;
+
+	size_t get_capacity() const noexcept
+	{
+		return this->capacity;
+	}
+
+	bool is_persistent() const noexcept
+	{
+		return this->persistent;
+	}
+
+	/**
+	 * @brief Write data to the buffer.
+	 * The data must be drawn before the next wrap around of the buffer in case it is not persistent,
+	 * since the wrap around orphans the buffer storage.
+	 * Binds the buffer to GL_ARRAY_BUFFER target.
+	 * @param data - data to write. Must not be larger than the buffer capacity.
+	 * @param alignment - alignment of the data offset within the buffer.
+	 * @return Offset of the written data within the buffer.
+	 */
+	size_t write(
+		utki::span<const uint8_t> data, //
+		size_t alignment = default_alignment
+	);
+
+	/**
+	 * @brief Place a fence after the draws issued so far.
+	 * The data written before the fence is considered in use till the fence is signaled.
+	 * Fences are also placed automatically in case the buffer is full.
+	 */
+	void fence();
+
+	/**
+	 * @brief Notify about the end of a frame.
+	 * Places a fence and starts collecting statistics for the next frame.
+	 */
+	void end_frame();
+
+	/**
+	 * @brief Get statistics of the last finished frame.
+	 * @return Statistics of the last frame.
+	 */
+	const statistics& get_frame_statistics() const noexcept
+	{
+		return this->last_frame_stats;
+	}
+
+private:
+	void wait_oldest_fence();
+};
+
+} // namespace ruis::render::opengl
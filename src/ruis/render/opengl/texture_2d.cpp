@@ -21,58 +21,24 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "texture_2d.hpp"
 
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "pixel_kernels.hpp"
+#include "texture_atlas.hpp"
+#include "texture_residency.hpp"
 #include "util.hpp"
 
 using namespace ruis::render::opengl;
 
-texture_2d::texture_2d(
-	utki::shared_ref<const ruis::render::context> rendering_context, //
-	rasterimage::format type,
-	rasterimage::dimensioned::dimensions_type dims,
-	utki::span<const uint8_t> data,
-	ruis::render::context::texture_2d_parameters params
-) :
-	ruis::render::texture_2d(
-		rendering_context, //
-		dims
-	)
+namespace {
+void set_texture_parameters(
+	const ruis::render::context::texture_2d_parameters& params, //
+	ruis::render::texture_2d::mipmap mipmap
+)
 {
-	utki::assert(data.size() % rasterimage::to_num_channels(type) == 0, SL);
-	utki::assert(data.size() % dims.x() == 0, SL);
-	utki::assert(data.size() == 0 || data.size() / rasterimage::to_num_channels(type) / dims.x() == dims.y(), SL);
-
-	this->bind(0);
-
-	utki::assert(dynamic_cast<const opengl::context*>(&rendering_context.get()), SL);
-	auto& opengl_context =
-		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast, "assert(dynamic_cast) done")
-		static_cast<const opengl::context&>(rendering_context.get());
-
-	GLint internal_format = this->set_swizzeling(
-		type, //
-		opengl_context.supported_extensions
-	);
-
-	// we will be passing pixels to OpenGL which are 1-byte aligned.
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	assert_opengl_no_error();
-
-	glTexImage2D(
-		GL_TEXTURE_2D,
-		0, // 0th level, no mipmaps
-		internal_format, // internal format
-		GLsizei(dims.x()),
-		GLsizei(dims.y()),
-		0, // border, should be 0!
-		internal_format, // format of the texel data
-		GL_UNSIGNED_BYTE, // data type of the texel data
-		data.size() == 0 ? nullptr : data.data() // texel data
-	);
-	assert_opengl_no_error();
-
-	if (!data.empty() && params.mipmap != texture_2d::mipmap::none) {
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
+	using ruis::render::texture_2d;
 
 	auto to_gl_filter = [](texture_2d::filter f) {
 		switch (f) {
@@ -87,7 +53,7 @@ texture_2d::texture_2d(
 	GLint mag_filter = to_gl_filter(params.mag_filter);
 
 	GLint min_filter = [&]() {
-		switch (params.mipmap) {
+		switch (mipmap) {
 			case texture_2d::mipmap::none:
 				return to_gl_filter(params.min_filter);
 			case texture_2d::mipmap::nearest:
@@ -121,3 +87,353 @@ texture_2d::texture_2d(
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	assert_opengl_no_error();
 }
+
+size_t calc_size_bytes(
+	r4::vector2<uint32_t> dims, //
+	size_t pixel_size,
+	bool mipmapped
+)
+{
+	size_t ret = 0;
+	for (;;) {
+		ret += size_t(dims.x()) * size_t(dims.y()) * pixel_size;
+		if (!mipmapped || (dims.x() == 1 && dims.y() == 1)) {
+			break;
+		}
+		dims = {
+			std::max(dims.x() / 2, uint32_t(1)), //
+			std::max(dims.y() / 2, uint32_t(1))
+		};
+	}
+	return ret;
+}
+
+unsigned calc_num_levels(r4::vector2<uint32_t> dims)
+{
+	unsigned ret = 1;
+	while (dims.x() > 1 || dims.y() > 1) {
+		dims = {
+			std::max(dims.x() / 2, uint32_t(1)), //
+			std::max(dims.y() / 2, uint32_t(1))
+		};
+		++ret;
+	}
+	return ret;
+}
+
+// glGenerateMipmap() is very slow on software renderers, so make the mipmap levels on CPU,
+// returns number of uploaded bytes
+size_t upload_mipmaps(
+	const image_view& image, //
+	GLenum gl_format
+)
+{
+	size_t ret = 0;
+
+	auto num_channels = size_t(rasterimage::to_num_channels(image.format));
+	auto stride = size_t(image.get_stride()) * num_channels;
+	auto src = image.data.subspan((size_t(image.origin.y()) * image.get_stride() + image.origin.x()) * num_channels);
+	auto dims = image.dims;
+
+	std::vector<uint8_t> level_pixels;
+	std::vector<uint8_t> next_level_pixels;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	assert_opengl_no_error();
+
+	for (GLint level = 1; dims.x() != 1 || dims.y() != 1; ++level) {
+		dims = downsample(
+			src, //
+			dims,
+			stride,
+			num_channels,
+			next_level_pixels
+		);
+		std::swap(level_pixels, next_level_pixels);
+
+		src = utki::make_span(std::as_const(level_pixels));
+		stride = size_t(dims.x()) * num_channels;
+
+		glTexImage2D(
+			GL_TEXTURE_2D,
+			level,
+			GLint(gl_format), // internal format
+			GLsizei(dims.x()),
+			GLsizei(dims.y()),
+			0, // border, should be 0!
+			gl_format, // format of the texel data
+			GL_UNSIGNED_BYTE, // data type of the texel data
+			level_pixels.data()
+		);
+		assert_opengl_no_error();
+
+		ret += size_t(dims.x()) * size_t(dims.y()) * num_channels;
+	}
+
+	return ret;
+}
+} // namespace
+
+texture_2d::texture_2d(
+	utki::shared_ref<const ruis::render::context> rendering_context, //
+	const image_view& image,
+	ruis::render::context::texture_2d_parameters params
+) :
+	opengl_texture(
+		rendering_context, //
+		GL_TEXTURE_2D
+	),
+	ruis::render::texture_2d(
+		rendering_context, //
+		image.dims
+	)
+{
+	const auto& ctx = this->opengl_context.get();
+
+	this->bind(ctx, 0);
+
+	// Expand unaligned RGB rows to RGBA and convert floats to normalized integers in case float textures
+	// are not supported. The buffer stays empty in case the image is uploaded as is.
+	std::vector<uint8_t> buffer;
+	auto prepared = prepare_for_upload(
+		image, //
+		false,
+		to_float_type(ctx.supported_extensions),
+		buffer
+	);
+
+	this->gl_type = prepared.type;
+
+	GLint format = this->set_swizzeling(
+		prepared.format, //
+		ctx.supported_extensions
+	);
+	this->gl_format = GLenum(format);
+
+	GLint internal_format = to_internal_format(
+		format, //
+		this->gl_type,
+		ctx.supported_extensions
+	);
+
+	glTexImage2D(
+		GL_TEXTURE_2D,
+		0, // 0th level, no mipmaps
+		internal_format, // internal format
+		GLsizei(prepared.dims.x()),
+		GLsizei(prepared.dims.y()),
+		0, // border, should be 0!
+		this->gl_format, // format of the texel data
+		this->gl_type, // data type of the texel data
+		nullptr // texel data is uploaded below
+	);
+	assert_opengl_no_error();
+
+	if (!prepared.data.empty()) {
+		prepared.upload(
+			GL_TEXTURE_2D, //
+			this->gl_format,
+			{0, 0},
+			false
+		);
+		ctx.get_state_cache().get_statistics().texture_bytes_uploaded += prepared.get_size_bytes();
+
+		// The rows are uploaded in memory order, so for top-down images the first texture row
+		// is the top row of the image, while texture coordinates assume the first texture row
+		// to be the bottom row. Flip the texture coordinates instead of the pixels.
+		if (prepared.top_down) {
+			this->tex_rect = {
+				{0, 1},
+				{1, -1}
+			};
+		}
+	}
+
+	if (!prepared.data.empty() && params.mipmap != texture_2d::mipmap::none) {
+		// the box filter kernel works with 8-bit components only
+		if (ctx.is_software_renderer() && prepared.type == GL_UNSIGNED_BYTE) {
+			ctx.get_state_cache().get_statistics().texture_bytes_uploaded += upload_mipmaps(
+				prepared, //
+				this->gl_format
+			);
+		} else {
+			glGenerateMipmap(GL_TEXTURE_2D);
+		}
+	}
+
+	set_texture_parameters(params, params.mipmap);
+
+	auto pixel_size = size_t(rasterimage::to_num_channels(prepared.format)) * to_component_size(this->gl_type);
+	this->mem_usage.size_bytes = calc_size_bytes(
+		prepared.dims, //
+		pixel_size,
+		params.mipmap != texture_2d::mipmap::none
+	);
+	this->mem_usage.uncompressed_size_bytes = this->mem_usage.size_bytes;
+	this->set_census_size(this->mem_usage.size_bytes);
+
+	// the residency manager is only used on the rendering thread
+	if (!ctx.is_loader_thread()) {
+		ctx.get_texture_residency().add(
+			*this, //
+			{
+				.internal_format = internal_format,
+				.format = this->gl_format,
+				.type = this->gl_type,
+				.compressed = false,
+				.dims = prepared.dims,
+				.num_levels = params.mipmap != texture_2d::mipmap::none ? calc_num_levels(prepared.dims) : 1,
+				.size_bytes = this->mem_usage.size_bytes
+			}
+		);
+		this->managed = true;
+	}
+}
+
+texture_2d::texture_2d(
+	utki::shared_ref<const ruis::render::context> rendering_context, //
+	const compressed_image& image,
+	ruis::render::context::texture_2d_parameters params
+) :
+	opengl_texture(
+		rendering_context, //
+		GL_TEXTURE_2D
+	),
+	ruis::render::texture_2d(
+		rendering_context, //
+		image.dims
+	),
+	compressed(true)
+{
+	utki::assert(!image.levels.empty(), SL);
+
+	const auto& ctx = this->opengl_context.get();
+
+	utki::assert(ctx.supported_compressed_formats.get(image.format), SL);
+
+	this->bind(ctx, 0);
+
+	auto internal_format = to_gl_internal_format(image.format);
+	auto uncompressed_pixel_size = size_t(rasterimage::to_num_channels(to_decompressed_format(image.format)));
+
+	auto dims = image.dims;
+	for (size_t level = 0; level != image.levels.size(); ++level) {
+		auto size = calc_compressed_size(image.format, dims);
+		if (image.levels[level].size() < size) {
+			throw std::invalid_argument(
+				"texture_2d::texture_2d(): "
+				"compressed image data is too small"
+			);
+		}
+
+		// compressed blocks are uploaded as is, the OpenGL implementation does not decompress them
+		glCompressedTexImage2D(
+			GL_TEXTURE_2D,
+			GLint(level),
+			internal_format,
+			GLsizei(dims.x()),
+			GLsizei(dims.y()),
+			0, // border, should be 0!
+			GLsizei(size),
+			image.levels[level].data()
+		);
+		assert_opengl_no_error();
+
+		ctx.get_state_cache().get_statistics().texture_bytes_uploaded += size;
+
+		this->mem_usage.size_bytes += size;
+		this->mem_usage.uncompressed_size_bytes += size_t(dims.x()) * size_t(dims.y()) * uncompressed_pixel_size;
+
+		dims = {
+			std::max(dims.x() / 2, uint32_t(1)), //
+			std::max(dims.y() / 2, uint32_t(1))
+		};
+	}
+	this->set_census_size(this->mem_usage.size_bytes);
+
+	// mipmaps cannot be generated for compressed textures, so use only the levels given
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(image.levels.size() - 1));
+	assert_opengl_no_error();
+
+	// blocks cannot be uploaded in reverse order, so flip the texture coordinates for top-down images
+	if (image.top_down) {
+		this->tex_rect = {
+			{0, 1},
+			{1, -1}
+		};
+	}
+
+	set_texture_parameters(
+		params, //
+		image.levels.size() > 1 ? params.mipmap : texture_2d::mipmap::none
+	);
+
+	// the residency manager is only used on the rendering thread
+	if (!ctx.is_loader_thread()) {
+		ctx.get_texture_residency().add(
+			*this, //
+			{
+				.internal_format = GLint(internal_format),
+				.format = 0,
+				.type = 0,
+				.compressed = true,
+				.dims = image.dims,
+				.num_levels = unsigned(image.levels.size()),
+				.size_bytes = this->mem_usage.size_bytes
+			}
+		);
+		this->managed = true;
+	}
+}
+
+texture_2d::texture_2d(
+	utki::shared_ref<const ruis::render::context> rendering_context, //
+	const image_view& image,
+	const ruis::render::context::texture_2d_parameters& params,
+	texture_atlas& atlas
+) :
+	opengl_texture(
+		rendering_context, //
+		GL_TEXTURE_2D,
+		0 // texture object is set by the atlas
+	),
+	ruis::render::texture_2d(
+		rendering_context, //
+		image.dims
+	),
+	atlas(&atlas)
+{
+	atlas.insert(
+		*this, //
+		image,
+		params
+	);
+
+	// the atlas page is counted in the resource census by the atlas
+	this->mem_usage.size_bytes = size_t(image.dims.x()) * size_t(image.dims.y()) * image.get_pixel_size();
+	this->mem_usage.uncompressed_size_bytes = this->mem_usage.size_bytes;
+}
+
+void texture_2d::set_reloader(texture_residency::reloader_type reloader)
+{
+	if (this->compressed) {
+		throw std::logic_error("texture_2d::set_reloader(): compressed textures cannot have reloaders");
+	}
+	if (!this->managed) {
+		return;
+	}
+	this->opengl_context.get().get_texture_residency().set_reloader(
+		*this, //
+		std::move(reloader)
+	);
+}
+
+texture_2d::~texture_2d()
+{
+	if (this->atlas) {
+		this->atlas->remove(*this);
+	}
+	if (this->managed) {
+		this->opengl_context.get().get_texture_residency().remove(*this);
+	}
+}
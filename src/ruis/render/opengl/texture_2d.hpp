@@ -24,20 +24,100 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <ruis/render/context.hpp>
 #include <ruis/render/texture_2d.hpp>
 
+#include "compressed_image.hpp"
+#include "image_view.hpp"
 #include "opengl_texture.hpp"
+#include "texture_residency.hpp"
 
 namespace ruis::render::opengl {
 
+class texture_atlas;
+
 class texture_2d :
 	public opengl_texture, //
 	public ruis::render::texture_2d
 {
 public:
+	struct memory_usage {
+		/**
+		 * @brief Texture memory size in bytes, including mipmap levels.
+		 */
+		size_t size_bytes = 0;
+
+		/**
+		 * @brief Memory size in bytes the texture would take if it was not compressed.
+		 */
+		size_t uncompressed_size_bytes = 0;
+
+		/**
+		 * @brief Get fraction of memory saved by compression.
+		 * @return Value from 0 to 1, 0 means no savings.
+		 */
+		float savings() const noexcept
+		{
+			if (this->uncompressed_size_bytes == 0) {
+				return 0;
+			}
+			return 1 - float(this->size_bytes) / float(this->uncompressed_size_bytes);
+		}
+	};
+
+private:
+	// atlas the texture is placed in, nullptr for standalone texture
+	texture_atlas* const atlas = nullptr;
+
+	// OpenGL format of the texel data
+	GLenum gl_format = 0;
+
+	// OpenGL data type of the texel data components
+	GLenum gl_type = GL_UNSIGNED_BYTE;
+
+	bool compressed = false;
+
+	// whether the texture is managed by the texture residency manager
+	bool managed = false;
+
+	memory_usage mem_usage;
+
+public:
+	/**
+	 * @brief Create texture.
+	 * @param rendering_context - rendering context.
+	 * @param image - texture image. In case image data is empty, the texture contents are undefined.
+	 * @param params - texture parameters.
+	 */
+	texture_2d(
+		utki::shared_ref<const ruis::render::context> rendering_context, //
+		const image_view& image,
+		ruis::render::context::texture_2d_parameters params
+	);
+
+	/**
+	 * @brief Create texture placed in a texture atlas.
+	 * The texture refers to an area of the atlas page texture, see tex_rect.
+	 * @param rendering_context - rendering context.
+	 * @param image - texture image.
+	 * @param params - texture parameters.
+	 * @param atlas - texture atlas to place the texture in.
+	 */
+	texture_2d(
+		utki::shared_ref<const ruis::render::context> rendering_context, //
+		const image_view& image,
+		const ruis::render::context::texture_2d_parameters& params,
+		texture_atlas& atlas
+	);
+
+	/**
+	 * @brief Create texture from block-compressed image.
+	 * The compressed format must be supported by OpenGL implementation, see context::supported_compressed_formats.
+	 * Mipmap levels are taken from the image, in case the image has only the base level the texture has no mipmaps.
+	 * @param rendering_context - rendering context.
+	 * @param image - compressed image.
+	 * @param params - texture parameters.
+	 */
 	texture_2d(
 		utki::shared_ref<const ruis::render::context> rendering_context, //
-		rasterimage::format type,
-		rasterimage::dimensioned::dimensions_type dims,
-		utki::span<const uint8_t> data,
+		const compressed_image& image,
 		ruis::render::context::texture_2d_parameters params
 	);
 
@@ -47,7 +127,57 @@ public:
 	texture_2d(texture_2d&&) = delete;
 	texture_2d& operator=(texture_2d&&) = delete;
 
-	~texture_2d() override = default;
+	~texture_2d() override;
+
+	bool is_in_atlas() const noexcept
+	{
+		return this->atlas != nullptr;
+	}
+
+	/**
+	 * @brief Get OpenGL format of the texel data.
+	 * @return OpenGL format for uploading pixels to the texture.
+	 */
+	GLenum get_gl_format() const noexcept
+	{
+		return this->gl_format;
+	}
+
+	/**
+	 * @brief Get OpenGL data type of the texel data.
+	 * Float images are converted to normalized integers in case float textures are not supported,
+	 * so the data type can differ from the one of the image the texture was created from.
+	 * @return OpenGL data type for uploading pixels to the texture.
+	 */
+	GLenum get_gl_type() const noexcept
+	{
+		return this->gl_type;
+	}
+
+	bool is_compressed() const noexcept
+	{
+		return this->compressed;
+	}
+
+	/**
+	 * @brief Get texture memory usage.
+	 * For textures placed in a texture atlas only the texture area is accounted.
+	 * @return Texture memory usage.
+	 */
+	const memory_usage& get_memory_usage() const noexcept
+	{
+		return this->mem_usage;
+	}
+
+	/**
+	 * @brief Set function loading the texture image from its source.
+	 * In case set, the texture residency manager drops the texture contents on eviction
+	 * instead of reading those back to CPU memory, and loads the image again when the texture is needed.
+	 * Does nothing for textures not managed by the residency manager, e.g. the ones in the texture atlas.
+	 * @param reloader - function loading the texture image, nullptr to read back the contents on eviction.
+	 * @throw std::logic_error - in case the texture is compressed.
+	 */
+	void set_reloader(texture_residency::reloader_type reloader);
 };
 
 } // namespace ruis::render::opengl
@@ -0,0 +1,544 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+#include "texture_atlas.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include <utki/debug.hpp>
+
+#include "texture_2d.hpp"
+#include "util.hpp"
+
+using namespace ruis::render::opengl;
+
+namespace {
+GLint to_gl_filter(ruis::render::texture_2d::filter f)
+{
+	switch (f) {
+		case ruis::render::texture_2d::filter::nearest:
+			return GL_NEAREST;
+		case ruis::render::texture_2d::filter::linear:
+			return GL_LINEAR;
+	}
+	return GL_NEAREST;
+}
+
+size_t area(const r4::rectangle<unsigned>& r)
+{
+	return size_t(r.d.x()) * size_t(r.d.y());
+}
+
+// copy image surrounded by the gutter filled with the image edge pixels
+image_view add_gutter(
+	const image_view& image, //
+	unsigned gutter,
+	std::vector<uint8_t>& buffer
+)
+{
+	auto pixel_size = image.get_pixel_size();
+	auto src_stride = size_t(image.get_stride()) * pixel_size;
+	auto src_row_size = size_t(image.dims.x()) * pixel_size;
+
+	r4::vector2<uint32_t> dims = {image.dims.x() + 2 * gutter, image.dims.y() + 2 * gutter};
+	auto row_size = size_t(dims.x()) * pixel_size;
+
+	buffer.resize(row_size * dims.y());
+
+	auto src = image.data.subspan((size_t(image.origin.y()) * image.get_stride() + image.origin.x()) * pixel_size);
+
+	for (uint32_t y = 0; y != dims.y(); ++y) {
+		auto src_y = std::min(y < gutter ? uint32_t(0) : y - gutter, image.dims.y() - 1);
+		auto src_row = src.subspan(size_t(src_y) * src_stride, src_row_size);
+		auto dst_row = utki::make_span(buffer).subspan(size_t(y) * row_size, row_size);
+
+		auto left = dst_row.subspan(0, size_t(gutter) * pixel_size);
+		auto middle = dst_row.subspan(left.size(), src_row_size);
+		auto right = dst_row.subspan(left.size() + middle.size());
+
+		std::memcpy(middle.data(), src_row.data(), src_row_size);
+		for (unsigned x = 0; x != gutter; ++x) {
+			std::memcpy(left.subspan(size_t(x) * pixel_size).data(), src_row.data(), pixel_size);
+			std::memcpy(
+				right.subspan(size_t(x) * pixel_size).data(),
+				src_row.subspan(src_row_size - pixel_size).data(),
+				pixel_size
+			);
+		}
+	}
+
+	return {
+		.format = image.format,
+		.type = image.type,
+		.dims = dims,
+		.data = utki::make_span(std::as_const(buffer)),
+		.top_down = image.top_down
+	};
+}
+} // namespace
+
+texture_atlas::texture_atlas(
+	state_cache& gl_state, //
+	resource_census& census,
+	const utki::flags<extension>& supported_extensions
+) :
+	gl_state(gl_state),
+	census(census),
+	supported_extensions(supported_extensions)
+{}
+
+texture_atlas::~texture_atlas()
+{
+	for (const auto& p : this->pages) {
+		ASSERT(p->entries.empty())
+		this->delete_page_texture(*p);
+	}
+}
+
+void texture_atlas::delete_page_texture(const page& p)
+{
+	this->gl_state.on_texture_deleted(p.tex);
+	glDeleteTextures(1, &p.tex);
+	assert_opengl_no_error();
+
+	this->census.on_destroyed(
+		resource_kind::texture, //
+		size_t(this->page_size) * size_t(this->page_size) * size_t(rasterimage::to_num_channels(p.format))
+	);
+}
+
+bool texture_atlas::accepts(
+	const image_view& image, //
+	const ruis::render::context::texture_2d_parameters& params
+) const noexcept
+{
+	return this->enabled && //
+		!image.data.empty() && //
+		image.type == GL_UNSIGNED_BYTE && //
+		params.mipmap == ruis::render::texture_2d::mipmap::none && //
+		image.dims.x() != 0 && image.dims.y() != 0 && //
+		image.dims.x() <= max_texture_size && image.dims.y() <= max_texture_size;
+}
+
+GLuint texture_atlas::create_page_texture(page& p)
+{
+	// NOLINTNEXTLINE(cppcoreguidelines-init-variables)
+	GLuint tex;
+	glGenTextures(1, &tex);
+	assert_opengl_no_error();
+
+	this->gl_state.bind_texture(0, GL_TEXTURE_2D, tex);
+
+	p.gl_format = opengl_texture::set_swizzeling(
+		GL_TEXTURE_2D, //
+		p.format,
+		this->supported_extensions
+	);
+
+	// the page is not cleared, as areas outside of the textures and their gutters are never sampled
+	glTexImage2D(
+		GL_TEXTURE_2D,
+		0, // 0th level, no mipmaps
+		p.gl_format, // internal format
+		GLsizei(this->page_size),
+		GLsizei(this->page_size),
+		0, // border, should be 0!
+		GLenum(p.gl_format), // format of the texel data
+		GL_UNSIGNED_BYTE, // data type of the texel data
+		nullptr
+	);
+	assert_opengl_no_error();
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, to_gl_filter(p.min_filter));
+	assert_opengl_no_error();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, to_gl_filter(p.mag_filter));
+	assert_opengl_no_error();
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	assert_opengl_no_error();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	assert_opengl_no_error();
+
+	this->census.on_created(
+		resource_kind::texture, //
+		size_t(this->page_size) * size_t(this->page_size) * size_t(rasterimage::to_num_channels(p.format))
+	);
+
+	return tex;
+}
+
+texture_atlas::page& texture_atlas::add_page(
+	rasterimage::format format, //
+	ruis::render::texture_2d::filter min_filter,
+	ruis::render::texture_2d::filter mag_filter
+)
+{
+	if (this->page_size == 0) {
+		GLint max_size = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+		assert_opengl_no_error();
+
+		this->page_size = std::min(max_page_size, unsigned(max_size));
+		ASSERT(this->page_size >= max_texture_size + 2 * gutter)
+	}
+
+	auto p = std::make_unique<page>();
+	p->format = format;
+	p->min_filter = min_filter;
+	p->mag_filter = mag_filter;
+	p->tex = this->create_page_texture(*p);
+
+	this->pages.push_back(std::move(p));
+	return *this->pages.back();
+}
+
+std::optional<r4::vector2<unsigned>> texture_atlas::place(page& p, r4::vector2<unsigned> dims) const
+{
+	// reuse the smallest fitting area of removed textures
+	auto best = p.free_rects.end();
+	for (auto i = p.free_rects.begin(); i != p.free_rects.end(); ++i) {
+		if (i->d.x() < dims.x() || i->d.y() < dims.y()) {
+			continue;
+		}
+		if (best == p.free_rects.end() || area(*i) < area(*best)) {
+			best = i;
+		}
+	}
+
+	if (best != p.free_rects.end()) {
+		auto r = *best;
+		p.free_rects.erase(best);
+
+		// the rest of the free area is split into two free rectangles
+		r4::rectangle<unsigned> right = {
+			{r.p.x() + dims.x(), r.p.y()},
+			{r.d.x() - dims.x(), dims.y()}
+		};
+		r4::rectangle<unsigned> top = {
+			{r.p.x(), r.p.y() + dims.y()},
+			{r.d.x(), r.d.y() - dims.y()}
+		};
+		for (const auto& fr : {right, top}) {
+			if (area(fr) != 0) {
+				p.free_rects.push_back(fr);
+			}
+		}
+
+		return r.p;
+	}
+
+	auto find_shelf = [&](unsigned max_height) -> shelf* {
+		shelf* ret = nullptr;
+		for (auto& s : p.shelves) {
+			if (s.height < dims.y() || s.height > max_height || s.width + dims.x() > this->page_size) {
+				continue;
+			}
+			if (!ret || s.height < ret->height) {
+				ret = &s;
+			}
+		}
+		return ret;
+	};
+
+	// avoid placing small textures to much taller shelves while there is space for new shelves
+	shelf* s = find_shelf(dims.y() * 2);
+
+	if (!s && p.shelves_height + dims.y() <= this->page_size) {
+		p.shelves.push_back({
+			.y = p.shelves_height, //
+			.height = dims.y(),
+			.width = 0
+		});
+		p.shelves_height += dims.y();
+		s = &p.shelves.back();
+	}
+
+	if (!s) {
+		s = find_shelf(this->page_size);
+	}
+
+	if (!s) {
+		return std::nullopt;
+	}
+
+	r4::vector2<unsigned> pos = {s->width, s->y};
+	s->width += dims.x();
+	return pos;
+}
+
+void texture_atlas::update_texture(const page& p, const entry& e) const
+{
+	auto size = float(this->page_size);
+
+	r4::rectangle<float> r = {
+		{float(e.rect.p.x() + gutter) / size, float(e.rect.p.y() + gutter) / size},
+		{float(e.rect.d.x() - 2 * gutter) / size, float(e.rect.d.y() - 2 * gutter) / size}
+	};
+
+	// texture coordinates assume the first row to be the bottom row of the image
+	if (e.top_down) {
+		r.p.y() += r.d.y();
+		r.d.y() = -r.d.y();
+	}
+
+	e.texture->tex = p.tex;
+	e.texture->tex_rect = r;
+}
+
+void texture_atlas::insert(
+	texture_2d& texture, //
+	const image_view& image,
+	const ruis::render::context::texture_2d_parameters& params
+)
+{
+	ASSERT(this->accepts(image, params))
+
+	auto format = image.format;
+
+	r4::vector2<unsigned> slot_dims = {
+		unsigned(image.dims.x()) + 2 * gutter, //
+		unsigned(image.dims.y()) + 2 * gutter
+	};
+
+	page* p = nullptr;
+	std::optional<r4::vector2<unsigned>> pos;
+
+	for (const auto& pg : this->pages) {
+		if (pg->format != format || //
+			pg->min_filter != params.min_filter || //
+			pg->mag_filter != params.mag_filter)
+		{
+			continue;
+		}
+		pos = this->place(*pg, slot_dims);
+		if (pos.has_value()) {
+			p = pg.get();
+			break;
+		}
+	}
+
+	if (!p) {
+		p = &this->add_page(format, params.min_filter, params.mag_filter);
+		pos = this->place(*p, slot_dims);
+		ASSERT(pos.has_value())
+	}
+
+	p->entries.push_back({
+		.texture = &texture, //
+		.rect = {pos.value(), slot_dims},
+		.top_down = image.top_down
+	});
+	this->update_texture(*p, p->entries.back());
+
+	this->gl_state.bind_texture(0, GL_TEXTURE_2D, p->tex);
+
+	std::vector<uint8_t> buffer;
+	auto slot_image = add_gutter(image, gutter, buffer);
+
+	slot_image.upload(
+		GL_TEXTURE_2D, //
+		GLenum(p->gl_format),
+		pos.value(),
+		false
+	);
+	this->gl_state.get_statistics().texture_bytes_uploaded += slot_image.get_size_bytes();
+}
+
+void texture_atlas::remove(const texture_2d& texture)
+{
+	auto pi = std::find_if(
+		this->pages.begin(), //
+		this->pages.end(),
+		[&](const auto& p) {
+			return p->tex == texture.tex;
+		}
+	);
+	ASSERT(pi != this->pages.end())
+
+	auto& p = **pi;
+
+	auto ei = std::find_if(
+		p.entries.begin(), //
+		p.entries.end(),
+		[&](const auto& e) {
+			return e.texture == &texture;
+		}
+	);
+	ASSERT(ei != p.entries.end())
+
+	p.free_rects.push_back(ei->rect);
+	p.entries.erase(ei);
+	p.repack_failed = false;
+
+	if (!p.entries.empty()) {
+		return;
+	}
+
+	this->delete_page_texture(p);
+
+	this->pages.erase(pi);
+}
+
+void texture_atlas::repack()
+{
+	for (const auto& p : this->pages) {
+		if (p->repack_failed) {
+			continue;
+		}
+
+		size_t free_area = 0;
+		for (const auto& fr : p->free_rects) {
+			free_area += area(fr);
+		}
+
+		if (float(free_area) < repack_threshold * float(size_t(this->page_size) * size_t(this->page_size))) {
+			continue;
+		}
+
+		if (!this->repack(*p)) {
+			p->repack_failed = true;
+			utki::log_debug([&](auto& o) {
+				o << "texture_atlas::repack(): page of format " << unsigned(p->format) << " was not repacked"
+				  << std::endl;
+			});
+		}
+	}
+}
+
+bool texture_atlas::repack(page& p)
+{
+	page packed;
+	packed.format = p.format;
+	packed.min_filter = p.min_filter;
+	packed.mag_filter = p.mag_filter;
+
+	// pack textures into an empty page, tallest first
+	auto entries = p.entries;
+	std::sort(
+		entries.begin(), //
+		entries.end(),
+		[](const auto& a, const auto& b) {
+			return a.rect.d.y() > b.rect.d.y();
+		}
+	);
+
+	for (const auto& e : entries) {
+		auto pos = this->place(packed, e.rect.d);
+		if (!pos.has_value()) {
+			return false;
+		}
+		packed.entries.push_back({
+			.texture = e.texture, //
+			.rect = {pos.value(), e.rect.d},
+			.top_down = e.top_down
+		});
+	}
+
+	packed.tex = this->create_page_texture(packed);
+
+	// copy texture images from the old page texture to the new one on GPU,
+	// the old page texture is read via a framebuffer
+	// NOLINTNEXTLINE(cppcoreguidelines-init-variables)
+	GLuint fbo;
+	glGenFramebuffers(1, &fbo);
+	assert_opengl_no_error();
+
+	auto old_fb = this->gl_state.get_framebuffer();
+	this->gl_state.bind_framebuffer(fbo);
+
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, p.tex, 0);
+	assert_opengl_no_error();
+
+	// textures of luminance formats cannot be framebuffer attachments
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	assert_opengl_no_error();
+
+	if (complete) {
+		this->gl_state.bind_texture(0, GL_TEXTURE_2D, packed.tex);
+
+		for (size_t i = 0; i != entries.size(); ++i) {
+			const auto& from = entries[i].rect;
+			const auto& to = packed.entries[i].rect;
+			glCopyTexSubImage2D(
+				GL_TEXTURE_2D,
+				0, // 0th level, no mipmaps
+				GLint(to.p.x()),
+				GLint(to.p.y()),
+				GLint(from.p.x()),
+				GLint(from.p.y()),
+				GLsizei(from.d.x()), // the gutter is copied along with the texture image
+				GLsizei(from.d.y())
+			);
+			assert_opengl_no_error();
+		}
+	}
+
+	this->gl_state.bind_framebuffer(old_fb);
+
+	this->gl_state.on_framebuffer_deleted(fbo);
+	glDeleteFramebuffers(1, &fbo);
+	assert_opengl_no_error();
+
+	this->delete_page_texture(complete ? p : packed);
+
+	if (!complete) {
+		return false;
+	}
+
+	for (const auto& e : packed.entries) {
+		this->update_texture(packed, e);
+	}
+
+	p = std::move(packed);
+
+	return true;
+}
+
+std::vector<texture_atlas::page_statistics> texture_atlas::get_statistics() const
+{
+	std::vector<page_statistics> ret;
+	ret.reserve(this->pages.size());
+
+	for (const auto& p : this->pages) {
+		size_t used = 0;
+		for (const auto& e : p->entries) {
+			used += size_t(e.rect.d.x() - 2 * gutter) * size_t(e.rect.d.y() - 2 * gutter);
+		}
+
+		size_t packed = 0;
+		for (const auto& s : p->shelves) {
+			packed += size_t(s.width) * size_t(s.height);
+		}
+
+		ASSERT(used <= packed)
+
+		ret.push_back({
+			.format = p->format,
+			.size = this->page_size,
+			.num_textures = p->entries.size(),
+			.used_pixels = used,
+			.wasted_pixels = packed - used
+		});
+	}
+
+	return ret;
+}
@@ -0,0 +1,266 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <GL/glew.h>
+#include <r4/rectangle.hpp>
+#include <rasterimage/image_variant.hpp>
+#include <ruis/render/context.hpp>
+#include <ruis/render/texture_2d.hpp>
+#include <utki/flags.hpp>
+#include <utki/span.hpp>
+
+#include "context.hpp"
+#include "image_view.hpp"
+
+namespace ruis::render::opengl {
+
+class texture_2d;
+
+/**
+ * @brief Packer of small textures into large atlas pages.
+ * Small textures are placed into shared OpenGL textures (pages), so that drawing
+ * many icons or glyphs does not require binding a texture for each of them.
+ * Pages are filled with shelves of rows, areas of removed textures are reused
+ * for new textures. Pages with much unused area can be repacked.
+ * Each page holds textures of the same format and filtering.
+ */
+class texture_atlas
+{
+public:
+	struct page_statistics {
+		rasterimage::format format;
+
+		/**
+		 * @brief Width and height of the page in pixels.
+		 */
+		unsigned size;
+
+		size_t num_textures;
+
+		/**
+		 * @brief Number of pixels occupied by texture images.
+		 */
+		size_t used_pixels;
+
+		/**
+		 * @brief Number of pixels within packed area of the page not occupied by texture images.
+		 * It includes gutters around textures, unused shelf space and areas of removed textures.
+		 */
+		size_t wasted_pixels;
+
+		/**
+		 * @brief Fraction of the page pixels occupied by texture images.
+		 * @return Value from 0 to 1.
+		 */
+		float occupancy() const noexcept
+		{
+			return float(this->used_pixels) / float(size_t(this->size) * size_t(this->size));
+		}
+	};
+
+	/**
+	 * @brief Maximum page width and height in pixels.
+	 * Actual page size can be less in case maximum texture size of OpenGL is less.
+	 */
+	constexpr static const unsigned max_page_size = 1024;
+
+	/**
+	 * @brief Maximum width and height of a texture placed into the atlas.
+	 * Larger textures get dedicated OpenGL textures.
+	 */
+	constexpr static const unsigned max_texture_size = 256;
+
+	/**
+	 * @brief Width of the gutter around each texture in pixels.
+	 * The gutter is filled with the texture edge pixels, so that linear filtering at the texture edges
+	 * neither samples neighbouring textures nor bleeds in transparent pixels.
+	 * One pixel is enough, because mipmapped textures are not placed into the atlas.
+	 */
+	constexpr static const unsigned gutter = 1;
+
+	/**
+	 * @brief Fraction of page area in reusable free rectangles after which the page is repacked.
+	 */
+	constexpr static const float repack_threshold = 0.25f;
+
+private:
+	state_cache& gl_state;
+
+	resource_census& census;
+
+	const utki::flags<extension> supported_extensions;
+
+	bool enabled = true;
+
+	// queried on creation of the first page, because OpenGL context might not be bound before
+	unsigned page_size = 0;
+
+	struct shelf {
+		unsigned y;
+		unsigned height;
+
+		// used width of the shelf
+		unsigned width;
+	};
+
+	struct entry {
+		texture_2d* texture;
+
+		// area allocated for the texture, including the gutter
+		r4::rectangle<unsigned> rect;
+
+		// whether the first row of the area is the top row of the texture image
+		bool top_down;
+	};
+
+	struct page {
+		GLuint tex = 0;
+
+		rasterimage::format format;
+		ruis::render::texture_2d::filter min_filter;
+		ruis::render::texture_2d::filter mag_filter;
+
+		// OpenGL format of texel data
+		GLint gl_format = 0;
+
+		std::vector<shelf> shelves;
+
+		// height of all shelves
+		unsigned shelves_height = 0;
+
+		// areas of removed textures
+		std::vector<r4::rectangle<unsigned>> free_rects;
+
+		std::vector<entry> entries;
+
+		// set when the page could not be repacked, so that it is not retried until more textures are removed
+		bool repack_failed = false;
+	};
+
+	std::vector<std::unique_ptr<page>> pages;
+
+public:
+	/**
+	 * @param gl_state - state cache of the context owning the atlas.
+	 * @param census - resource census of the context owning the atlas, pages are counted in it.
+	 * @param supported_extensions - supported OpenGL extensions.
+	 */
+	texture_atlas(
+		state_cache& gl_state, //
+		resource_census& census,
+		const utki::flags<extension>& supported_extensions
+	);
+
+	texture_atlas(const texture_atlas&) = delete;
+	texture_atlas& operator=(const texture_atlas&) = delete;
+
+	texture_atlas(texture_atlas&&) = delete;
+	texture_atlas& operator=(texture_atlas&&) = delete;
+
+	~texture_atlas();
+
+	bool is_enabled() const noexcept
+	{
+		return this->enabled;
+	}
+
+	/**
+	 * @brief Enable or disable placing new textures into the atlas.
+	 * Textures already in the atlas stay there.
+	 */
+	void set_enabled(bool enable) noexcept
+	{
+		this->enabled = enable;
+	}
+
+	/**
+	 * @brief Check if texture can be placed into the atlas.
+	 * Only small 8-bit textures with initial data and without mipmaps are placed into the atlas.
+	 * @param image - texture image.
+	 * @param params - texture parameters.
+	 * @return true if the texture can be placed into the atlas.
+	 */
+	bool accepts(
+		const image_view& image, //
+		const ruis::render::context::texture_2d_parameters& params
+	) const noexcept;
+
+	/**
+	 * @brief Place texture into the atlas.
+	 * Sets texture object and texture rectangle of the texture.
+	 * Called by the texture_2d constructor.
+	 * @param texture - texture to place.
+	 * @param image - texture image.
+	 * @param params - texture parameters.
+	 */
+	void insert(
+		texture_2d& texture, //
+		const image_view& image,
+		const ruis::render::context::texture_2d_parameters& params
+	);
+
+	/**
+	 * @brief Remove texture from the atlas.
+	 * The area occupied by the texture is reused for new textures.
+	 * Called by the texture_2d destructor.
+	 * @param texture - texture to remove.
+	 */
+	void remove(const texture_2d& texture);
+
+	/**
+	 * @brief Repack pages with much unused area.
+	 * Textures of such pages are packed again and copied to a new page texture on GPU.
+	 * Pages of formats which cannot be attached to a framebuffer are not repacked.
+	 * Supposed to be called periodically, e.g. once in a number of frames.
+	 */
+	void repack();
+
+	size_t get_num_pages() const noexcept
+	{
+		return this->pages.size();
+	}
+
+	std::vector<page_statistics> get_statistics() const;
+
+private:
+	page& add_page(
+		rasterimage::format format, //
+		ruis::render::texture_2d::filter min_filter,
+		ruis::render::texture_2d::filter mag_filter
+	);
+
+	// also update the resource census
+	GLuint create_page_texture(page& p);
+	void delete_page_texture(const page& p);
+
+	std::optional<r4::vector2<unsigned>> place(page& p, r4::vector2<unsigned> dims) const;
+
+	bool repack(page& p);
+
+	void update_texture(const page& p, const entry& e) const;
+};
+
+} // namespace ruis::render::opengl
@@ -27,34 +27,63 @@ using namespace ruis::render::opengl;
 
 texture_cube::texture_cube(
 	utki::shared_ref<const ruis::render::context> rendering_context, //
-	const std::array<cube_face_image, num_cube_faces>& side_images
+	const std::array<image_view, num_cube_faces>& side_images
 ) :
+	opengl_texture(
+		rendering_context, //
+		GL_TEXTURE_CUBE_MAP
+	),
 	ruis::render::texture_cube(rendering_context)
 {
-	this->bind(0);
+	const auto& ctx = this->opengl_context.get();
 
-	utki::assert(dynamic_cast<const opengl::context*>(&rendering_context.get()), SL);
-	auto& opengl_context =
-		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast, "assert(dynamic_cast) done")
-		static_cast<const opengl::context&>(rendering_context.get());
+	this->bind(ctx, 0);
+
+	// cube map faces are not flipped by texture coordinates, so the rows are reversed on CPU,
+	// also unaligned RGB rows are expanded to RGBA and floats are converted to normalized integers if needed
+	std::vector<uint8_t> buffer;
+
+	size_t size_bytes = 0;
 
 	unsigned i = 0;
-	for (const auto& s : side_images) {
+	for (const auto& side_image : side_images) {
+		auto s = prepare_for_upload(
+			side_image, //
+			side_image.top_down,
+			to_float_type(ctx.supported_extensions),
+			buffer
+		);
+
 		auto format = this->set_swizzeling(
-			s.type, //
-			opengl_context.supported_extensions
+			s.format, //
+			ctx.supported_extensions
 		);
 		glTexImage2D( //
 			GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
 			0, // 0th level, no mipmaps
-			format, // internal format
+			to_internal_format(format, s.type, ctx.supported_extensions), // internal format
 			GLsizei(s.dims.x()),
 			GLsizei(s.dims.y()),
 			0, // border, should be 0
 			format, // format of the texel data
-			GL_UNSIGNED_BYTE,
-			s.data.data()
+			s.type,
+			nullptr // texel data is uploaded below
 		);
+		assert_opengl_no_error();
+
+		size_bytes += size_t(s.dims.x()) * size_t(s.dims.y()) * size_t(rasterimage::to_num_channels(s.format)) *
+			to_component_size(s.type);
+
+		if (!s.data.empty()) {
+			s.upload(
+				GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, //
+				GLenum(format),
+				{0, 0},
+				false
+			);
+			ctx.get_state_cache().get_statistics().texture_bytes_uploaded += s.get_size_bytes();
+		}
+
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -62,12 +91,6 @@ texture_cube::texture_cube(
 
 		++i;
 	}
-}
-
-void texture_cube::bind(unsigned unit_num) const
-{
-	this->set_active_texture(unit_num);
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, this->tex);
-	assert_opengl_no_error();
+	this->set_census_size(size_bytes);
 }
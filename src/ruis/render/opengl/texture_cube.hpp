@@ -24,6 +24,7 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <rasterimage/image_variant.hpp>
 #include <ruis/render/texture_cube.hpp>
 
+#include "image_view.hpp"
 #include "opengl_texture.hpp"
 
 namespace ruis::render::opengl {
@@ -33,17 +34,18 @@ class texture_cube :
 	public ruis::render::texture_cube
 {
 public:
-	struct cube_face_image {
-		rasterimage::format type{};
-		rasterimage::dimensioned::dimensions_type dims;
-		utki::span<const uint8_t> data;
-	};
-
 	constexpr static const auto num_cube_faces = 6;
 
+	/**
+	 * @brief Create cube texture.
+	 * Cube map faces are stored with the first row being the bottom row of the image,
+	 * so rows of top-down face images are uploaded in reverse order.
+	 * @param rendering_context - rendering context.
+	 * @param side_images - images of the faces in OpenGL cube map face order.
+	 */
 	texture_cube(
 		utki::shared_ref<const ruis::render::context> rendering_context, //
-		const std::array<cube_face_image, num_cube_faces>& side_images
+		const std::array<image_view, num_cube_faces>& side_images
 	);
 
 	texture_cube(const texture_cube&) = delete;
@@ -53,8 +55,6 @@ public:
 	texture_cube& operator=(texture_cube&&) = delete;
 
 	~texture_cube() override = default;
-
-	void bind(unsigned unit_num) const;
 };
 
 } // namespace ruis::render::opengl
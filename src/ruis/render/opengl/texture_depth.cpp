@@ -29,12 +29,16 @@ texture_depth::texture_depth(
 	utki::shared_ref<const ruis::render::context> rendering_context, //
 	r4::vector2<uint32_t> dims
 ) :
+	opengl_texture(
+		rendering_context, //
+		GL_TEXTURE_2D
+	),
 	ruis::render::texture_depth(
 		std::move(rendering_context), //
 		dims
 	)
 {
-	this->bind(0);
+	this->bind(this->opengl_context.get(), 0);
 
 	glTexImage2D( //
 		GL_TEXTURE_2D,
@@ -57,4 +61,8 @@ texture_depth::texture_depth(
 	assert_opengl_no_error();
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	assert_opengl_no_error();
+
+	// depth textures of unsized format are usually 32 bits per texel
+	constexpr size_t depth_texel_size = 4;
+	this->set_census_size(size_t(dims.x()) * size_t(dims.y()) * depth_texel_size);
 }
\ No newline at end of file
@@ -0,0 +1,411 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "texture_residency.hpp"
+
+#include <algorithm>
+
+#include <utki/debug.hpp>
+
+#include "image_view.hpp"
+#include "opengl_texture.hpp"
+#include "resource_census.hpp"
+#include "state_cache.hpp"
+#include "util.hpp"
+
+using namespace ruis::render::opengl;
+
+namespace {
+size_t to_num_components(GLenum format)
+{
+	switch (format) {
+		default:
+			utki::assert(false, SL);
+		case GL_RED:
+		case GL_LUMINANCE:
+			return 1;
+		case GL_RG:
+		case GL_LUMINANCE_ALPHA:
+			return 2;
+		case GL_RGB:
+			return 3;
+		case GL_RGBA:
+			return 4;
+	}
+}
+
+r4::vector2<uint32_t> next_level_dims(r4::vector2<uint32_t> dims)
+{
+	return {
+		std::max(dims.x() / 2, uint32_t(1)), //
+		std::max(dims.y() / 2, uint32_t(1))
+	};
+}
+} // namespace
+
+texture_residency::texture_residency(
+	state_cache& gl_state, //
+	resource_census& census
+) :
+	gl_state(gl_state),
+	census(census)
+{}
+
+void texture_residency::set_budget(size_t bytes)
+{
+	this->budget = bytes;
+}
+
+void texture_residency::end_frame()
+{
+	this->evict_to_budget();
+	++this->cur_frame;
+}
+
+size_t texture_residency::get_managed_size() const noexcept
+{
+	size_t ret = 0;
+	for (const auto& e : this->lru) {
+		ret += e.info.size_bytes;
+	}
+	return ret;
+}
+
+void texture_residency::add(
+	const opengl_texture& texture, //
+	const texture_info& info
+)
+{
+	utki::assert(texture.target == GL_TEXTURE_2D, SL);
+	utki::assert(info.num_levels != 0, SL);
+	utki::assert(this->entries.find(&texture) == this->entries.end(), SL);
+
+	this->lru.push_front({
+		.texture = &texture,
+		.info = info,
+		.last_bound_frame = this->cur_frame,
+		.num_pins = 0,
+		.resident = true,
+		.reloader = nullptr,
+		.levels = {}
+	});
+	this->entries.insert(std::make_pair(&texture, this->lru.begin()));
+
+	this->resident_size += info.size_bytes;
+}
+
+void texture_residency::remove(const opengl_texture& texture)
+{
+	auto i = this->entries.find(&texture);
+	if (i == this->entries.end()) {
+		return;
+	}
+
+	auto& e = *i->second;
+	if (e.resident) {
+		this->resident_size -= e.info.size_bytes;
+	} else {
+		// the texture accounts its whole size in the census on destruction
+		this->census.on_resized(resource_kind::texture, 0, e.info.size_bytes);
+	}
+
+	this->lru.erase(i->second);
+	this->entries.erase(i);
+}
+
+void texture_residency::set_reloader(
+	const opengl_texture& texture, //
+	reloader_type reloader
+)
+{
+	auto i = this->entries.find(&texture);
+	if (i == this->entries.end()) {
+		return;
+	}
+
+	auto& e = *i->second;
+	utki::assert(!e.info.compressed, SL);
+
+	// evicted texture without read back contents can only be restored by the old reloader
+	if (!reloader && !e.resident && e.levels.empty()) {
+		this->restore(e);
+	}
+
+	// read back contents of evicted texture are kept, the reloader is used starting from the next eviction
+	e.reloader = std::move(reloader);
+}
+
+void texture_residency::pin(const opengl_texture& texture)
+{
+	auto i = this->entries.find(&texture);
+	if (i == this->entries.end()) {
+		return;
+	}
+
+	auto& e = *i->second;
+	++e.num_pins;
+
+	// pinned texture has to have its storage
+	if (!e.resident) {
+		this->restore(e);
+	}
+}
+
+void texture_residency::unpin(const opengl_texture& texture)
+{
+	auto i = this->entries.find(&texture);
+	if (i == this->entries.end()) {
+		return;
+	}
+
+	auto& e = *i->second;
+	utki::assert(e.num_pins != 0, SL);
+	--e.num_pins;
+}
+
+void texture_residency::on_bind(const opengl_texture& texture)
+{
+	auto i = this->entries.find(&texture);
+	if (i == this->entries.end()) {
+		return;
+	}
+
+	// move to the front of the least recently bound list
+	this->lru.splice(this->lru.begin(), this->lru, i->second);
+
+	auto& e = *i->second;
+	e.last_bound_frame = this->cur_frame;
+
+	if (!e.resident) {
+		this->restore(e);
+	}
+}
+
+void texture_residency::evict_to_budget()
+{
+	// evict least recently bound textures first
+	for (auto i = this->lru.rbegin(); i != this->lru.rend() && this->resident_size > this->budget; ++i) {
+		auto& e = *i;
+
+		// textures are sorted by the frame they were bound last,
+		// so all the rest of textures are bound during the current frame as well
+		if (e.last_bound_frame == this->cur_frame) {
+			break;
+		}
+
+		if (!e.resident || e.num_pins != 0) {
+			continue;
+		}
+
+		this->evict(e);
+	}
+}
+
+void texture_residency::evict(entry& e)
+{
+	ASSERT(e.resident)
+
+	const auto& info = e.info;
+
+	this->gl_state.bind_texture(0, GL_TEXTURE_2D, e.texture->tex);
+
+	// the contents of the texture with reloader are dropped
+	if (!e.reloader) {
+		this->read_back(e);
+	}
+
+	// Release the storage by re-specifying all levels as empty. The texture object itself
+	// is kept, so that its name and parameters stay valid for whoever refers to it.
+	for (unsigned level = 0; level != info.num_levels; ++level) {
+		glTexImage2D(
+			GL_TEXTURE_2D,
+			GLint(level),
+			GL_RGBA, // internal format
+			0, // width
+			0, // height
+			0, // border, should be 0!
+			GL_RGBA, // format of the texel data
+			GL_UNSIGNED_BYTE, // data type of the texel data
+			nullptr
+		);
+		assert_opengl_no_error();
+	}
+
+	e.resident = false;
+	this->resident_size -= info.size_bytes;
+	this->census.on_resized(resource_kind::texture, info.size_bytes, 0);
+
+	++this->stats.num_evictions;
+	this->stats.bytes_evicted += info.size_bytes;
+
+	utki::log_debug([&](auto& o) {
+		o << "texture_residency::evict(): texture " << e.texture->tex << " of " << info.size_bytes
+		  << " bytes evicted, resident size = " << this->resident_size << std::endl;
+	});
+}
+
+void texture_residency::read_back(entry& e)
+{
+	const auto& info = e.info;
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	assert_opengl_no_error();
+
+	e.levels.resize(info.num_levels);
+
+	auto dims = info.dims;
+	for (unsigned level = 0; level != info.num_levels; ++level) {
+		auto& data = e.levels[level];
+
+		if (info.compressed) {
+			// NOLINTNEXTLINE(cppcoreguidelines-init-variables, "initialized via output argument")
+			GLint size;
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, GLint(level), GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+			assert_opengl_no_error();
+
+			data.resize(size_t(size));
+			glGetCompressedTexImage(GL_TEXTURE_2D, GLint(level), data.data());
+			assert_opengl_no_error();
+		} else {
+			data.resize(
+				size_t(dims.x()) * size_t(dims.y()) * to_num_components(info.format) * to_component_size(info.type)
+			);
+			glGetTexImage(GL_TEXTURE_2D, GLint(level), info.format, info.type, data.data());
+			assert_opengl_no_error();
+		}
+
+		dims = next_level_dims(dims);
+	}
+}
+
+void texture_residency::restore(entry& e)
+{
+	ASSERT(!e.resident)
+
+	const auto& info = e.info;
+
+	this->gl_state.bind_texture(0, GL_TEXTURE_2D, e.texture->tex);
+
+	if (e.levels.empty()) {
+		ASSERT(e.reloader)
+		this->reload(e);
+	} else {
+		this->restore_levels(e);
+	}
+
+	e.resident = true;
+
+	this->gl_state.get_statistics().texture_bytes_uploaded += info.size_bytes;
+
+	this->resident_size += info.size_bytes;
+	this->census.on_resized(resource_kind::texture, 0, info.size_bytes);
+
+	++this->stats.num_restores;
+	this->stats.bytes_restored += info.size_bytes;
+}
+
+void texture_residency::reload(const entry& e)
+{
+	const auto& info = e.info;
+
+	auto image = e.reloader();
+	auto view = make_image_view(image);
+	utki::assert(view.dims == info.dims, SL);
+
+	// convert the image the same way it was converted when the texture was created
+	std::vector<uint8_t> buffer;
+	auto prepared = prepare_for_upload(
+		view, //
+		false,
+		info.type,
+		buffer
+	);
+	utki::assert(prepared.type == info.type, SL);
+
+	glTexImage2D(
+		GL_TEXTURE_2D,
+		0, // 0th level
+		info.internal_format,
+		GLsizei(info.dims.x()),
+		GLsizei(info.dims.y()),
+		0, // border, should be 0!
+		info.format, // format of the texel data
+		info.type, // data type of the texel data
+		nullptr // texel data is uploaded below
+	);
+	assert_opengl_no_error();
+
+	prepared.upload(
+		GL_TEXTURE_2D, //
+		info.format,
+		{0, 0},
+		false
+	);
+
+	if (info.num_levels > 1) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+		assert_opengl_no_error();
+	}
+}
+
+void texture_residency::restore_levels(entry& e)
+{
+	const auto& info = e.info;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	assert_opengl_no_error();
+
+	auto dims = info.dims;
+	for (unsigned level = 0; level != info.num_levels; ++level) {
+		const auto& data = e.levels[level];
+
+		if (info.compressed) {
+			glCompressedTexImage2D(
+				GL_TEXTURE_2D,
+				GLint(level),
+				GLenum(info.internal_format),
+				GLsizei(dims.x()),
+				GLsizei(dims.y()),
+				0, // border, should be 0!
+				GLsizei(data.size()),
+				data.data()
+			);
+			assert_opengl_no_error();
+		} else {
+			glTexImage2D(
+				GL_TEXTURE_2D,
+				GLint(level),
+				info.internal_format,
+				GLsizei(dims.x()),
+				GLsizei(dims.y()),
+				0, // border, should be 0!
+				info.format, // format of the texel data
+				info.type, // data type of the texel data
+				data.data()
+			);
+			assert_opengl_no_error();
+		}
+
+		dims = next_level_dims(dims);
+	}
+
+	e.levels.clear();
+}
@@ -0,0 +1,270 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+#include <r4/vector.hpp>
+#include <rasterimage/image_variant.hpp>
+
+namespace ruis::render::opengl {
+
+class resource_census;
+class state_cache;
+struct opengl_texture;
+
+/**
+ * @brief Residency manager of texture memory.
+ * Accounts texture memory of managed textures and keeps it within the budget by evicting
+ * least recently bound textures at the end of each frame, so that no eviction happens while drawing.
+ * Contents of an evicted texture are dropped in case the texture has a reloader, which loads
+ * the texture image from its source again. Otherwise the contents are read back to CPU memory,
+ * compressed textures are read back as compressed blocks. Then the OpenGL storage of the texture
+ * is released. The contents are uploaded back when the texture is bound next time.
+ * Textures bound during the current frame are never evicted, so the budget can be exceeded
+ * in case those do not fit into it.
+ */
+class texture_residency
+{
+public:
+	struct statistics {
+		size_t num_evictions = 0;
+
+		/**
+		 * @brief Total size of evicted textures in bytes.
+		 */
+		size_t bytes_evicted = 0;
+
+		size_t num_restores = 0;
+
+		/**
+		 * @brief Total size of re-uploaded textures in bytes.
+		 */
+		size_t bytes_restored = 0;
+	};
+
+	/**
+	 * @brief Texture storage description needed to restore evicted texture.
+	 */
+	struct texture_info {
+		/**
+		 * @brief OpenGL internal format of the texture.
+		 */
+		GLint internal_format;
+
+		/**
+		 * @brief OpenGL format of the texel data. Ignored for compressed textures.
+		 */
+		GLenum format;
+
+		/**
+		 * @brief OpenGL data type of the texel data. Ignored for compressed textures.
+		 */
+		GLenum type;
+
+		bool compressed;
+
+		r4::vector2<uint32_t> dims;
+
+		/**
+		 * @brief Number of mipmap levels, including the base level.
+		 */
+		unsigned num_levels;
+
+		/**
+		 * @brief Texture memory size in bytes, including mipmap levels.
+		 */
+		size_t size_bytes;
+	};
+
+	/**
+	 * @brief Function loading the texture image from its source.
+	 * The image has to be the same as the one the texture was created from.
+	 */
+	using reloader_type = std::function<rasterimage::image_variant()>;
+
+	constexpr static const size_t unlimited_budget = std::numeric_limits<size_t>::max();
+
+private:
+	state_cache& gl_state;
+
+	resource_census& census;
+
+	size_t budget = unlimited_budget;
+
+	// size of the textures which currently have OpenGL storage
+	size_t resident_size = 0;
+
+	uint64_t cur_frame = 0;
+
+	struct entry {
+		const opengl_texture* texture;
+		texture_info info;
+
+		uint64_t last_bound_frame;
+
+		// textures attached to a frame buffer or being uploaded cannot be evicted
+		unsigned num_pins = 0;
+
+		bool resident = true;
+
+		reloader_type reloader;
+
+		// contents of the mipmap levels read back on eviction, empty for textures with reloader
+		std::vector<std::vector<uint8_t>> levels;
+	};
+
+	// most recently bound textures go first
+	std::list<entry> lru;
+
+	std::unordered_map<const opengl_texture*, std::list<entry>::iterator> entries;
+
+	statistics stats;
+
+public:
+	/**
+	 * @param gl_state - state cache of the context owning the residency manager.
+	 * @param census - resource census of the context owning the residency manager.
+	 *                 Evicted textures are accounted in it with zero size.
+	 */
+	texture_residency(
+		state_cache& gl_state, //
+		resource_census& census
+	);
+
+	texture_residency(const texture_residency&) = delete;
+	texture_residency& operator=(const texture_residency&) = delete;
+
+	texture_residency(texture_residency&&) = delete;
+	texture_residency& operator=(texture_residency&&) = delete;
+
+	~texture_residency() = default;
+
+	/**
+	 * @brief Set texture memory budget.
+	 * Textures are evicted at the end of the frame in case the resident ones do not fit into the new budget.
+	 * @param bytes - budget in bytes, unlimited_budget to disable eviction.
+	 */
+	void set_budget(size_t bytes);
+
+	size_t get_budget() const noexcept
+	{
+		return this->budget;
+	}
+
+	/**
+	 * @brief Get size of resident textures.
+	 * @return Size in bytes of managed textures which currently have OpenGL storage.
+	 */
+	size_t get_resident_size() const noexcept
+	{
+		return this->resident_size;
+	}
+
+	/**
+	 * @brief Get total size of managed textures.
+	 * @return Size in bytes of all managed textures, both resident and evicted.
+	 */
+	size_t get_managed_size() const noexcept;
+
+	const statistics& get_statistics() const noexcept
+	{
+		return this->stats;
+	}
+
+	/**
+	 * @brief Start managing texture.
+	 * The texture must be a GL_TEXTURE_2D texture with complete contents.
+	 * @param texture - texture to manage.
+	 * @param info - storage description of the texture.
+	 */
+	void add(
+		const opengl_texture& texture, //
+		const texture_info& info
+	);
+
+	/**
+	 * @brief Stop managing texture.
+	 * Does nothing in case the texture is not managed.
+	 * @param texture - texture to stop managing.
+	 */
+	void remove(const opengl_texture& texture);
+
+	/**
+	 * @brief Set reloader of the texture.
+	 * Contents of the texture with reloader are not read back on eviction, the texture image
+	 * is loaded and uploaded again instead, mipmaps are generated in case the texture has those.
+	 * Only uncompressed textures can have reloaders.
+	 * Does nothing in case the texture is not managed.
+	 * @param texture - texture to set the reloader to.
+	 * @param reloader - function loading the texture image, nullptr to read back the contents on eviction.
+	 */
+	void set_reloader(
+		const opengl_texture& texture, //
+		reloader_type reloader
+	);
+
+	/**
+	 * @brief Prevent texture from eviction.
+	 * Pins are counted, each pin() has to be matched by unpin().
+	 * Does nothing in case the texture is not managed.
+	 * @param texture - texture to pin.
+	 */
+	void pin(const opengl_texture& texture);
+
+	void unpin(const opengl_texture& texture);
+
+	/**
+	 * @brief Mark texture as used in the current frame.
+	 * Uploads contents of the texture in case it was evicted.
+	 * Must be called before binding the texture.
+	 * Does nothing in case the texture is not managed.
+	 * @param texture - texture which is going to be bound.
+	 */
+	void on_bind(const opengl_texture& texture);
+
+	/**
+	 * @brief Evict textures in case those do not fit into the budget and advance frame.
+	 * Must be called once per frame, context::end_frame() does that for the residency manager of the context.
+	 */
+	void end_frame();
+
+private:
+	void evict_to_budget();
+
+	void evict(entry& e);
+	void read_back(entry& e);
+
+	void restore(entry& e);
+
+	void reload(const entry& e);
+	void restore_levels(entry& e);
+};
+
+} // namespace ruis::render::opengl
@@ -0,0 +1,415 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+#include "texture_uploader.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <utki/debug.hpp>
+
+#include "resource_census.hpp"
+#include "texture_2d.hpp"
+#include "texture_residency.hpp"
+#include "util.hpp"
+
+using namespace ruis::render::opengl;
+
+namespace {
+// 1 second, in nanoseconds
+constexpr const GLuint64 fence_wait_timeout = 1000000000;
+} // namespace
+
+texture_upload::texture_upload(
+	utki::shared_ref<texture_2d> texture, //
+	rasterimage::image_variant&& image,
+	bool generate_mipmap
+) :
+	image(std::move(image)),
+	view(make_image_view(this->image)),
+	texture(std::move(texture)),
+	generate_mipmap(generate_mipmap)
+{
+	utki::assert(!this->texture.get().is_in_atlas(), SL);
+	utki::assert(this->view.dims.x() != 0 && this->view.dims.y() != 0, SL);
+}
+
+utki::shared_ref<ruis::render::texture_2d> texture_upload::get_texture() const noexcept
+{
+	return this->texture;
+}
+
+size_t texture_upload::get_size_bytes() const noexcept
+{
+	// the pixels are staged in the texture data type, which can differ from the image one
+	return size_t(this->view.dims.x()) * size_t(this->view.dims.y()) *
+		size_t(rasterimage::to_num_channels(this->view.format)) * to_component_size(this->texture.get().get_gl_type());
+}
+
+texture_uploader::texture_uploader(
+	state_cache& gl_state, //
+	resource_census& census,
+	bool async_supported
+) :
+	gl_state(gl_state),
+	census(census),
+	async_supported(async_supported)
+{}
+
+texture_uploader::~texture_uploader()
+{
+	// pending uploads keep the context alive through their textures
+	ASSERT(this->uploads.empty())
+
+	for (const auto& pb : this->pool) {
+		glDeleteBuffers(1, &pb.buffer);
+		assert_opengl_no_error();
+		this->census.on_destroyed(resource_kind::buffer, pb.size);
+	}
+}
+
+texture_uploader::pixel_buffer texture_uploader::acquire(size_t size)
+{
+	// take the smallest pooled buffer which is large enough
+	auto best = this->pool.end();
+	for (auto i = this->pool.begin(); i != this->pool.end(); ++i) {
+		if (i->size < size) {
+			continue;
+		}
+		if (best == this->pool.end() || i->size < best->size) {
+			best = i;
+		}
+	}
+
+	if (best != this->pool.end()) {
+		auto ret = *best;
+		this->pool.erase(best);
+		return ret;
+	}
+
+	pixel_buffer ret{0, size};
+	glGenBuffers(1, &ret.buffer);
+	assert_opengl_no_error();
+
+	// the storage is allocated when staging, each time with the same size
+	this->census.on_created(resource_kind::buffer, size);
+
+	return ret;
+}
+
+void texture_uploader::release(pixel_buffer pb)
+{
+	size_t pool_size = 0;
+	for (const auto& b : this->pool) {
+		pool_size += b.size;
+	}
+
+	if (pool_size + pb.size > max_pool_size) {
+		glDeleteBuffers(1, &pb.buffer);
+		assert_opengl_no_error();
+		this->census.on_destroyed(resource_kind::buffer, pb.size);
+		return;
+	}
+
+	this->pool.push_back(pb);
+}
+
+utki::shared_ref<texture_upload> texture_uploader::upload(
+	utki::shared_ref<texture_2d> texture, //
+	rasterimage::image_variant&& image,
+	bool generate_mipmap
+)
+{
+	auto u = utki::make_shared<texture_upload>(
+		std::move(texture), //
+		std::move(image),
+		generate_mipmap
+	);
+
+	u.get().start_time = std::chrono::steady_clock::now();
+
+	// the texture must not be evicted while its contents are being uploaded
+	auto& tex = u.get().texture.get();
+	tex.opengl_context.get().get_texture_residency().pin(tex);
+
+	if (!this->async_supported) {
+		this->upload_sync(u.get());
+		return u;
+	}
+
+	this->uploads.push_back(u);
+	return u;
+}
+
+void texture_uploader::upload_sync(texture_upload& u)
+{
+	auto& tex = u.texture.get();
+
+	this->gl_state.bind_texture(0, GL_TEXTURE_2D, tex.tex);
+
+	// convert floats in case the texture is not a float one
+	std::vector<uint8_t> buffer;
+	auto prepared = u.view;
+	if (u.view.type != tex.get_gl_type()) {
+		prepared = prepare_for_upload(
+			u.view, //
+			false,
+			tex.get_gl_type(),
+			buffer
+		);
+	}
+	ASSERT(prepared.type == tex.get_gl_type())
+
+	prepared.upload(
+		GL_TEXTURE_2D, //
+		tex.get_gl_format(),
+		{0, 0},
+		false
+	);
+	this->gl_state.get_statistics().texture_bytes_uploaded += prepared.get_size_bytes();
+
+	if (u.generate_mipmap) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+		assert_opengl_no_error();
+	}
+
+	this->on_ready(u);
+}
+
+size_t texture_uploader::stage(texture_upload& u, size_t budget)
+{
+	ASSERT(u.cur_state == texture_upload::state::staging)
+
+	if (u.mapped.empty()) {
+		auto pb = this->acquire(u.get_size_bytes());
+		u.pbo = pb.buffer;
+		u.pbo_size = pb.size;
+
+		// Pixel unpack buffer binding is not tracked by the state cache,
+		// it is always unbound right away, because pixel uploads from client memory
+		// require no pixel unpack buffer to be bound.
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, u.pbo);
+		assert_opengl_no_error();
+
+		// orphan the old storage, so that mapping does not wait for the previous upload from the buffer
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(u.pbo_size), nullptr, GL_STREAM_DRAW);
+		assert_opengl_no_error();
+
+		void* ptr = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+		assert_opengl_no_error();
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		assert_opengl_no_error();
+
+		if (!ptr) {
+			throw std::runtime_error("texture_uploader: glMapBuffer() failed");
+		}
+
+		u.mapped = utki::make_span(static_cast<uint8_t*>(ptr), u.get_size_bytes());
+	}
+
+	const auto& v = u.view;
+
+	auto pixel_size = v.get_pixel_size();
+	auto src_row_size = size_t(v.dims.x()) * pixel_size;
+	auto stride = size_t(v.get_stride()) * pixel_size;
+
+	// float images are staged in the texture data type in case the texture is not a float one
+	auto gl_type = u.texture.get().get_gl_type();
+	bool convert = v.type == GL_FLOAT && gl_type != GL_FLOAT;
+	auto row_size = convert ? src_row_size / sizeof(float) * to_component_size(gl_type) : src_row_size;
+
+	// stage at least one row to make progress
+	auto num_rows = std::max(budget / row_size, size_t(1));
+	num_rows = std::min(num_rows, size_t(v.dims.y() - u.num_staged_rows));
+
+	// the rows are staged tightly packed in memory order
+	for (size_t i = 0; i != num_rows; ++i) {
+		auto r = size_t(u.num_staged_rows) + i;
+		auto src = v.data.subspan((size_t(v.origin.y()) + r) * stride + size_t(v.origin.x()) * pixel_size, src_row_size);
+		auto dst = u.mapped.subspan(r * row_size, row_size);
+		if (convert) {
+			convert_floats(src, gl_type, dst);
+		} else {
+			std::memcpy(dst.data(), src.data(), row_size);
+		}
+	}
+
+	u.num_staged_rows += uint32_t(num_rows);
+
+	return num_rows * row_size;
+}
+
+void texture_uploader::submit(texture_upload& u)
+{
+	ASSERT(u.cur_state == texture_upload::state::staging)
+	ASSERT(u.num_staged_rows == u.view.dims.y())
+
+	auto& tex = u.texture.get();
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, u.pbo);
+	assert_opengl_no_error();
+
+	auto unmapped = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	assert_opengl_no_error();
+	u.mapped = {};
+
+	if (unmapped == GL_FALSE) {
+		// the buffer contents were lost, e.g. due to screen mode change, stage the pixels again
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		assert_opengl_no_error();
+		this->release({u.pbo, u.pbo_size});
+		u.pbo = 0;
+		u.num_staged_rows = 0;
+		return;
+	}
+
+	this->gl_state.bind_texture(0, GL_TEXTURE_2D, tex.tex);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	assert_opengl_no_error();
+
+	glTexSubImage2D(
+		GL_TEXTURE_2D,
+		0, // 0th level, no mipmaps
+		0,
+		0,
+		GLsizei(u.view.dims.x()),
+		GLsizei(u.view.dims.y()),
+		tex.get_gl_format(), // format of the texel data
+		tex.get_gl_type(), // data type of the texel data
+		nullptr // offset within the pixel unpack buffer
+	);
+	assert_opengl_no_error();
+	this->gl_state.get_statistics().texture_bytes_uploaded += u.get_size_bytes();
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	assert_opengl_no_error();
+
+	if (u.generate_mipmap) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+		assert_opengl_no_error();
+	}
+
+	u.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	assert_opengl_no_error();
+
+	u.cur_state = texture_upload::state::in_flight;
+}
+
+bool texture_uploader::poll(texture_upload& u, bool wait)
+{
+	ASSERT(u.cur_state == texture_upload::state::in_flight)
+
+	auto res = glClientWaitSync(u.sync, 0, 0);
+	if (res == GL_TIMEOUT_EXPIRED) {
+		if (!wait) {
+			return false;
+		}
+		do {
+			res = glClientWaitSync(u.sync, GL_SYNC_FLUSH_COMMANDS_BIT, fence_wait_timeout);
+		} while (res == GL_TIMEOUT_EXPIRED);
+	}
+	utki::assert(res != GL_WAIT_FAILED, SL);
+
+	glDeleteSync(u.sync);
+	u.sync = nullptr;
+
+	this->release({u.pbo, u.pbo_size});
+	u.pbo = 0;
+
+	this->on_ready(u);
+	return true;
+}
+
+void texture_uploader::on_ready(texture_upload& u)
+{
+	u.cur_state = texture_upload::state::ready;
+	u.upload_time = std::chrono::steady_clock::now() - u.start_time;
+
+	auto& tex = u.texture.get();
+	tex.opengl_context.get().get_texture_residency().unpin(tex);
+
+	++this->stats.num_uploads;
+	this->stats.bytes_uploaded += u.get_size_bytes();
+	this->stats.upload_time += u.upload_time;
+	this->stats.total_frames_in_flight += u.num_frames_in_flight;
+	this->stats.max_frames_in_flight = std::max(this->stats.max_frames_in_flight, u.num_frames_in_flight);
+}
+
+void texture_uploader::end_frame()
+{
+	auto budget = this->staging_budget;
+
+	for (auto& up : this->uploads) {
+		auto& u = up.get();
+		switch (u.cur_state) {
+			case texture_upload::state::staging:
+				if (budget == 0) {
+					break;
+				}
+				budget -= std::min(budget, this->stage(u, budget));
+				if (u.num_staged_rows == u.view.dims.y()) {
+					this->submit(u);
+				}
+				break;
+			case texture_upload::state::in_flight:
+				++u.num_frames_in_flight;
+				this->poll(u, false);
+				break;
+			case texture_upload::state::ready:
+				break;
+		}
+	}
+
+	this->uploads.erase(
+		std::remove_if(
+			this->uploads.begin(), //
+			this->uploads.end(),
+			[](const auto& u) {
+				return u.get().is_ready();
+			}
+		),
+		this->uploads.end()
+	);
+}
+
+void texture_uploader::wait(texture_upload& u)
+{
+	while (u.cur_state == texture_upload::state::staging) {
+		this->stage(u, u.get_size_bytes());
+		this->submit(u);
+	}
+
+	if (u.cur_state == texture_upload::state::in_flight) {
+		this->poll(u, true);
+	}
+
+	this->uploads.erase(
+		std::remove_if(
+			this->uploads.begin(), //
+			this->uploads.end(),
+			[&](const auto& up) {
+				return &up.get() == &u;
+			}
+		),
+		this->uploads.end()
+	);
+}
@@ -0,0 +1,304 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include <GL/glew.h>
+#include <rasterimage/image_variant.hpp>
+#include <ruis/render/context.hpp>
+#include <utki/shared_ref.hpp>
+#include <utki/span.hpp>
+
+#include "image_view.hpp"
+
+namespace ruis::render::opengl {
+
+class resource_census;
+class state_cache;
+class texture_2d;
+
+/**
+ * @brief Handle of asynchronous texture upload.
+ * The texture is created right away, but its contents are undefined until the upload is ready.
+ */
+class texture_upload
+{
+	friend class texture_uploader;
+
+	// keeps the pixels alive until they are staged
+	const rasterimage::image_variant image;
+	const image_view view;
+
+	const utki::shared_ref<texture_2d> texture;
+
+	const bool generate_mipmap;
+
+	enum class state {
+		staging,
+		in_flight,
+		ready
+	};
+
+	state cur_state = state::staging;
+
+	// pixel buffer object the pixels are staged in, 0 if not acquired yet
+	GLuint pbo = 0;
+	size_t pbo_size = 0;
+
+	// mapped memory of the pixel buffer object
+	utki::span<uint8_t> mapped;
+
+	uint32_t num_staged_rows = 0;
+
+	// fence after the upload command, nullptr if not submitted yet
+	GLsync sync = nullptr;
+
+	unsigned num_frames_in_flight = 0;
+
+	std::chrono::steady_clock::time_point start_time;
+	std::chrono::steady_clock::duration upload_time{0};
+
+public:
+	texture_upload(
+		utki::shared_ref<texture_2d> texture, //
+		rasterimage::image_variant&& image,
+		bool generate_mipmap
+	);
+
+	texture_upload(const texture_upload&) = delete;
+	texture_upload& operator=(const texture_upload&) = delete;
+
+	texture_upload(texture_upload&&) = delete;
+	texture_upload& operator=(texture_upload&&) = delete;
+
+	~texture_upload() = default;
+
+	/**
+	 * @brief Check if the texture is ready to be used.
+	 * @return true if the texture contents are uploaded.
+	 */
+	bool is_ready() const noexcept
+	{
+		return this->cur_state == state::ready;
+	}
+
+	/**
+	 * @brief Get the texture being uploaded.
+	 * The texture can be used for rendering only after the upload is ready.
+	 * @return The texture.
+	 */
+	utki::shared_ref<ruis::render::texture_2d> get_texture() const noexcept;
+
+	/**
+	 * @brief Get size of the uploaded pixel data.
+	 * @return Size in bytes.
+	 */
+	size_t get_size_bytes() const noexcept;
+
+	/**
+	 * @brief Get number of frames the upload was in flight.
+	 * Counts frames between submitting the upload to OpenGL and detecting its completion.
+	 * @return Number of frames.
+	 */
+	unsigned get_num_frames_in_flight() const noexcept
+	{
+		return this->num_frames_in_flight;
+	}
+
+	/**
+	 * @brief Get time from the start of staging till the upload was detected to be complete.
+	 * @return Upload time.
+	 */
+	std::chrono::steady_clock::duration get_upload_time() const noexcept
+	{
+		return this->upload_time;
+	}
+};
+
+/**
+ * @brief Uploader of texture contents through pixel buffer objects.
+ * Pixels are copied to a mapped pixel buffer object incrementally, a limited number of bytes
+ * per frame, then the texture contents are uploaded from the pixel buffer object and
+ * completion of the upload is tracked with a fence. This way uploading large images
+ * does not stall the frame while the driver copies the pixels.
+ * Pixel buffer objects are pooled and reused for next uploads.
+ * In case pixel buffer objects or sync objects are not supported, textures are uploaded
+ * synchronously and the uploads are ready right away.
+ */
+class texture_uploader
+{
+public:
+	struct statistics {
+		size_t num_uploads = 0;
+
+		/**
+		 * @brief Total size of uploaded pixel data in bytes.
+		 */
+		size_t bytes_uploaded = 0;
+
+		/**
+		 * @brief Total time of all uploads, from the start of staging till detected completion.
+		 */
+		std::chrono::steady_clock::duration upload_time{0};
+
+		size_t total_frames_in_flight = 0;
+
+		unsigned max_frames_in_flight = 0;
+
+		/**
+		 * @brief Upload bandwidth.
+		 * @return Bytes per second.
+		 */
+		double bandwidth() const noexcept
+		{
+			auto seconds = std::chrono::duration<double>(this->upload_time).count();
+			if (seconds == 0) {
+				return 0;
+			}
+			return double(this->bytes_uploaded) / seconds;
+		}
+
+		float average_frames_in_flight() const noexcept
+		{
+			if (this->num_uploads == 0) {
+				return 0;
+			}
+			return float(this->total_frames_in_flight) / float(this->num_uploads);
+		}
+	};
+
+	/**
+	 * @brief Default number of bytes staged per frame.
+	 */
+	constexpr static const size_t default_staging_budget = size_t(16) * 1024 * 1024;
+
+	/**
+	 * @brief Maximum total size of pooled pixel buffer objects in bytes.
+	 */
+	constexpr static const size_t max_pool_size = size_t(64) * 1024 * 1024;
+
+private:
+	state_cache& gl_state;
+
+	resource_census& census;
+
+	const bool async_supported;
+
+	size_t staging_budget = default_staging_budget;
+
+	struct pixel_buffer {
+		GLuint buffer;
+		size_t size;
+	};
+
+	std::vector<pixel_buffer> pool;
+
+	std::vector<utki::shared_ref<texture_upload>> uploads;
+
+	statistics stats;
+
+public:
+	/**
+	 * @param gl_state - state cache of the context owning the uploader.
+	 * @param census - resource census of the context owning the uploader, pixel buffer objects are counted in it.
+	 * @param async_supported - whether pixel buffer objects and sync objects are supported.
+	 */
+	texture_uploader(
+		state_cache& gl_state, //
+		resource_census& census,
+		bool async_supported
+	);
+
+	texture_uploader(const texture_uploader&) = delete;
+	texture_uploader& operator=(const texture_uploader&) = delete;
+
+	texture_uploader(texture_uploader&&) = delete;
+	texture_uploader& operator=(texture_uploader&&) = delete;
+
+	~texture_uploader();
+
+	bool is_async_supported() const noexcept
+	{
+		return this->async_supported;
+	}
+
+	/**
+	 * @brief Set number of bytes staged per frame.
+	 * At least one row of an image is staged per frame regardless of the budget.
+	 * @param bytes_per_frame - staging budget.
+	 */
+	void set_staging_budget(size_t bytes_per_frame) noexcept
+	{
+		this->staging_budget = bytes_per_frame;
+	}
+
+	/**
+	 * @brief Start uploading texture contents.
+	 * @param texture - texture to upload the contents to. Must not be placed in a texture atlas.
+	 * @param image - texture image. Must be of the texture dimensions and format.
+	 * @param generate_mipmap - whether to generate mipmaps after the upload.
+	 * @return Handle of the upload.
+	 */
+	utki::shared_ref<texture_upload> upload(
+		utki::shared_ref<texture_2d> texture, //
+		rasterimage::image_variant&& image,
+		bool generate_mipmap
+	);
+
+	/**
+	 * @brief Advance uploads.
+	 * Stages next portion of pixels and checks completion of submitted uploads.
+	 * Must be called once per frame, context::end_frame() does that for the uploader of the context.
+	 */
+	void end_frame();
+
+	/**
+	 * @brief Wait for the upload to be ready.
+	 * Stages the rest of the pixels and waits for completion of the upload.
+	 * @param u - upload to wait for.
+	 */
+	void wait(texture_upload& u);
+
+	const statistics& get_statistics() const noexcept
+	{
+		return this->stats;
+	}
+
+private:
+	pixel_buffer acquire(size_t size);
+	void release(pixel_buffer pb);
+
+	// returns number of staged bytes
+	size_t stage(texture_upload& u, size_t budget);
+
+	void submit(texture_upload& u);
+
+	// returns true if the upload is complete
+	bool poll(texture_upload& u, bool wait);
+
+	void upload_sync(texture_upload& u);
+
+	void on_ready(texture_upload& u);
+};
+
+} // namespace ruis::render::opengl
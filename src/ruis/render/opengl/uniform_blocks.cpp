@@ -0,0 +1,188 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#include "uniform_blocks.hpp"
+
+#include "resource_census.hpp"
+#include "state_cache.hpp"
+#include "util.hpp"
+
+using namespace ruis::render::opengl;
+
+namespace {
+// The shaders have no #version directive, i.e. those are GLSL 1.10,
+// so uniform blocks are enabled by the extension directive.
+constexpr const char* uniform_block_declarations = R"qwertyuiop(
+	#extension GL_ARB_uniform_buffer_object : enable
+
+	layout(std140) uniform per_frame {
+		vec4 frame_time;
+	};
+
+	layout(std140) uniform per_pass {
+		vec4 pass_viewport;
+	};
+)qwertyuiop";
+
+constexpr const char* plain_uniform_declarations = R"qwertyuiop(
+	uniform vec4 frame_time;
+
+	uniform vec4 pass_viewport;
+)qwertyuiop";
+
+static_assert(sizeof(uniform_blocks::per_frame_block) == 4 * sizeof(float), "must match std140 layout");
+static_assert(sizeof(uniform_blocks::per_pass_block) == 4 * sizeof(float), "must match std140 layout");
+
+// binding point of each uniform block is the block key
+GLuint to_binding_point(uniform_block b)
+{
+	return GLuint(b);
+}
+} // namespace
+
+uniform_blocks::uniform_blocks(
+	state_cache& state, //
+	resource_census& census,
+	bool supported
+) :
+	state(state),
+	census(census),
+	supported(supported)
+{
+	if (!this->supported) {
+		return;
+	}
+
+	glGenBuffers(GLsizei(this->buffers.size()), this->buffers.data());
+	assert_opengl_no_error();
+
+	auto init = [this](uniform_block b, const void* data, size_t size) {
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+		auto buffer = this->buffers[size_t(b)];
+
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		assert_opengl_no_error();
+		glBufferData(GL_UNIFORM_BUFFER, GLsizeiptr(size), data, GL_DYNAMIC_DRAW);
+		assert_opengl_no_error();
+
+		// the binding point is never changed, so bind the buffer to it once
+		glBindBufferBase(GL_UNIFORM_BUFFER, to_binding_point(b), buffer);
+		assert_opengl_no_error();
+
+		this->census.on_created(resource_kind::buffer, size);
+	};
+
+	init(uniform_block::per_frame, &this->frame, sizeof(this->frame));
+	init(uniform_block::per_pass, &this->pass, sizeof(this->pass));
+}
+
+uniform_blocks::~uniform_blocks()
+{
+	if (!this->supported) {
+		return;
+	}
+
+	this->census.on_destroyed(resource_kind::buffer, sizeof(this->frame));
+	this->census.on_destroyed(resource_kind::buffer, sizeof(this->pass));
+
+	glDeleteBuffers(GLsizei(this->buffers.size()), this->buffers.data());
+}
+
+const char* uniform_blocks::get_glsl_declarations() const noexcept
+{
+	if (this->supported) {
+		return uniform_block_declarations;
+	}
+	return plain_uniform_declarations;
+}
+
+void uniform_blocks::set_up_program(
+	GLuint program, //
+	const shader_reflection& reflection
+) const
+{
+	if (!this->supported) {
+		return;
+	}
+
+	for (size_t i = 0; i != size_t(uniform_block::enum_size); ++i) {
+		auto b = uniform_block(i);
+		auto index = reflection.get_block_index(b);
+		if (index == GL_INVALID_INDEX) {
+			// the block is not used by the program
+			continue;
+		}
+		glUniformBlockBinding(program, index, to_binding_point(b));
+		assert_opengl_no_error();
+	}
+}
+
+void uniform_blocks::upload(uniform_block b, const void* data, size_t size)
+{
+	if (!this->supported) {
+		return;
+	}
+
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-bounds-constant-array-index)
+	glBindBuffer(GL_UNIFORM_BUFFER, this->buffers[size_t(b)]);
+	assert_opengl_no_error();
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, GLsizeiptr(size), data);
+	assert_opengl_no_error();
+
+	this->state.get_statistics().buffer_bytes_uploaded += size;
+}
+
+void uniform_blocks::set_viewport_size(const r4::vector2<uint32_t>& viewport_size)
+{
+	auto size = viewport_size.to<float>();
+
+	auto& v = this->pass.pass_viewport;
+	if (v.x() == size.x() && v.y() == size.y()) {
+		return;
+	}
+
+	v = {
+		size.x(), //
+		size.y(),
+		size.x() == 0 ? 0 : 1 / size.x(),
+		size.y() == 0 ? 0 : 1 / size.y()
+	};
+
+	this->upload(uniform_block::per_pass, &this->pass, sizeof(this->pass));
+}
+
+void uniform_blocks::end_frame()
+{
+	using seconds = std::chrono::duration<float>;
+
+	auto now = std::chrono::steady_clock::now();
+
+	this->frame.frame_time = {
+		std::chrono::duration_cast<seconds>(now - this->start_time).count(),
+		std::chrono::duration_cast<seconds>(now - this->frame_start_time).count(),
+		0,
+		0
+	};
+
+	this->frame_start_time = now;
+
+	this->upload(uniform_block::per_frame, &this->frame, sizeof(this->frame));
+}
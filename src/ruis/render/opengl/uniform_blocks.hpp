@@ -0,0 +1,162 @@
+/*
+ruis-render-opengl - OpenGL renderer
+
+Copyright (C) 2012-2024  Ivan Gagis <igagis@gmail.com>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* ================ LICENSE END ================ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+
+#include <GL/glew.h>
+#include <r4/vector.hpp>
+
+#include "shader_reflection.hpp"
+
+namespace ruis::render::opengl {
+
+class resource_census;
+class state_cache;
+
+/**
+ * @brief Uniform data shared by all the shader programs.
+ * The data is grouped by update frequency into per-frame and per-pass uniform blocks.
+ * Each block is stored in a uniform buffer object, which is bound to its own binding point once,
+ * and all the programs have their blocks assigned to those binding points when linked.
+ * So, updating the data is a single buffer upload, regardless of the number of programs.
+ *
+ * In case uniform buffer objects are not supported, the same data is declared as plain uniforms,
+ * which are uploaded to each program when it is bound, unless the program already has the values.
+ *
+ * The declarations are prepended to the sources of every shader, see get_glsl_declarations().
+ * The declared GLSL variables are:
+ * - vec4 frame_time: x - seconds since the context creation, y - seconds since previous frame.
+ * - vec4 pass_viewport: x, y - viewport size in pixels, z, w - reciprocals of x and y.
+ */
+class uniform_blocks
+{
+public:
+	/**
+	 * @brief Per-frame uniform block.
+	 * Laid out according to std140 rules.
+	 */
+	struct per_frame_block {
+		r4::vector4<float> frame_time = {0, 0, 0, 0};
+	};
+
+	/**
+	 * @brief Per-pass uniform block.
+	 * Pass is rendering to a viewport, so the block is updated when the viewport size changes.
+	 * Laid out according to std140 rules.
+	 */
+	struct per_pass_block {
+		r4::vector4<float> pass_viewport = {0, 0, 0, 0};
+	};
+
+private:
+	state_cache& state;
+	resource_census& census;
+
+	const bool supported;
+
+	per_frame_block frame;
+	per_pass_block pass;
+
+	// uniform buffer objects, indexed by uniform_block
+	std::array<GLuint, size_t(uniform_block::enum_size)> buffers{};
+
+	std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point frame_start_time = start_time;
+
+	void upload(uniform_block b, const void* data, size_t size);
+
+public:
+	/**
+	 * @param state - state cache of the OpenGL context.
+	 * @param census - resource census of the OpenGL context.
+	 * @param supported - whether GL_ARB_uniform_buffer_object is supported.
+	 */
+	uniform_blocks(
+		state_cache& state, //
+		resource_census& census,
+		bool supported
+	);
+
+	uniform_blocks(const uniform_blocks&) = delete;
+	uniform_blocks& operator=(const uniform_blocks&) = delete;
+
+	uniform_blocks(uniform_blocks&&) = delete;
+	uniform_blocks& operator=(uniform_blocks&&) = delete;
+
+	~uniform_blocks();
+
+	/**
+	 * @brief Check if uniform buffer objects are used.
+	 * @return true if the data is stored in uniform buffer objects.
+	 * @return false if the data is passed as plain uniforms.
+	 */
+	bool is_supported() const noexcept
+	{
+		return this->supported;
+	}
+
+	/**
+	 * @brief Get GLSL declarations of the shared uniform data.
+	 * The declarations are to be placed before the shader source.
+	 * Can be called from any thread.
+	 * @return GLSL source code.
+	 */
+	const char* get_glsl_declarations() const noexcept;
+
+	/**
+	 * @brief Assign binding points to the uniform blocks of the program.
+	 * Does nothing in case uniform buffer objects are not supported.
+	 * @param program - linked program object.
+	 * @param reflection - reflection of the program.
+	 */
+	void set_up_program(
+		GLuint program, //
+		const shader_reflection& reflection
+	) const;
+
+	const per_frame_block& get_frame_data() const noexcept
+	{
+		return this->frame;
+	}
+
+	const per_pass_block& get_pass_data() const noexcept
+	{
+		return this->pass;
+	}
+
+	/**
+	 * @brief Update per-pass data for the viewport size.
+	 * The data is uploaded only if the viewport size has changed.
+	 * @param viewport_size - viewport size in pixels.
+	 */
+	void set_viewport_size(const r4::vector2<uint32_t>& viewport_size);
+
+	/**
+	 * @brief Update per-frame data for the next frame.
+	 * Called by context::end_frame().
+	 */
+	void end_frame();
+};
+
+} // namespace ruis::render::opengl
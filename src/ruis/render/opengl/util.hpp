@@ -23,6 +23,7 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <GL/glew.h>
 #include <utki/debug.hpp>
+#include <utki/span.hpp>
 
 namespace ruis::render::opengl {
 
@@ -91,4 +92,81 @@ inline void assert_opengl_no_error()
 #endif
 }
 
+// Instanced drawing is a part of the core OpenGL since version 3.3. On older versions
+// it is provided by GL_ARB_instanced_arrays and GL_ARB_draw_instanced extensions,
+// which have their own entry points.
+
+inline void vertex_attrib_divisor(GLuint index, GLuint divisor)
+{
+	if (glVertexAttribDivisor) {
+		glVertexAttribDivisor(index, divisor);
+	} else {
+		ASSERT(glVertexAttribDivisorARB)
+		glVertexAttribDivisorARB(index, divisor);
+	}
+	assert_opengl_no_error();
+}
+
+inline void draw_elements_instanced(
+	GLenum mode, //
+	GLsizei count,
+	GLenum type,
+	const GLvoid* indices,
+	GLsizei instance_count
+)
+{
+	if (glDrawElementsInstanced) {
+		glDrawElementsInstanced(mode, count, type, indices, instance_count);
+	} else {
+		ASSERT(glDrawElementsInstancedARB)
+		glDrawElementsInstancedARB(mode, count, type, indices, instance_count);
+	}
+	assert_opengl_no_error();
+}
+
+/**
+ * @brief Draw several index ranges with a single draw call.
+ * @param mode - primitive mode.
+ * @param counts - number of indices of each draw.
+ * @param type - index type.
+ * @param indices - offset of the first index of each draw within the element array buffer.
+ * @param base_vertices - value added to the indices of each draw.
+ *        Empty in case all the base vertices are zero, otherwise requires GL_ARB_draw_elements_base_vertex.
+ */
+inline void multi_draw_elements(
+	GLenum mode, //
+	utki::span<const GLsizei> counts,
+	GLenum type,
+	utki::span<const GLvoid* const> indices,
+	utki::span<const GLint> base_vertices
+)
+{
+	ASSERT(counts.size() == indices.size())
+
+	// Different GLEW versions declare the array parameters with different constness,
+	// the functions do not modify the arrays, so pass those as non-const to match any declaration.
+
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+	auto c = const_cast<GLsizei*>(counts.data());
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+	auto i = const_cast<GLvoid**>(indices.data());
+
+	if (base_vertices.empty()) {
+		glMultiDrawElements(mode, c, type, i, GLsizei(counts.size()));
+	} else {
+		ASSERT(base_vertices.size() == counts.size())
+		ASSERT(glMultiDrawElementsBaseVertex)
+		glMultiDrawElementsBaseVertex(
+			mode, //
+			c,
+			type,
+			i,
+			GLsizei(counts.size()),
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+			const_cast<GLint*>(base_vertices.data())
+		);
+	}
+	assert_opengl_no_error();
+}
+
 } // namespace ruis::render::opengl
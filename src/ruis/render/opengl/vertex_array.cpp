@@ -21,6 +21,8 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "vertex_array.hpp"
 
+#include <cstddef>
+
 #include "index_buffer.hpp"
 #include "util.hpp"
 #include "vertex_buffer.hpp"
@@ -33,38 +35,256 @@ vertex_array::vertex_array(
 	utki::shared_ref<const ruis::render::index_buffer> indices,
 	mode rendering_mode
 ) :
-	ruis::render::vertex_array(
+	vertex_array(
 		std::move(rendering_context), //
 		std::move(buffers),
+		{},
 		std::move(indices),
-		rendering_mode
+		rendering_mode,
+		1
 	)
 {}
 
-void vertex_array::bind_buffers() const
+vertex_array::vertex_array(
+	utki::shared_ref<const ruis::render::context> rendering_context, //
+	buffers_type buffers,
+	buffers_type instance_buffers,
+	utki::shared_ref<const ruis::render::index_buffer> indices,
+	mode rendering_mode,
+	size_t num_instances
+) :
+	ruis::render::vertex_array(
+		rendering_context, //
+		std::move(buffers),
+		std::move(indices),
+		rendering_mode
+	),
+	opengl_context(context::to_opengl_context(rendering_context)),
+	num_instances(num_instances),
+	instance_buffers(std::move(instance_buffers))
 {
-	for (unsigned i = 0; i != this->buffers.size(); ++i) {
-		ASSERT(dynamic_cast<const vertex_buffer*>(&this->buffers[i].get()))
+	ASSERT(this->buffers.size() + this->instance_buffers.size() <= sizeof(uint32_t) * 8)
+
+	const auto& ctx = this->opengl_context.get();
+
+	// per-instance attribute values are set from CPU side in case instanced drawing is not supported
+	if (!ctx.is_instancing_supported()) {
+		for (const auto& buf : this->instance_buffers) {
+			ASSERT(dynamic_cast<const vertex_buffer*>(&buf.get()))
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+			static_cast<const vertex_buffer&>(buf.get()).keep_fallback_data();
+		}
+	}
+
+	if (!ctx.supported_extensions.get(extension::arb_vertex_array_object)) {
+		return;
+	}
+
+	// vertex array objects are not shared between OpenGL contexts,
+	// so vertex arrays created on a resource loader thread do not use those
+	if (ctx.is_loader_thread()) {
+		return;
+	}
+
+	glGenVertexArrays(1, &this->vao);
+	assert_opengl_no_error();
+
+	auto& state = ctx.get_state_cache();
+
+	// newly created vertex array object has no element array buffer bound
+	state.bind_vertex_array(this->vao, 0);
+
+	this->set_up_attributes(state);
+	this->arena_generation = ctx.get_vertex_buffer_arena().get_generation();
+	this->element_buffer = this->get_index_buffer().get_buffer();
+
+	state.bind_vertex_array(0);
+}
+
+vertex_array::~vertex_array()
+{
+	if (this->vao != 0) {
+		this->opengl_context.get().get_state_cache().delete_vertex_array_object(this->vao);
+	}
+}
+
+const index_buffer& vertex_array::get_index_buffer() const
+{
+	ASSERT(dynamic_cast<const index_buffer*>(&this->indices.get()))
+	// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+	return static_cast<const index_buffer&>(this->indices.get());
+}
+
+void vertex_array::set_up_attributes(state_cache& state) const
+{
+	// In case instanced drawing is not supported, per-instance attribute arrays are left disabled
+	// and the per-instance attribute values are set for each instance by set_instance_attributes().
+	bool instance_arrays = this->is_instanced() && this->opengl_context.get().is_instancing_supported();
+
+	auto num_arrays = unsigned(this->buffers.size());
+	if (instance_arrays) {
+		num_arrays += unsigned(this->instance_buffers.size());
+	}
+
+	uint32_t instanced_mask = 0;
+
+	for (unsigned i = 0; i != num_arrays; ++i) {
+		bool per_instance = i >= this->buffers.size();
+
+		const auto& buf = per_instance ? this->instance_buffers[i - this->buffers.size()] : this->buffers[i];
+
+		ASSERT(dynamic_cast<const vertex_buffer*>(&buf.get()))
 		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
-		const auto& vbo = static_cast<const vertex_buffer&>(this->buffers[i].get());
-		glBindBuffer(GL_ARRAY_BUFFER, vbo.buffer);
+		const auto& vbo = static_cast<const vertex_buffer&>(buf.get());
+		state.bind_buffer(GL_ARRAY_BUFFER, vbo.get_buffer());
+
+		glVertexAttribPointer(
+			i, //
+			vbo.num_components,
+			vbo.type,
+			GL_FALSE,
+			0,
+			// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, performance-no-int-to-ptr)
+			reinterpret_cast<const GLvoid*>(vbo.get_offset())
+		);
 		assert_opengl_no_error();
 
-		//		TRACE(<< "vbo.numComponents = " << vbo.numComponents << "
-		// vbo.type = " << vbo.type << std::endl)
+		if (per_instance) {
+			instanced_mask |= uint32_t(1) << i;
+		}
 
-		glVertexAttribPointer(i, vbo.num_components, vbo.type, GL_FALSE, 0, nullptr);
-		assert_opengl_no_error();
+		if (this->vao != 0 && state.get_vertex_array_object() == this->vao) {
+			glEnableVertexAttribArray(i);
+			assert_opengl_no_error();
+
+			if (per_instance) {
+				vertex_attrib_divisor(i, 1);
+			}
+		}
+	}
+
+	if (state.get_vertex_array_object() == 0) {
+		state.set_enabled_vertex_attribs(num_arrays);
+		state.set_instanced_vertex_attribs(instanced_mask);
+	}
+
+	state.bind_buffer(GL_ELEMENT_ARRAY_BUFFER, this->get_index_buffer().get_buffer());
+}
+
+void vertex_array::bind(const context& rendering_context) const
+{
+	auto& state = rendering_context.get_state_cache();
+
+	if (this->vao != 0 && &rendering_context == &this->opengl_context.get()) {
+		state.bind_vertex_array(this->vao, this->element_buffer);
+
+		auto generation = rendering_context.get_vertex_buffer_arena().get_generation();
+		auto element_buffer = this->get_index_buffer().get_buffer();
+		if (generation != this->arena_generation || element_buffer != this->element_buffer) {
+			// vertex buffers were moved within the arena pages or some buffers were moved out of the arenas
+			this->set_up_attributes(state);
+			this->arena_generation = generation;
+			this->element_buffer = element_buffer;
+		}
+		return;
+	}
+
+	// vertex array objects are not supported or rendering is done within another context
+	state.bind_vertex_array(0);
+	this->set_up_attributes(state);
+}
+
+void vertex_array::set_instance_attributes(size_t instance) const
+{
+	ASSERT(instance < this->num_instances)
+
+	for (unsigned i = 0; i != this->instance_buffers.size(); ++i) {
+		ASSERT(dynamic_cast<const vertex_buffer*>(&this->instance_buffers[i].get()))
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+		const auto& vbo = static_cast<const vertex_buffer&>(this->instance_buffers[i].get());
+
+		ASSERT(vbo.type == GL_FLOAT)
+
+		auto num_components = size_t(vbo.num_components);
+		auto data = vbo.get_fallback_data();
+		ASSERT((instance + 1) * num_components <= data.size())
+
+		const float* v = data.subspan(instance * num_components).data();
 
-		glEnableVertexAttribArray(i);
+		auto index = GLuint(this->buffers.size() + i);
+
+		switch (num_components) {
+			case 1:
+				glVertexAttrib1fv(index, v);
+				break;
+			case 2:
+				glVertexAttrib2fv(index, v);
+				break;
+			case 3:
+				glVertexAttrib3fv(index, v);
+				break;
+			default:
+				ASSERT(num_components == 4)
+				glVertexAttrib4fv(index, v);
+				break;
+		}
 		assert_opengl_no_error();
 	}
+}
 
+std::optional<GLint> vertex_array::get_base_vertex(const vertex_array& va) const
+{
+	if (this->rendering_mode != va.rendering_mode || this->is_instanced() || va.is_instanced() ||
+		this->buffers.size() != va.buffers.size())
 	{
-		ASSERT(dynamic_cast<const index_buffer*>(&this->indices.get()))
+		return std::nullopt;
+	}
+
+	const auto& ib = this->get_index_buffer();
+	const auto& va_ib = va.get_index_buffer();
+	if (ib.get_buffer() != va_ib.get_buffer() || ib.element_type != va_ib.element_type) {
+		return std::nullopt;
+	}
+
+	std::optional<std::ptrdiff_t> base_vertex;
+
+	for (size_t i = 0; i != this->buffers.size(); ++i) {
+		ASSERT(dynamic_cast<const vertex_buffer*>(&this->buffers[i].get()))
+		ASSERT(dynamic_cast<const vertex_buffer*>(&va.buffers[i].get()))
 		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
-		const auto& ivbo = static_cast<const index_buffer&>(this->indices.get());
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ivbo.buffer);
-		assert_opengl_no_error();
+		const auto& vbo = static_cast<const vertex_buffer&>(this->buffers[i].get());
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-static-cast-downcast)
+		const auto& va_vbo = static_cast<const vertex_buffer&>(va.buffers[i].get());
+
+		if (vbo.get_buffer() != va_vbo.get_buffer() || vbo.num_components != va_vbo.num_components ||
+			vbo.type != va_vbo.type || vbo.type != GL_FLOAT)
+		{
+			return std::nullopt;
+		}
+
+		auto stride = std::ptrdiff_t(vbo.num_components) * std::ptrdiff_t(sizeof(GLfloat));
+		auto diff = std::ptrdiff_t(vbo.get_offset()) - std::ptrdiff_t(va_vbo.get_offset());
+		if (diff % stride != 0) {
+			return std::nullopt;
+		}
+
+		auto bv = diff / stride;
+		if (base_vertex && *base_vertex != bv) {
+			return std::nullopt;
+		}
+		base_vertex = bv;
+	}
+
+	if (!base_vertex) {
+		// no vertex buffers
+		return 0;
 	}
+
+	if (*base_vertex != 0 &&
+		!this->opengl_context.get().supported_extensions.get(extension::arb_draw_elements_base_vertex))
+	{
+		return std::nullopt;
+	}
+
+	return GLint(*base_vertex);
 }
@@ -21,15 +21,42 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <optional>
+
 #include <GL/glew.h>
 #include <ruis/render/vertex_array.hpp>
 
+#include "context.hpp"
+
 namespace ruis::render::opengl {
 
+class index_buffer;
+
 class vertex_array : public ruis::render::vertex_array
 {
+	const utki::shared_ref<const context> opengl_context;
+
+	// Native OpenGL vertex array object, 0 if not supported.
+	// Vertex array objects cannot be shared between OpenGL contexts, so it is only
+	// used when rendering within the context which has created the vertex array.
+	GLuint vao = 0;
+
+	// Generation of the vertex buffer arena at the moment of setting up the vertex array object.
+	// In case the arena was defragmented since then, the attribute offsets have to be set up again.
+	mutable unsigned arena_generation = 0;
+
+	// Index buffer object bound to the vertex array object.
+	// It changes in case the index buffer is moved out of the index buffer arena.
+	mutable GLuint element_buffer = 0;
+
+	size_t num_instances = 1;
+
 public:
-	// NOTE: The native OpenGL Vertex Array Object is not used because it cannot be shared between OpenGL contexts.
+	/**
+	 * @brief Per-instance vertex buffers.
+	 * Vertex attribute indices of per-instance buffers follow the ones of per-vertex buffers.
+	 */
+	const buffers_type instance_buffers;
 
 	vertex_array(
 		utki::shared_ref<const ruis::render::context> rendering_context, //
@@ -38,17 +65,82 @@ public:
 		mode rendering_mode
 	);
 
+	/**
+	 * @brief Create instanced vertex array.
+	 * @param rendering_context - rendering context.
+	 * @param buffers - per-vertex buffers.
+	 * @param instance_buffers - per-instance buffers.
+	 * @param indices - index buffer.
+	 * @param rendering_mode - rendering mode.
+	 * @param num_instances - number of instances to draw.
+	 */
+	vertex_array(
+		utki::shared_ref<const ruis::render::context> rendering_context, //
+		buffers_type buffers,
+		buffers_type instance_buffers,
+		utki::shared_ref<const ruis::render::index_buffer> indices,
+		mode rendering_mode,
+		size_t num_instances
+	);
+
 	vertex_array(const vertex_array&) = delete;
 	vertex_array& operator=(const vertex_array&) = delete;
 
 	vertex_array(vertex_array&&) = delete;
 	vertex_array& operator=(vertex_array&&) = delete;
 
-	~vertex_array() override = default;
-
-	void bind_buffers() const;
+	~vertex_array() override;
+
+	/**
+	 * @brief Bind vertex array for rendering.
+	 * @param rendering_context - context within which the rendering is done.
+	 */
+	void bind(const context& rendering_context) const;
+
+	bool is_instanced() const noexcept
+	{
+		return !this->instance_buffers.empty();
+	}
+
+	size_t get_num_instances() const noexcept
+	{
+		return this->num_instances;
+	}
+
+	/**
+	 * @brief Set number of instances to draw.
+	 * Per-instance buffers must have at least the given number of elements.
+	 * @param num - number of instances.
+	 */
+	void set_num_instances(size_t num) noexcept
+	{
+		this->num_instances = num;
+	}
+
+	/**
+	 * @brief Set per-instance vertex attributes to values of the given instance.
+	 * Used for drawing instances one by one in case instanced drawing is not supported.
+	 * In this case per-instance vertex attribute arrays are disabled and
+	 * the attribute values are set from CPU-side copies of the per-instance buffers.
+	 * @param instance - index of the instance.
+	 */
+	void set_instance_attributes(size_t instance) const;
+
+	/**
+	 * @brief Get base vertex for drawing this vertex array with vertex attribute setup of another one.
+	 * Vertex arrays whose vertex buffers are sub-allocated from the same buffer arena pages differ
+	 * only in offsets of the vertex data. In case the offsets of all the vertex buffers differ
+	 * by the same number of vertices, the vertex arrays can be drawn by a single draw call with base vertices.
+	 * @param va - vertex array whose vertex attribute setup is used for drawing.
+	 * @return base vertex to draw indices of this vertex array with.
+	 * @return std::nullopt in case this vertex array cannot be drawn with vertex attribute setup of va.
+	 */
+	std::optional<GLint> get_base_vertex(const vertex_array& va) const;
 
 private:
+	void set_up_attributes(state_cache& state) const;
+
+	const index_buffer& get_index_buffer() const;
 };
 
 } // namespace ruis::render::opengl
@@ -21,71 +21,207 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "vertex_buffer.hpp"
 
+#include <algorithm>
+#include <iterator>
+
 #include "util.hpp"
 
 using namespace ruis::render::opengl;
 
-void vertex_buffer::init(GLsizeiptr size, const GLvoid* data)
+namespace {
+template <typename vector_type>
+utki::span<const float> to_floats(utki::span<const vector_type> vertices)
 {
-	glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
-	assert_opengl_no_error();
+	static_assert(sizeof(vector_type) % sizeof(float) == 0);
+	return utki::make_span(
+		// NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast, "vectors are arrays of floats")
+		reinterpret_cast<const float*>(vertices.data()),
+		vertices.size_bytes() / sizeof(float)
+	);
+}
+} // namespace
+
+void vertex_buffer::init(
+	utki::span<const float> data, //
+	buffer_usage usage
+)
+{
+	this->opengl_context.get().get_state_cache().bind_buffer(GL_ARRAY_BUFFER, this->get_buffer());
+
+	this->allocate(
+		GL_ARRAY_BUFFER, //
+		data.data(),
+		data.size_bytes(),
+		usage
+	);
+}
+
+void vertex_buffer::keep_fallback_data() const
+{
+	ASSERT(this->type == GL_FLOAT)
+
+	if (!this->fallback_data.empty()) {
+		return;
+	}
+
+	this->fallback_data.resize(this->get_size_bytes() / sizeof(float));
 
-	glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+	this->opengl_context.get().get_state_cache().bind_buffer(GL_ARRAY_BUFFER, this->get_buffer());
+
+	// the read back stalls, but it is done only once per buffer
+	glGetBufferSubData(
+		GL_ARRAY_BUFFER, //
+		GLintptr(this->get_offset()),
+		GLsizeiptr(this->fallback_data.size() * sizeof(float)),
+		this->fallback_data.data()
+	);
 	assert_opengl_no_error();
 }
 
+void vertex_buffer::update_data(
+	size_t first, //
+	utki::span<const float> data
+)
+{
+	ASSERT(this->type == GL_FLOAT)
+
+	auto offset = first * size_t(this->num_components);
+
+	this->opengl_context.get().get_state_cache().bind_buffer(GL_ARRAY_BUFFER, this->get_buffer());
+
+	this->opengl_buffer::update(
+		GL_ARRAY_BUFFER, //
+		offset * sizeof(float),
+		data.data(),
+		data.size_bytes()
+	);
+
+	if (!this->fallback_data.empty()) {
+		ASSERT(offset + data.size() <= this->fallback_data.size())
+		std::copy(
+			data.begin(), //
+			data.end(),
+			std::next(this->fallback_data.begin(), std::ptrdiff_t(offset))
+		);
+	}
+}
+
+void vertex_buffer::update(
+	size_t first, //
+	utki::span<const r4::vector4<float>> vertices
+)
+{
+	ASSERT(this->num_components == 4)
+	this->update_data(first, to_floats(vertices));
+}
+
+void vertex_buffer::update(
+	size_t first, //
+	utki::span<const r4::vector3<float>> vertices
+)
+{
+	ASSERT(this->num_components == 3)
+	this->update_data(first, to_floats(vertices));
+}
+
+void vertex_buffer::update(
+	size_t first, //
+	utki::span<const r4::vector2<float>> vertices
+)
+{
+	ASSERT(this->num_components == 2)
+	this->update_data(first, to_floats(vertices));
+}
+
+void vertex_buffer::update(
+	size_t first, //
+	utki::span<const float> vertices
+)
+{
+	ASSERT(this->num_components == 1)
+	this->update_data(first, vertices);
+}
+
 vertex_buffer::vertex_buffer(
 	utki::shared_ref<const ruis::render::context> rendering_context, //
-	utki::span<const r4::vector4<float>> vertices
+	utki::span<const r4::vector4<float>> vertices,
+	buffer_usage usage
 ) :
 	ruis::render::vertex_buffer(
-		std::move(rendering_context), //
+		rendering_context, //
 		vertices.size()
 	),
+	opengl_buffer(
+		rendering_context, //
+		GL_ARRAY_BUFFER,
+		vertices.size_bytes(),
+		usage
+	),
 	num_components(4),
 	type(GL_FLOAT)
 {
-	this->init(GLsizeiptr(vertices.size_bytes()), vertices.data());
+	this->init(to_floats(vertices), usage);
 }
 
 vertex_buffer::vertex_buffer(
 	utki::shared_ref<const ruis::render::context> rendering_context, //
-	utki::span<const r4::vector3<float>> vertices
+	utki::span<const r4::vector3<float>> vertices,
+	buffer_usage usage
 ) :
 	ruis::render::vertex_buffer(
-		std::move(rendering_context), //
+		rendering_context, //
 		vertices.size()
 	),
+	opengl_buffer(
+		rendering_context, //
+		GL_ARRAY_BUFFER,
+		vertices.size_bytes(),
+		usage
+	),
 	num_components(3),
 	type(GL_FLOAT)
 {
-	this->init(GLsizeiptr(vertices.size_bytes()), vertices.data());
+	this->init(to_floats(vertices), usage);
 }
 
 vertex_buffer::vertex_buffer(
 	utki::shared_ref<const ruis::render::context> rendering_context, //
-	utki::span<const r4::vector2<float>> vertices
+	utki::span<const r4::vector2<float>> vertices,
+	buffer_usage usage
 ) :
 	ruis::render::vertex_buffer(
-		std::move(rendering_context), //
+		rendering_context, //
 		vertices.size()
 	),
+	opengl_buffer(
+		rendering_context, //
+		GL_ARRAY_BUFFER,
+		vertices.size_bytes(),
+		usage
+	),
 	num_components(2),
 	type(GL_FLOAT)
 {
-	this->init(GLsizeiptr(vertices.size_bytes()), vertices.data());
+	this->init(to_floats(vertices), usage);
 }
 
 vertex_buffer::vertex_buffer(
 	utki::shared_ref<const ruis::render::context> rendering_context, //
-	utki::span<const float> vertices
+	utki::span<const float> vertices,
+	buffer_usage usage
 ) :
 	ruis::render::vertex_buffer(
-		std::move(rendering_context), //
+		rendering_context, //
 		vertices.size()
 	),
+	opengl_buffer(
+		rendering_context, //
+		GL_ARRAY_BUFFER,
+		vertices.size_bytes(),
+		usage
+	),
 	num_components(1),
 	type(GL_FLOAT)
 {
-	this->init(GLsizeiptr(vertices.size_bytes()), vertices.data());
+	this->init(to_floats(vertices), usage);
 }
@@ -21,6 +21,8 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <vector>
+
 #include <r4/vector.hpp>
 #include <ruis/render/vertex_buffer.hpp>
 #include <utki/span.hpp>
@@ -33,28 +35,37 @@ class vertex_buffer :
 	public ruis::render::vertex_buffer, //
 	public opengl_buffer
 {
+	// CPU-side copy of the buffer data.
+	// Only kept for per-instance buffers in case the context does not support instanced drawing,
+	// because in that case per-instance vertex attributes are set from CPU side.
+	mutable std::vector<float> fallback_data;
+
 public:
 	const GLint num_components;
 	const GLenum type;
 
 	vertex_buffer(
 		utki::shared_ref<const ruis::render::context> rendering_context, //
-		utki::span<const r4::vector4<float>> vertices
+		utki::span<const r4::vector4<float>> vertices,
+		buffer_usage usage = buffer_usage::static_draw
 	);
 
 	vertex_buffer(
 		utki::shared_ref<const ruis::render::context> rendering_context, //
-		utki::span<const r4::vector3<float>> vertices
+		utki::span<const r4::vector3<float>> vertices,
+		buffer_usage usage = buffer_usage::static_draw
 	);
 
 	vertex_buffer(
 		utki::shared_ref<const ruis::render::context> rendering_context, //
-		utki::span<const r4::vector2<float>> vertices
+		utki::span<const r4::vector2<float>> vertices,
+		buffer_usage usage = buffer_usage::static_draw
 	);
 
 	vertex_buffer(
 		utki::shared_ref<const ruis::render::context> rendering_context, //
-		utki::span<const float> vertices
+		utki::span<const float> vertices,
+		buffer_usage usage = buffer_usage::static_draw
 	);
 
 	vertex_buffer(const vertex_buffer&) = delete;
@@ -65,8 +76,59 @@ public:
 
 	~vertex_buffer() override = default;
 
+	/**
+	 * @brief Update vertices.
+	 * The number of vertex components must match the one of the buffer.
+	 * @param first - index of the first vertex to update.
+	 * @param vertices - new vertex values.
+	 */
+	void update(
+		size_t first, //
+		utki::span<const r4::vector4<float>> vertices
+	);
+
+	void update(
+		size_t first, //
+		utki::span<const r4::vector3<float>> vertices
+	);
+
+	void update(
+		size_t first, //
+		utki::span<const r4::vector2<float>> vertices
+	);
+
+	void update(
+		size_t first, //
+		utki::span<const float> vertices
+	);
+
+	/**
+	 * @brief Keep CPU-side copy of the buffer data.
+	 * Called by vertex arrays for their per-instance buffers in case the context does not support
+	 * instanced drawing. The buffer data is read back once, after that the copy is kept up to date on updates.
+	 */
+	void keep_fallback_data() const;
+
+	/**
+	 * @brief Get CPU-side copy of the buffer data.
+	 * @return CPU-side copy of the buffer data in case keep_fallback_data() was called.
+	 * @return empty span otherwise.
+	 */
+	utki::span<const float> get_fallback_data() const noexcept
+	{
+		return utki::make_span(this->fallback_data);
+	}
+
 private:
-	void init(GLsizeiptr size, const GLvoid* data);
+	void init(
+		utki::span<const float> data, //
+		buffer_usage usage
+	);
+
+	void update_data(
+		size_t first, //
+		utki::span<const float> data
+	);
 };
 
 } // namespace ruis::render::opengl